@@ -109,10 +109,13 @@ using STL_Address = BaseAddress<std::string>;
  * @param address
  * @param socketType
  * @param isTcp If true, establish a TCP connection. Else, UDP.
+ * @param backlog The maximum number of connections waiting to be accepted. Only used for TCP servers.
+ * @param reusePort If true, other sockets can listen on the same port. Only used for servers.
  *
  * @return True if successful
  */
-extern bool openSocket(SOCKET &socket, const Address &address, const SocketType socketType, const bool isTcp);
+extern bool openSocket(SOCKET &socket, const Address &address, const SocketType socketType, const bool isTcp,
+					   const int backlog = SOMAXCONN, const bool reusePort = false);
 
 /**
  * @brief Open a socket with these parameters
@@ -121,13 +124,17 @@ extern bool openSocket(SOCKET &socket, const Address &address, const SocketType
  * @param address
  * @param socketType
  * @param isTcp If true, establish a TCP connection. Else, UDP.
+ * @param backlog The maximum number of connections waiting to be accepted. Only used for TCP servers.
+ * @param reusePort If true, other sockets can listen on the same port. Only used for servers.
  *
  * @return This pointer to a socket connection or nullptr
  */
-template <typename T> unique_ptr<T> openSocket(const Address &address, const SocketType socketType, const bool isTcp)
+template <typename T>
+unique_ptr<T> openSocket(const Address &address, const SocketType socketType, const bool isTcp,
+						 const int backlog = SOMAXCONN, const bool reusePort = false)
 {
 	SOCKET fd = INVALID_SOCKET;
-	if (!openSocket(fd, address, socketType, isTcp))
+	if (!openSocket(fd, address, socketType, isTcp, backlog, reusePort))
 	{
 		return nullptr;
 	}
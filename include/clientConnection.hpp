@@ -26,19 +26,83 @@ class ClientConnection : public Connection
 	Message::VerifyLogin verifyLogin;
 	Message::ServerInformation serverInformation;
 	TimePoint lastSentMessage;
-	bool opened;
+	std::thread thread;
+	std::function<void()> onClose;
+#if __linux__
+	int eventFd;
+#endif
+	std::atomic_bool opened;
+
+	// Audio and video frames go over UDP once the server opens a media channel
+	shared_ptr<UdpSocket> mediaSocket;
+	// Datagrams from anywhere else are dropped
+	SocketAddress mediaServer;
+	MediaSender mediaSender;
+	MediaReceiver mediaReceiver;
+	TimePoint lastMediaHello;
+	uint32_t mediaToken;
+	MediaHeader::Key mediaKey;
+	uint32_t mediaHellos;
+	std::atomic_bool mediaReady;
+
+	/**
+	 * Read and write until the connection is closed
+	 */
+	void run();
+
+	/**
+	 * Open the media channel that the server offered. Frames are sent over TCP until the server answers.
+	 *
+	 * @param channel
+	 */
+	void openMedia(const Message::MediaChannel &);
+
+	/**
+	 * Read datagrams from the media channel, ask for missing keyframes and keep saying hello until the server answers
+	 */
+	void handleMedia();
+
+	/**
+	 * Wait until the socket can be read, the socket can be written (if writing), or the connection is woken up
+	 *
+	 * @param writing
+	 * @param timeout
+	 *
+	 * @return GotData if the socket can be read
+	 */
+	PollState wait(bool writing, int timeout);
+
+	/**
+	 * Wake up the thread from ::wait
+	 */
+	void wake();
 
   public:
+	/**
+	 * Number of times to say hello on the media channel before giving up on it
+	 */
+	static constexpr uint32_t MaxMediaHellos = 10;
+
 	ClientConnection(TemStreamGui &, const Address &, unique_ptr<Socket>);
 	ClientConnection(const ClientConnection &) = delete;
 	ClientConnection(ClientConnection &&) = delete;
 	virtual ~ClientConnection();
 
 	/**
-	 * Packets are enqueued in a list. The will be sent when ::flushPackets() is called
+	 * Start the thread that handles this connection. The thread sleeps until the socket can be read, the socket can be
+	 * written while bytes are waiting to be sent, or a packet is queued. The socket will be set to non-blocking mode.
+	 *
+	 * @param onClose called from the thread when the connection closes
+	 *
+	 * @return True if successful
+	 */
+	bool start(std::function<void()> &&onClose);
+
+	/**
+	 * Packets are enqueued in a list. Once the thread is started, they are sent as soon as the socket can be written.
 	 *
 	 * @param packet
-	 * @param sendImmediately Will call flush if true
+	 * @param sendImmediately Will call flush if true and the thread hasn't started
 	 *
 	 * @return True if the flush call is successful (if it was called). Otherwise, always true
 	 */
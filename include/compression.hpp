@@ -0,0 +1,60 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * Smallest message that is compressed unless configured otherwise
+ */
+constexpr uint32_t DefaultCompressMinBytes = 256;
+
+/**
+ * Check if messages of this type are worth compressing. Text, chat, links, server information and replays are.
+ * Images, audio and video are already compressed.
+ *
+ * @param type Index of the payload in Message::Payload
+ *
+ * @return True if the message should be compressed
+ */
+extern bool isCompressible(size_t type);
+
+/**
+ * Compress a serialized message with zlib. The size of the message is written first as 4 little endian bytes. Chat
+ * messages are compressed with a dictionary of common words so short messages shrink too.
+ *
+ * @param data
+ * @param size
+ * @param type Index of the payload in Message::Payload
+ *
+ * @return The compressed bytes or nullptr if they wouldn't be smaller
+ */
+extern SharedBytes compressMessage(const uint8_t *, uint32_t, size_t type);
+
+/**
+ * Decompress a message made by ::compressMessage
+ *
+ * @param data
+ * @param size
+ * @param type Index of the payload in Message::Payload
+ * @param maxSize Largest message allowed
+ * @param bytes [out] The message
+ *
+ * @return False if the bytes were invalid or the message is too large
+ */
+extern bool decompressMessage(const uint8_t *, size_t, size_t type, uint64_t maxSize, ByteList &);
+} // namespace TemStream
\ No newline at end of file
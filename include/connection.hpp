@@ -21,15 +21,93 @@ namespace TemStream
 class Connection
 {
   private:
-	ByteList bytes;
+	ByteList readBuffer;
+	RingBuffer pending;
 	ConcurrentQueue<Message::Packet> packets;
 	std::optional<uint64_t> nextMessageSize;
+	uint32_t nextStreamId;
+	uint8_t nextType;
+	bool nextHasSource;
+	bool nextCompressed;
+	// True once a valid header was received
+	bool gotHeader;
+	// Compressed messages are decompressed into this buffer
+	ByteList decompressed;
+	// Sources that the peer gave stream ids to
+	Map<uint32_t, Message::Source> streamSources;
+	mutable Mutex streamMutex;
+
+	/**
+	 * Decode the next header or packet from the start of the bytes
+	 *
+	 * @param data
+	 * @param size
+	 *
+	 * @return The number of bytes used, 0 if more bytes are needed, or std::nullopt if the bytes were invalid
+	 */
+	std::optional<size_t> decode(const uint8_t *, size_t);
 
   protected:
+	/**
+	 * Decode a header of any framing. A peer that sends a newer header is sent that framing from then on.
+	 *
+	 * @param data
+	 * @param size
+	 *
+	 * @return The number of bytes used, 0 if more bytes are needed, or std::nullopt if the header was invalid
+	 */
+	std::optional<size_t> decodeHeader(const uint8_t *, size_t);
+
 	const Address address;
 	unique_ptr<Socket> mSocket;
 	uint64_t maxMessageSize;
 
+	/**
+	 * Called with the bytes of each message before they are deserialized. Called from the thread that reads the
+	 * socket.
+	 *
+	 * @param data Serialized Message::Packet
+	 * @param size
+	 * @param streamId From the header. 0 if there wasn't one.
+	 * @param hasSource If false, the packet's source was left out
+	 *
+	 * @return True if the message was handled and shouldn't be deserialized
+	 */
+	virtual bool tryForward(const uint8_t *, size_t, uint32_t, bool)
+	{
+		return false;
+	}
+
+	/**
+	 * Get the source of a packet that was sent without one
+	 *
+	 * @param streamId
+	 * @param source
+	 *
+	 * @return True if the stream id is known
+	 */
+	virtual bool resolveSource(uint32_t, Message::Source &);
+
+	/**
+	 * Remember the source that the peer gave a stream id to so later packets can be sent without it
+	 *
+	 * @param streamId
+	 * @param source
+	 */
+	virtual void addSource(uint32_t, const Message::Source &);
+
+	/**
+	 * Deserialize a message and add it to the list of packets
+	 *
+	 * @param data Serialized Message::Packet
+	 * @param size
+	 * @param streamId 0 if there isn't one
+	 * @param hasSource If false, the packet's source is found with the stream id
+	 *
+	 * @return False if the message was invalid
+	 */
+	bool decodePacket(const uint8_t *, size_t, uint32_t streamId, bool hasSource);
+
   public:
 	Connection(const Address &, unique_ptr<Socket>);
 	Connection(const Connection &) = delete;
@@ -57,6 +135,35 @@ class Connection
 	}
 
 	bool readAndHandle(const int);
+
+	/**
+	 * Check if the peer has sent a valid header (i.e. it understood the framing that was sent to it)
+	 *
+	 * @return True if a header was received
+	 */
+	bool receivedHeader() const
+	{
+		return gotHeader;
+	}
+
+	/**
+	 * Get the id that the peer gave to the source
+	 *
+	 * @param source
+	 *
+	 * @return the stream id or 0 if there isn't one
+	 */
+	uint32_t getStreamId(const Message::Source &) const;
+
+	/**
+	 * Handle bytes that were read from the socket by someone else (i.e. an io_uring completion)
+	 *
+	 * @param data
+	 * @param size
+	 *
+	 * @return True if the bytes were valid
+	 */
+	bool receive(const uint8_t *, uint32_t);
 };
 
 } // namespace TemStream
\ No newline at end of file
@@ -158,15 +158,6 @@ class TemStreamGui
 	bool addConnection(const shared_ptr<ClientConnection> &);
 	void removeConnection(const Message::Source &);
 
-	/**
-	 * Read incoming packets from this connection and send enqueued packets to the peer
-	 *
-	 * @param con
-	 *
-	 * @return False, if the connection has been closed
-	 */
-	bool handleClientConnection(ClientConnection &con);
-
 	/**
 	 * Push the font based on the index to ImGui
 	 */
@@ -259,28 +250,45 @@ class TemStreamGui
 	static bool startReplay(ClientConnection &);
 
 	/**
-	 * Get one second of replays within a time frame from the server
+	 * Ask the server to stream the replays within a time frame
 	 *
 	 * @param source
-	 * @param timestamp
+	 * @param range
 	 *
 	 * @return True if the request was sent successfully
 	 */
-	bool getReplays(const Message::Source &, int64_t);
+	bool getReplays(const Message::Source &, const Message::GetReplayRange &);
 
 	/**
-	 * See TemStreamGui::getReplays(const Message::Source &, int64_t)
+	 * See TemStreamGui::getReplays(const Message::Source &, const Message::GetReplayRange &)
 	 *
 	 * @param connection
-	 * @param timestamp
+	 * @param range
 	 *
 	 * @return True is successful
 	 */
-	static bool getReplays(ClientConnection &, int64_t);
+	static bool getReplays(ClientConnection &, const Message::GetReplayRange &);
+
+	/**
+	 * Let the server send more of a replay
+	 *
+	 * @param source
+	 * @param credit
+	 *
+	 * @return True if the message was sent successfully
+	 */
+	bool sendReplayCredit(const Message::Source &, const Message::ReplayCredit &);
 
 	bool hasReplayAccess(const Message::Source &);
 
-	void connect(const Address &);
+	/**
+	 * Connect to a stream in another thread
+	 *
+	 * @param address
+	 * @param serverName The stream to join. Only needed for servers that host more than one stream.
+	 * @param framing Servers that don't understand this framing close the connection. Then, the one before it is tried.
+	 */
+	void connect(const Address &, const String &serverName = String(), Framing = Framing::V3);
 
 	void setShowLogs(bool v)
 	{
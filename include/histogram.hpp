@@ -0,0 +1,48 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * Counts durations in buckets that double in size starting at 1 millisecond. Can be used from many threads.
+ */
+class Histogram
+{
+  public:
+	static constexpr size_t BucketCount = 16;
+
+  private:
+	std::array<std::atomic<uint64_t>, BucketCount> buckets;
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> totalMicroseconds;
+	std::atomic<uint64_t> maxMicroseconds;
+
+	friend std::ostream &operator<<(std::ostream &, const Histogram &);
+
+  public:
+	Histogram();
+	Histogram(const Histogram &) = delete;
+	Histogram(Histogram &&) = delete;
+	~Histogram();
+
+	void add(std::chrono::microseconds);
+
+	uint64_t getCount() const;
+};
+extern std::ostream &operator<<(std::ostream &, const Histogram &);
+} // namespace TemStream
\ No newline at end of file
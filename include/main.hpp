@@ -74,9 +74,14 @@ constexpr SOCKET INVALID_SOCKET = -1;
 #include <variant>
 #include <vector>
 
+#include <openssl/crypto.h>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
 #include <openssl/ssl.h>
 
+#include <zlib.h>
+
 #if __linux__
 using TimePoint = std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::duration<double, std::nano>>;
 #else
@@ -276,10 +281,14 @@ enum class SocketType
  * @param port
  * @param socketType
  * @param isTcp If true, establish a TCP connection. Else, UDP.
+ * @param backlog The maximum number of connections waiting to be accepted. Only used for TCP servers.
+ * @param reusePort If true, other sockets can listen on the same port. The kernel will spread new connections
+ * between them. Only used for servers.
  *
  * @return True if successful
  */
-extern bool openSocket(SOCKET &, const char *hostname, const char *port, const SocketType, const bool isTcp);
+extern bool openSocket(SOCKET &, const char *hostname, const char *port, const SocketType, const bool isTcp,
+					   const int backlog = SOMAXCONN, const bool reusePort = false);
 
 /**
  * Send data through socket
@@ -418,6 +427,8 @@ template <typename T> void cleanSwap(T &t)
 
 #include "memoryStream.hpp"
 
+#include "ringBuffer.hpp"
+
 #include "logger.hpp"
 #include "windowProcess.hpp"
 
@@ -431,8 +442,12 @@ template <typename T> void cleanSwap(T &t)
 
 #include "socket.hpp"
 
+#include "mediaChannel.hpp"
+
 #include "message.hpp"
 
+#include "compression.hpp"
+
 #include "concurrentMap.hpp"
 #include "concurrentQueue.hpp"
 
@@ -440,6 +455,8 @@ template <typename T> void cleanSwap(T &t)
 
 #include "time.hpp"
 
+#include "histogram.hpp"
+
 namespace std
 {
 template <typename T> ostream &operator<<(ostream &os, const optional<T> &value)
@@ -457,8 +474,14 @@ template <typename T> ostream &operator<<(ostream &os, const optional<T> &value)
 } // namespace std
 
 #if TEMSTREAM_SERVER
+#include "serverReplay.hpp"
 #include "serverConfiguration.hpp"
+#include "serverPeers.hpp"
+#include "serverStream.hpp"
 #include "serverConnection.hpp"
+#include "serverReactor.hpp"
+#include "serverUring.hpp"
+#include "serverMedia.hpp"
 #elif TEMSTREAM_CHAT_TEST
 #include "chatTester.hpp"
 #else
@@ -474,6 +497,7 @@ template <typename T> ostream &operator<<(ostream &os, const optional<T> &value)
 #include "clientConfiguration.hpp"
 #include "clientConnection.hpp"
 
+#include "replayPlayer.hpp"
 #include "streamDisplay.hpp"
 
 #include "gui.hpp"
@@ -0,0 +1,309 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * Kind of datagram sent on the media channel
+ */
+enum class MediaKind : uint8_t
+{
+	// Client asks the server to send media to the address the datagram came from. The server answers with the same.
+	// Followed by the HMAC-SHA256 of the header.
+	Hello = 1,
+	// Part of a serialized Message::Packet
+	Data,
+	// Sequences that the receiver is missing. Only keyframes are sent again.
+	Nack
+};
+
+/**
+ * Header at the start of every datagram on the media channel. Multi-byte fields are little endian.
+ *
+ * Audio and video frames are sent on the channel after a peer logs in over TCP (see Message::MediaChannel). Each
+ * message is split into datagrams that fit in a single IP packet on most networks.
+ */
+struct MediaHeader
+{
+	static constexpr uint8_t Magic = 'U';
+	static constexpr uint8_t Version = 1;
+
+	// Flags
+	static constexpr uint8_t Keyframe = 0x1;
+	static constexpr uint8_t HasSource = 0x2;
+
+	static constexpr uint32_t Size = 20;
+
+	// Key that Hello datagrams are signed with
+	using Key = std::array<uint8_t, 32>;
+
+	/**
+	 * Largest datagram that is sent. Leaves room for IP and UDP headers (and tunnels) within an Ethernet MTU.
+	 */
+	static constexpr uint32_t MaxDatagram = 1200;
+	static constexpr uint32_t MaxFragment = MaxDatagram - Size;
+
+	MediaKind kind;
+	uint8_t flags;
+	// Token of the peer when sent to the server. Stream id when sent to a client.
+	uint32_t id;
+	uint32_t sequence;
+	// Milliseconds since the sender was created
+	uint32_t timestamp;
+	uint16_t fragment;
+	uint16_t fragments;
+
+	/**
+	 * Write the header to the start of the bytes. There must be room for ::Size bytes.
+	 *
+	 * @param bytes
+	 */
+	void write(uint8_t *) const;
+
+	/**
+	 * Read the header from the start of a datagram
+	 *
+	 * @param data
+	 * @param size
+	 *
+	 * @return The header or std::nullopt if the datagram isn't from the media channel
+	 */
+	static std::optional<MediaHeader> read(const uint8_t *, size_t);
+
+	/**
+	 * Create a datagram without data (i.e. Nack)
+	 *
+	 * @param kind
+	 * @param id
+	 * @param sequences Sent after the header
+	 *
+	 * @return the datagram
+	 */
+	static SharedBytes makeControl(MediaKind, uint32_t id, const List<uint32_t> &sequences = {});
+
+	/**
+	 * Create a Hello datagram signed with the key. The sequence must grow with each Hello so that an old one can't be
+	 * sent again from another address.
+	 *
+	 * @param id
+	 * @param sequence
+	 * @param key
+	 *
+	 * @return the datagram
+	 */
+	static SharedBytes makeHello(uint32_t id, uint32_t sequence, const Key &);
+
+	/**
+	 * Check that a Hello datagram was signed with the key
+	 *
+	 * @param data
+	 * @param size
+	 * @param key
+	 *
+	 * @return True if the signature matches
+	 */
+	static bool verifyHello(const uint8_t *, size_t, const Key &);
+
+	/**
+	 * Read the sequences of a Nack datagram
+	 *
+	 * @param data
+	 * @param size
+	 *
+	 * @return the sequences
+	 */
+	static List<uint32_t> readSequences(const uint8_t *, size_t);
+};
+
+/**
+ * Splits messages into datagrams. Recent keyframes are kept so they can be sent again when a receiver is missing them.
+ */
+class MediaSender
+{
+  public:
+	using Datagrams = List<SharedBytes>;
+
+  private:
+	struct Keyframe
+	{
+		uint32_t sequence;
+		std::optional<uint64_t> author;
+		shared_ptr<const Datagrams> datagrams;
+	};
+
+	Mutex mutex;
+	Deque<Keyframe> keyframes;
+	const TimePoint start;
+	uint32_t nextSequence;
+
+  public:
+	/**
+	 * Number of keyframes that are kept for resending
+	 */
+	static constexpr size_t MaxKeyframes = 4;
+
+	MediaSender();
+	MediaSender(const MediaSender &) = delete;
+	MediaSender(MediaSender &&) = delete;
+	~MediaSender();
+
+	/**
+	 * Split a serialized Message::Packet into datagrams with the next sequence number
+	 *
+	 * @param data
+	 * @param size
+	 * @param id Written to every datagram
+	 * @param keyframe
+	 * @param hasSource If the packet ends with its source
+	 * @param author If the message is shared by many receivers, the one that won't be sent it again
+	 *
+	 * @return The datagrams or nullptr if the message is too large
+	 */
+	shared_ptr<const Datagrams> split(const uint8_t *, uint32_t, uint32_t id, bool keyframe, bool hasSource,
+									  std::optional<uint64_t> author = std::nullopt);
+
+	/**
+	 * Get the datagrams of kept keyframes with these sequences
+	 *
+	 * @param sequences
+	 * @param receiver Keyframes from this author are skipped
+	 *
+	 * @return the datagrams
+	 */
+	Datagrams resend(const List<uint32_t> &, std::optional<uint64_t> receiver = std::nullopt);
+};
+
+/**
+ * A message that was put back together from its datagrams
+ */
+struct MediaMessage
+{
+	ByteList bytes;
+	uint32_t id;
+	uint32_t sequence;
+	uint32_t timestamp;
+	bool keyframe;
+	bool hasSource;
+};
+
+/**
+ * Puts messages back together and returns them in order. A missing message is waited on for a short time before it
+ * is skipped so one lost datagram doesn't hold up the rest of the stream.
+ */
+class MediaReceiver
+{
+  private:
+	struct Partial
+	{
+		List<ByteList> fragments;
+		TimePoint firstSeen;
+		uint32_t id;
+		uint32_t timestamp;
+		uint32_t bytes;
+		uint16_t received;
+		uint8_t flags;
+	};
+
+	Map<uint32_t, Partial> partials;
+	Set<uint32_t> requested;
+	List<uint32_t> missing;
+	std::optional<uint32_t> next;
+	uint32_t highest;
+	std::chrono::milliseconds maxDelay;
+	const uint64_t maxMessageSize;
+	// Bytes held by incomplete messages
+	uint64_t partialBytes;
+
+	/**
+	 * Remember a sequence as missing if it hasn't been requested already
+	 *
+	 * @param sequence
+	 */
+	void request(uint32_t);
+
+	/**
+	 * Forget every incomplete message and start over at the sequence
+	 *
+	 * @param sequence
+	 */
+	void reset(uint32_t);
+
+	/**
+	 * Remove an incomplete message
+	 *
+	 * @param iter
+	 */
+	void erase(Map<uint32_t, Partial>::iterator);
+
+  public:
+	/**
+	 * Largest number of sequences that are requested again at once
+	 */
+	static constexpr size_t MaxMissing = 64;
+
+	/**
+	 * Largest number of incomplete messages that are kept
+	 */
+	static constexpr size_t MaxPartials = 256;
+
+	/**
+	 * Largest number of bytes held by incomplete messages. It is raised to the largest message size if that is
+	 * larger.
+	 */
+	static constexpr uint64_t MaxPartialBytes = MB(16);
+
+	/**
+	 * How long to wait for a missing message. Audio can't wait long. Video waits long enough for a keyframe to be sent
+	 * again.
+	 */
+	static constexpr std::chrono::milliseconds AudioDelay{40};
+	static constexpr std::chrono::milliseconds VideoDelay{200};
+
+	MediaReceiver(std::chrono::milliseconds maxDelay, uint64_t maxMessageSize);
+	~MediaReceiver();
+
+	/**
+	 * Add a data datagram
+	 *
+	 * @param header
+	 * @param data The datagram after the header
+	 * @param size
+	 * @param now
+	 *
+	 * @return False if the datagram was invalid or its message is larger than the largest message size
+	 */
+	bool add(const MediaHeader &, const uint8_t *, size_t, TimePoint);
+
+	/**
+	 * Take the messages that are ready in order
+	 *
+	 * @param now
+	 * @param messages [out] Messages are appended to this list
+	 */
+	void poll(TimePoint, List<MediaMessage> &);
+
+	/**
+	 * Take the sequences that should be requested from the sender
+	 *
+	 * @return the sequences
+	 */
+	List<uint32_t> takeMissing();
+
+	void setMaxDelay(std::chrono::milliseconds);
+};
+} // namespace TemStream
\ No newline at end of file
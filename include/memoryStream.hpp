@@ -84,4 +84,35 @@ class MemoryStream : public std::iostream
 		return &buffer;
 	}
 };
+/**
+ * Read-only buffer over bytes owned by someone else. The bytes must outlive the buffer.
+ */
+class MemoryView : public std::basic_streambuf<char>
+{
+  public:
+	MemoryView(const uint8_t *, size_t);
+	virtual ~MemoryView();
+
+	std::streamsize getReadPoint() const
+	{
+		return gptr() - eback();
+	}
+};
+/**
+ * Stream for deserializing bytes in place without copying them into a MemoryStream first
+ */
+class ViewStream : public std::istream
+{
+  private:
+	MemoryView view;
+
+  public:
+	ViewStream(const uint8_t *, size_t);
+	virtual ~ViewStream();
+
+	const MemoryView *operator->() const
+	{
+		return &view;
+	}
+};
 } // namespace TemStream
\ No newline at end of file
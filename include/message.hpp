@@ -260,6 +260,15 @@ struct Chat
  * Message for Video stream
  */
 using Video = std::variant<Frame, LargeFile>;
+/**
+ * Check if the encoded frame can be decoded without any previous frames. Supports VP8 and H264 (Annex B) frames.
+ *
+ * @param frame
+ *
+ * @return True if the frame is a keyframe
+ */
+extern bool isKeyframe(const Frame &);
+extern bool isKeyframe(const uint8_t *, size_t);
 /**
  * Message for Audio stream
  */
@@ -341,9 +350,88 @@ struct TimeRange
 };
 extern std::ostream &operator<<(std::ostream &, const TimeRange &);
 EMPTY_MESSAGE(GetTimeRange);
+/**
+ * Sent by the server after Message::VerifyLogin if audio and video can be sent over UDP. The client sends a Hello
+ * datagram with the token to the port. The server sends media to the address that datagram came from. Hello datagrams
+ * are signed with the key since the token is in every datagram.
+ */
+struct MediaChannel
+{
+	uint32_t token;
+	uint16_t port;
+	MediaHeader::Key key;
+	template <class Archive> void save(Archive &ar) const
+	{
+		ar(token, port, key);
+	}
+	template <class Archive> void load(Archive &ar)
+	{
+		ar(token, port, key);
+	}
+};
+/**
+ * Ask the server to stream the packets recorded from start to end. The server sends Message::ReplayChunk until it has
+ * sent ::window bytes and then waits for Message::ReplayCredit. A new request replaces the previous one.
+ */
+struct GetReplayRange
+{
+	static constexpr uint8_t MaxSpeed = 4;
+
+	int64_t start;
+	int64_t end;
+	// Echoed in every chunk so chunks of an earlier request can be ignored
+	uint32_t id;
+	// Bytes of packets that the client can buffer
+	uint32_t window;
+	// Playback speed. The server doesn't read further ahead of playback than it needs to.
+	uint8_t speed;
+	template <class Archive> void save(Archive &ar) const
+	{
+		ar(start, end, id, window, speed);
+	}
+	template <class Archive> void load(Archive &ar)
+	{
+		ar(start, end, id, window, speed);
+	}
+};
+/**
+ * Sent by the client as it plays packets of a Message::GetReplayRange. The server may send this many more bytes.
+ */
+struct ReplayCredit
+{
+	uint32_t id;
+	uint32_t bytes;
+	template <class Archive> void save(Archive &ar) const
+	{
+		ar(id, bytes);
+	}
+	template <class Archive> void load(Archive &ar)
+	{
+		ar(id, bytes);
+	}
+};
+/**
+ * Packets of a Message::GetReplayRange that were recorded at the timestamp. Every packet recorded before the timestamp
+ * has already been sent. The last chunk of the range is empty and has ::last set.
+ */
+struct ReplayChunk
+{
+	List<ByteList> packets;
+	int64_t timestamp;
+	uint32_t id;
+	bool last;
+	template <class Archive> void save(Archive &ar) const
+	{
+		ar(packets, timestamp, id, last);
+	}
+	template <class Archive> void load(Archive &ar)
+	{
+		ar(packets, timestamp, id, last);
+	}
+};
 using Payload = std::variant<std::monostate, Credentials, VerifyLogin, Text, Chat, ServerLinks, Image, Video, Audio,
 							 RequestServerInformation, ServerInformation, BanUser, GetReplay, NoReplay, Replay,
-							 TimeRange, GetTimeRange>;
+							 TimeRange, GetTimeRange, MediaChannel, GetReplayRange, ReplayCredit, ReplayChunk>;
 
 #define MESSAGE_HANDLER_FUNCTIONS(RVAL)                                                                                \
 	RVAL operator()(std::monostate);                                                                                   \
@@ -362,7 +450,11 @@ using Payload = std::variant<std::monostate, Credentials, VerifyLogin, Text, Cha
 	RVAL operator()(Message::GetReplay);                                                                               \
 	RVAL operator()(Message::NoReplay);                                                                                \
 	RVAL operator()(Message::TimeRange &);                                                                             \
-	RVAL operator()(Message::GetTimeRange)
+	RVAL operator()(Message::GetTimeRange);                                                                            \
+	RVAL operator()(Message::MediaChannel &);                                                                          \
+	RVAL operator()(Message::GetReplayRange &);                                                                        \
+	RVAL operator()(Message::ReplayCredit &);                                                                          \
+	RVAL operator()(Message::ReplayChunk &)
 
 struct Packet
 {
@@ -381,6 +473,29 @@ struct Packet
 };
 extern std::ostream &operator<<(std::ostream &, const Packet &);
 
+/**
+ * What the server needs to know to forward a media packet without deserializing its payload
+ */
+struct PacketSummary
+{
+	Source source;
+	size_t type;
+	// Where the source starts. This is the size of the packet without its source.
+	size_t sourceOffset;
+	bool keyframe;
+};
+
+/**
+ * Read the payload type and source of a serialized Audio or Video frame packet. The payload is skipped, not copied.
+ *
+ * @param data Bytes of a Message::Packet written by a cereal::PortableBinaryOutputArchive
+ * @param size
+ * @param hasSource If false, the packet was serialized without its source
+ *
+ * @return The summary or std::nullopt if the bytes are another type of packet or aren't valid
+ */
+extern std::optional<PacketSummary> summarize(const uint8_t *, size_t, bool hasSource = true);
+
 /**
  * Get a maximum of MAX_FILE_CHUNK bytes from an iterator
  *
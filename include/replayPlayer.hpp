@@ -0,0 +1,150 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * Decodes the packets of a replay on a worker so the render thread only gets packets that are ready to be played.
+ * Packets are kept in the order they were received. They are decoded up to a number of seconds (the prefetch) ahead
+ * of the playback cursor.
+ */
+class ReplayPlayer
+{
+  public:
+	struct ReadyPacket
+	{
+		Message::Packet packet;
+		int64_t timestamp;
+		// Size of the serialized packet
+		uint32_t size;
+	};
+
+  private:
+	struct EncodedPacket
+	{
+		ByteList bytes;
+		int64_t timestamp;
+	};
+
+	mutable Mutex mutex;
+	Deque<EncodedPacket> encoded;
+	Deque<ReadyPacket> ready;
+	// Timestamp of the packet that the worker is decoding
+	std::optional<int64_t> decoding;
+	int64_t cursor;
+	// Changed when the packets are cleared so a packet that was being decoded is dropped
+	uint32_t generation;
+	uint32_t prefetch;
+	bool failed;
+
+  public:
+	/**
+	 * Seconds ahead of the cursor that are decoded. At least the next second must be decoded or playback can't reach
+	 * it.
+	 */
+	static constexpr uint32_t MinPrefetch = 1;
+	static constexpr uint32_t DefaultPrefetch = 5;
+	static constexpr uint32_t MaxPrefetch = 60;
+
+	/**
+	 * Largest number of packets that are decoded before the worker is given to other work
+	 */
+	static constexpr size_t MaxDecodeBatch = 64;
+
+	ReplayPlayer(int64_t cursor);
+	ReplayPlayer(const ReplayPlayer &) = delete;
+	ReplayPlayer(ReplayPlayer &&) = delete;
+	~ReplayPlayer();
+
+	/**
+	 * Add a serialized Message::Packet. Packets must be added in order.
+	 *
+	 * @param bytes
+	 * @param timestamp
+	 */
+	void add(ByteList &&, int64_t);
+
+	/**
+	 * Drop every packet (i.e. when seeking)
+	 *
+	 * @param cursor
+	 */
+	void clear(int64_t cursor);
+
+	/**
+	 * Set the second that is being played
+	 *
+	 * @param cursor
+	 */
+	void setCursor(int64_t);
+
+	void setPrefetch(uint32_t);
+	uint32_t getPrefetch() const;
+
+	/**
+	 * Decode packets that are within the prefetch. Called by the worker.
+	 *
+	 * @return True if there may be more to decode
+	 */
+	bool decode();
+
+	/**
+	 * Get the number of packets with the timestamp that haven't been played
+	 *
+	 * @param timestamp
+	 *
+	 * @return The count
+	 */
+	size_t count(int64_t) const;
+
+	/**
+	 * Get the last second that every received packet has been decoded for
+	 *
+	 * @return The second or std::nullopt if every received packet has been decoded
+	 */
+	std::optional<int64_t> decodedUntil() const;
+
+	/**
+	 * Get the timestamp of the next packet if it is ready
+	 *
+	 * @return The timestamp or std::nullopt if the next packet isn't ready
+	 */
+	std::optional<int64_t> next() const;
+
+	/**
+	 * Take the next packet if it is ready
+	 *
+	 * @return The packet or std::nullopt if the next packet isn't ready
+	 */
+	std::optional<ReadyPacket> pop();
+
+	/**
+	 * Check if a packet couldn't be decoded
+	 *
+	 * @return True if a packet failed
+	 */
+	bool hasFailed() const;
+
+	/**
+	 * Start decoding on the work pool until the player is destroyed
+	 *
+	 * @param player
+	 */
+	static void startDecoding(const shared_ptr<ReplayPlayer> &);
+};
+} // namespace TemStream
\ No newline at end of file
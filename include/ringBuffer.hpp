@@ -0,0 +1,93 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * Bytes stored in a circular buffer. Reading from the front never moves the unread bytes. The buffer only grows when
+ * it is full and shrinks back to its initial capacity when it is emptied after growing a lot.
+ */
+class RingBuffer
+{
+  private:
+	List<uint8_t> buffer;
+	List<uint8_t> scratch;
+	const size_t initialCapacity;
+	size_t head;
+	size_t used;
+
+	void grow(size_t);
+	void shrink();
+
+  public:
+	/**
+	 * The buffer is only shrunk when its capacity is more than this many times the initial capacity
+	 */
+	static constexpr size_t ShrinkFactor = 4;
+
+	RingBuffer(size_t capacity);
+	RingBuffer(const RingBuffer &) = delete;
+	RingBuffer(RingBuffer &&) = delete;
+	~RingBuffer();
+
+	size_t size() const
+	{
+		return used;
+	}
+
+	bool empty() const
+	{
+		return used == 0;
+	}
+
+	size_t capacity() const
+	{
+		return buffer.size();
+	}
+
+	/**
+	 * Add bytes to the end
+	 *
+	 * @param data
+	 * @param size
+	 */
+	void append(const uint8_t *, size_t);
+
+	/**
+	 * Get the first bytes as one contiguous range. The bytes are only copied if they wrap around the end of the
+	 * buffer. The pointer is valid until the buffer is changed.
+	 *
+	 * @param count Must not be greater than ::size
+	 *
+	 * @return pointer to the bytes
+	 */
+	const uint8_t *view(size_t);
+
+	/**
+	 * Remove bytes from the front. The buffer may shrink if this removes all of them.
+	 *
+	 * @param count
+	 */
+	void consume(size_t);
+
+	/**
+	 * Remove all bytes. The buffer may shrink.
+	 */
+	void clear();
+};
+} // namespace TemStream
\ No newline at end of file
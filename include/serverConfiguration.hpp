@@ -30,7 +30,12 @@ struct Configuration
 	Access access;
 	Address address;
 	String name;
+	String accessFile;
+	String streamsFile;
 	std::optional<SSLConfig> ssl;
+	std::optional<Address> upstream;
+	String upstreamName;
+	String upstreamToken;
 	int64_t startTime;
 #if __unix__
 	void *handle;
@@ -42,17 +47,79 @@ struct Configuration
 	uint32_t messageRateInSeconds;
 	uint32_t maxClients;
 	uint32_t maxMessageSize;
+	uint32_t maxSendQueueSize;
+	uint32_t maxSendDelay;
+	uint32_t maxWriteBatch;
+	uint32_t compressMinBytes;
+	uint32_t handshakeTimeout;
+	uint32_t sessionCacheSize;
+	uint32_t sessionTimeout;
+	uint32_t ioThreads;
+	uint32_t acceptThreads;
+	uint32_t listenBacklog;
+	uint32_t workerThreads;
+	uint32_t recordSyncEvery;
+	uint64_t recordSegmentSize;
+	uint32_t recordSegmentDuration;
+	uint64_t recordMaxBytes;
+	uint32_t recordMaxAge;
+	uint32_t recordCompactAge;
 	ServerType serverType;
+	TcpMode tcpMode;
+	SyncMode recordSync;
 	bool record;
+	bool useIoUring;
+	bool upstreamSsl;
+	bool kernelTls;
+	bool udpMedia;
 
 	Configuration();
+
+	/**
+	 * Copies share the authentication library of the original. Only the original will close it.
+	 *
+	 * @param configuration
+	 */
+	Configuration(const Configuration &);
+	Configuration(Configuration &&);
 	~Configuration();
 
 	bool valid() const;
 
+	/**
+	 * Check if this configuration only describes the server process. The streams are loaded from a file.
+	 *
+	 * @return True if there is a streams file
+	 */
+	bool hasStreamsFile() const;
+
+	/**
+	 * Check if the stream is copied from another server instead of being published to by peers
+	 *
+	 * @return True if there is an upstream server
+	 */
+	bool isRelay() const;
+
+	/**
+	 * Get the TCP mode for peers of this stream. TcpMode::Auto is resolved by the stream type.
+	 *
+	 * @return the mode
+	 */
+	TcpMode getTcpMode() const;
+
 	Message::Source getSource() const;
 };
 extern std::ostream &operator<<(std::ostream &, const Configuration &);
+
+/**
+ * Load the streams in the configuration's streams file. Each stream starts as a copy of the configuration and is
+ * changed by its own list of arguments. Arguments that affect the whole server can't be used in a stream.
+ *
+ * @param configuration
+ *
+ * @return The configuration for each stream
+ */
+extern List<Configuration> loadStreams(const Configuration &);
 class CredentialHandler
 {
   private:
@@ -18,47 +18,93 @@
 
 namespace TemStream
 {
-struct RecordedPacket
-{
-	Message::Packet packet;
-	int64_t timestamp;
-
-	RecordedPacket(const Message::Packet &);
-	~RecordedPacket();
-
-	bool save(const String &filename) const;
+class MediaServer;
 
-	static std::optional<int64_t> getTimestamp(const String &s, std::string::size_type &pos);
-	static std::optional<String> getEncodedPacket(const String &s, const int64_t target);
-};
 class ServerConnection : public Connection
 {
 	friend int runApp(Configuration &configuration);
+	friend class Reactor;
+	friend class WorkerPool;
+	friend class PeerRegistry;
+	friend class ServerStream;
+	friend class MediaServer;
 
   private:
 	static std::atomic_int32_t runningThreads;
-	static Mutex peersMutex;
+	static std::atomic<uint64_t> nextId;
 	static unique_ptr<StringList> badWords;
-	static unique_ptr<LinkedList<std::weak_ptr<ServerConnection>>> peers;
-
-	static void sendToPeers(Message::Packet &&, const ServerConnection *author = nullptr);
-
-	static bool peerExists(const String &);
-
-	static size_t totalPeers();
-
-	static List<PeerInformation> getPeers();
-
-	static String sendLinks(Configuration &);
+	static unique_ptr<PeerRegistry> peers;
+	static Map<String, shared_ptr<ServerStream>> streams;
+	static unique_ptr<MediaServer> media;
+
+	/**
+	 * Seconds of packets that are sent ahead of the peer's playback of a replay
+	 */
+	static constexpr int64_t ReplayLead = 5;
+
+	/**
+	 * Largest number of bytes of packets in a Message::ReplayChunk
+	 */
+	static constexpr uint32_t MaxReplayChunkSize = KB(256);
+
+	/**
+	 * A media packet that is sent to peers as it was received
+	 */
+	struct ForwardedPacket
+	{
+		Message::PacketSummary summary;
+		// Serialized Message::Packet without its source
+		SharedBytes body;
+		// Serialized Message::Source
+		SharedBytes source;
+		uint32_t streamId;
+		bool hasSource;
+	};
 
-	static void checkAccess(Configuration &);
+	/**
+	 * Serialize a packet once and send it to the stream's peers
+	 *
+	 * @param stream
+	 * @param packet
+	 * @param author Peer that sent the packet. It won't get the packet back.
+	 * @param record If true, the serialized packet is also queued for the stream's recording
+	 */
+	static void sendToPeers(ServerStream &, Message::Packet &&, const ServerConnection *author = nullptr,
+							bool record = false);
+
+	/**
+	 * Send a serialized packet to the stream's peers. Peers using V2 framing get the packet without its source and
+	 * with the stream's id. Other peers get the source appended. Audio and video frames are sent over UDP to peers
+	 * with a media channel.
+	 *
+	 * @param stream
+	 * @param body Serialized Message::Packet. The source is left out if the source parameter isn't null.
+	 * @param source Serialized Message::Source or null if the body contains it
+	 * @param type Index of the payload in Message::Payload
+	 * @param policy
+	 * @param keyframe
+	 * @param author Peer that sent the packet. It won't get the packet back.
+	 */
+	static void sendToPeers(ServerStream &, const SharedBytes &body, const SharedBytes &source, size_t type, SendPolicy,
+							bool keyframe, const ServerConnection *author);
+
+	static List<PeerInformation> getPeers(const ServerStream &);
+
+	static String sendLinks(ServerStream &);
+
+	static void checkAccess(ServerStream &);
+
+	/**
+	 * Find the stream that a peer wants to join. The name is ignored if the server only has one stream.
+	 *
+	 * @param name
+	 *
+	 * @return The stream or nullptr if there is no stream with that name
+	 */
+	static shared_ptr<ServerStream> findStream(const String &name);
 
 	std::optional<PeerInformation> login(const Message::Credentials &);
 
-	static void runPeerConnection(shared_ptr<ServerConnection>);
-
-	static String getReplayFilename(Configuration &);
-
 	class MessageHandler
 	{
 	  private:
@@ -71,7 +117,15 @@ class ServerConnection : public Connection
 
 		bool sendStoredPayload();
 
-		static void sendImageBytes(shared_ptr<ServerConnection>, Message::Source &&, String &&filename);
+		/**
+		 * Stream the packets recorded in the range to the peer. Runs in its own thread until the range is done or
+		 * the window is cancelled.
+		 *
+		 * @param connection
+		 * @param window
+		 * @param range
+		 */
+		static void sendReplayRange(shared_ptr<ServerConnection>, shared_ptr<ReplayWindow>, Message::GetReplayRange);
 
 	  public:
 		MessageHandler(ServerConnection &, Message::Packet &&);
@@ -84,11 +138,11 @@ class ServerConnection : public Connection
 	class ImageSaver
 	{
 	  private:
-		ServerConnection &connection;
+		const ServerStream &stream;
 		const Message::Source &source;
 
 	  public:
-		ImageSaver(ServerConnection &, const Message::Source &);
+		ImageSaver(const ServerStream &, const Message::Source &);
 		~ImageSaver();
 
 		void operator()(const Message::LargeFile &);
@@ -99,18 +153,84 @@ class ServerConnection : public Connection
 
 	shared_ptr<ServerConnection> getPointer() const;
 
-	void handleInput();
-	void handleOutput();
+	/**
+	 * Handle all received packets. Called from a worker thread.
+	 */
+	void handlePackets();
+
+	/**
+	 * Check if there are received packets that haven't been handled
+	 *
+	 * @return True if there are packets
+	 */
+	bool hasPackets();
+
+	/**
+	 * Check if the peer may send a packet of this type to its stream now. Updates the time of the last message.
+	 *
+	 * @param type Index of the payload in Message::Payload
+	 *
+	 * @return True if the packet can be sent
+	 */
+	bool canPublish(size_t type);
+
+	/**
+	 * Queue audio and video frames without deserializing them. Other packets are fully decoded so the server can
+	 * inspect them.
+	 */
+	bool tryForward(const uint8_t *, size_t, uint32_t, bool) override;
+
+	/**
+	 * Peers may only leave out the source of packets sent to their own stream
+	 */
+	bool resolveSource(uint32_t, Message::Source &) override;
+
+	/**
+	 * Stream ids sent by peers are never used to resolve sources (see ::resolveSource). Peers choose them before they
+	 * log in, so they aren't kept.
+	 */
+	void addSource(uint32_t, const Message::Source &) override
+	{
+	}
+
+	/**
+	 * Send a packet from ::tryForward to the stream. Called from a worker thread.
+	 *
+	 * @param packet
+	 *
+	 * @return False if the peer should be disconnected
+	 */
+	bool forward(ForwardedPacket &&);
+
+	/**
+	 * Tell the reactor to close this connection
+	 */
+	void disconnect();
+
+	/**
+	 * Remove this connection from the server and its stream. Called from the reactor.
+	 */
+	void leave();
+
+	void setLimits(const Configuration &);
 
+	const uint64_t id;
 	PeerInformation information;
 	const TimePoint startingTime;
 	TimePoint lastMessage;
 	Configuration &configuration;
-	ConcurrentQueue<RecordedPacket> &packetsToRecord;
-	bool stayConnected;
+	shared_ptr<ServerStream> stream;
+	ConcurrentQueue<ForwardedPacket> forwarded;
+	// Set once the peer opens its media channel
+	shared_ptr<const SocketAddress> mediaAddress;
+	uint32_t mediaToken;
+	// Set while a replay is streamed to the peer
+	shared_ptr<ReplayWindow> replayWindow;
+	std::atomic_bool stayConnected;
+	std::atomic_bool scheduled;
 
   public:
-	ServerConnection(Configuration &, ConcurrentQueue<RecordedPacket> &, Address &&, unique_ptr<Socket>);
+	ServerConnection(Configuration &, Address &&, unique_ptr<Socket>);
 	ServerConnection(const ServerConnection &) = delete;
 	ServerConnection(ServerConnection &&) = delete;
 	~ServerConnection();
@@ -119,8 +239,7 @@ class ServerConnection : public Connection
 
 	template <const size_t N> void getFilename(std::array<char, N> &arr)
 	{
-		snprintf(arr.data(), arr.size(), "%s_%u_%" PRId64 ".tsd", configuration.name.c_str(),
-				 (uint32_t)configuration.serverType, configuration.startTime);
+		stream->getFilename(arr);
 	}
 };
 } // namespace TemStream
\ No newline at end of file
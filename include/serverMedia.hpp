@@ -0,0 +1,109 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+class ServerConnection;
+class WorkerPool;
+
+/**
+ * UDP socket on the server's port that carries audio and video frames for peers that asked for it. Everything else
+ * stays on the peer's TCP connection.
+ *
+ * Peers are given a token when they log in. Datagrams from a peer are put back together and handled like frames that
+ * came over TCP. Datagrams to a peer are split once per stream and shared by every peer.
+ */
+class MediaServer
+{
+  private:
+	struct Peer
+	{
+		std::weak_ptr<ServerConnection> connection;
+		std::optional<SocketAddress> address;
+		unique_ptr<MediaReceiver> receiver;
+		MediaHeader::Key key;
+		// Sequence of the last Hello
+		uint32_t hello;
+	};
+
+	Mutex mutex;
+	Map<uint32_t, Peer> peers;
+	unique_ptr<UdpSocket> socket;
+	WorkerPool &workers;
+	std::thread thread;
+	uint16_t port;
+
+	void run();
+
+	/**
+	 * Handle a datagram from a peer
+	 *
+	 * @param bytes
+	 * @param address
+	 * @param now
+	 */
+	void handle(const ByteList &, const SocketAddress &, TimePoint);
+
+	/**
+	 * Send the frames that were put back together to the peers' streams and ask for missing keyframes
+	 *
+	 * @param now
+	 */
+	void deliver(TimePoint);
+
+  public:
+	MediaServer(WorkerPool &);
+	MediaServer(const MediaServer &) = delete;
+	MediaServer(MediaServer &&) = delete;
+	~MediaServer();
+
+	/**
+	 * Open the UDP socket and start the thread that reads it
+	 *
+	 * @param address
+	 *
+	 * @return True if successful
+	 */
+	bool start(const Address &);
+	void join();
+
+	/**
+	 * Give the peer a token and key that it can use to open its media channel
+	 *
+	 * @param connection
+	 *
+	 * @return the channel to send to the peer or std::nullopt if a key couldn't be made
+	 */
+	std::optional<Message::MediaChannel> add(const shared_ptr<ServerConnection> &);
+
+	void remove(uint32_t token);
+
+	/**
+	 * Send datagrams to a peer
+	 *
+	 * @param datagrams
+	 * @param address
+	 */
+	void send(const MediaSender::Datagrams &, const SocketAddress &);
+
+	uint16_t getPort() const
+	{
+		return port;
+	}
+};
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,110 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+class ServerConnection;
+
+/**
+ * All connections of the server indexed by id and by peer name. Authenticated peers are also published as an
+ * immutable snapshot. Readers load the snapshot without locking. Joins and leaves build a new snapshot and swap it in.
+ */
+class PeerRegistry
+{
+  public:
+	using Snapshot = List<shared_ptr<ServerConnection>>;
+
+  private:
+	struct Peer
+	{
+		shared_ptr<ServerConnection> connection;
+		// Name reserved by the connection. Kept here so it can be removed without reading the connection's
+		// information, which the worker may be changing.
+		String name;
+	};
+
+	mutable Mutex mutex;
+	Map<uint64_t, Peer> peers;
+	Map<String, uint64_t> names;
+	shared_ptr<const Snapshot> current;
+
+  public:
+	PeerRegistry();
+	PeerRegistry(const PeerRegistry &) = delete;
+	PeerRegistry(PeerRegistry &&) = delete;
+	~PeerRegistry();
+
+	/**
+	 * Add a connection that hasn't logged in yet
+	 *
+	 * @param connection
+	 */
+	void add(shared_ptr<ServerConnection>);
+
+	/**
+	 * Remove the connection and its name. The connection will stay in snapshots that are still being read.
+	 *
+	 * @param id
+	 */
+	void remove(uint64_t id);
+
+	/**
+	 * Reserve the name for the connection and publish it to the snapshot. The connection's information must be set
+	 * before this is called.
+	 *
+	 * @param id
+	 * @param name
+	 *
+	 * @return False if another connection is using the name
+	 */
+	bool login(uint64_t id, const String &name);
+
+	/**
+	 * Reserve the name for the connection without publishing it. The peer won't get packets from the stream until
+	 * ::publish is called. This lets the peer be sent messages that must arrive first.
+	 *
+	 * @param id
+	 * @param name
+	 *
+	 * @return False if another connection is using the name
+	 */
+	bool reserve(uint64_t id, const String &name);
+
+	/**
+	 * Build a new snapshot with all logged in peers
+	 */
+	void publish();
+
+	shared_ptr<ServerConnection> find(uint64_t id) const;
+	shared_ptr<ServerConnection> find(const String &name) const;
+
+	/**
+	 * Get the authenticated peers. This doesn't lock and the list won't change while it is being used.
+	 *
+	 * @return the snapshot
+	 */
+	shared_ptr<const Snapshot> snapshot() const;
+
+	/**
+	 * Get the number of connections, including ones that haven't logged in
+	 *
+	 * @return the number of connections
+	 */
+	size_t size() const;
+};
+} // namespace TemStream
\ No newline at end of file
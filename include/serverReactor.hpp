@@ -0,0 +1,246 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+class ServerConnection;
+
+/**
+ * Fixed set of threads that run the message handlers for connections. A connection is only ever handled by one worker
+ * at a time so its packets are processed in order.
+ */
+class WorkerPool
+{
+  private:
+	ConcurrentQueue<shared_ptr<ServerConnection>> connections;
+	List<std::thread> threads;
+
+	void run();
+
+  public:
+	WorkerPool();
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool(WorkerPool &&) = delete;
+	~WorkerPool();
+
+	void start(uint32_t count);
+	void join();
+
+	/**
+	 * Queue the connection to have its received packets handled. Caller must have set the connection as scheduled.
+	 *
+	 * @param connection
+	 */
+	void schedule(shared_ptr<ServerConnection>);
+};
+
+/**
+ * An I/O thread that owns a set of non-blocking sockets. It reads and frames incoming data and writes outgoing data.
+ * Subclasses decide how the sockets are waited on.
+ */
+class Reactor
+{
+  protected:
+	Map<SOCKET, shared_ptr<ServerConnection>> connections;
+	LinkedList<shared_ptr<ServerConnection>> incoming;
+	Set<SOCKET> dirty;
+	Mutex mutex;
+	WorkerPool &workers;
+	std::thread thread;
+	std::atomic<size_t> total;
+	std::chrono::milliseconds handshakeTimeout;
+
+	static Histogram handshakes;
+
+	void run();
+
+	/**
+	 * Prepare the reactor before its thread starts
+	 *
+	 * @return True if successful
+	 */
+	virtual bool init() = 0;
+
+	/**
+	 * Start waiting on the socket
+	 *
+	 * @param fd
+	 * @param connection
+	 *
+	 * @return True if successful
+	 */
+	virtual bool watch(SOCKET, const shared_ptr<ServerConnection> &) = 0;
+
+	/**
+	 * Stop waiting on the socket. The reactor may keep the connection alive until pending operations finish.
+	 *
+	 * @param fd
+	 * @param connection
+	 */
+	virtual void unwatch(SOCKET, shared_ptr<ServerConnection> &&) = 0;
+
+	/**
+	 * Wait for socket events and handle them
+	 *
+	 * @param timeout in milliseconds
+	 *
+	 * @return False if waiting failed and the reactor should stop
+	 */
+	virtual bool wait(int timeout) = 0;
+
+	/**
+	 * Wake up the reactor thread from ::wait. Can be called from any thread.
+	 */
+	virtual void wake() = 0;
+
+	/**
+	 * Start writing the outgoing data of the connection
+	 *
+	 * @param fd
+	 * @param connection
+	 *
+	 * @return False if the connection should be closed
+	 */
+	virtual bool flush(SOCKET, const shared_ptr<ServerConnection> &) = 0;
+
+	/**
+	 * Called after all connections were removed when the reactor stops
+	 */
+	virtual void shutdown()
+	{
+	}
+
+	void markDirty(SOCKET);
+	void addIncoming();
+	void flushDirty();
+	void removeStale();
+
+	/**
+	 * Schedule the received packets of the connection to be handled
+	 *
+	 * @param connection
+	 *
+	 * @return False if the connection should be closed
+	 */
+	bool received(const shared_ptr<ServerConnection> &);
+
+	void removeConnection(SOCKET);
+
+	/**
+	 * Record how long the connection took to finish its handshake
+	 *
+	 * @param connection
+	 */
+	static void handshakeFinished(const ServerConnection &);
+
+  public:
+	Reactor(WorkerPool &);
+	Reactor(const Reactor &) = delete;
+	Reactor(Reactor &&) = delete;
+	virtual ~Reactor();
+
+	/**
+	 * Create and start the reactor selected by the configuration. Falls back to ::PollReactor if io_uring isn't
+	 * available.
+	 *
+	 * @param workers
+	 * @param configuration
+	 *
+	 * @return the reactor or nullptr if it failed to start
+	 */
+	static unique_ptr<Reactor> create(WorkerPool &, const Configuration &);
+
+	bool start();
+	void join();
+
+	/**
+	 * Give ownership of the connection to this reactor. The socket will be set to non-blocking mode.
+	 *
+	 * @param connection
+	 */
+	void add(shared_ptr<ServerConnection>);
+
+	/**
+	 * Get the number of connections handled by this reactor
+	 *
+	 * @return the number of connections
+	 */
+	size_t size() const
+	{
+		return total;
+	}
+
+	/**
+	 * Get the time between accepting connections and finishing their handshakes for all reactors
+	 *
+	 * @return the histogram
+	 */
+	static const Histogram &getHandshakeDurations();
+};
+
+/**
+ * Reactor that waits for sockets to be readable or writable. Uses epoll on Linux and poll everywhere else.
+ */
+class PollReactor : public Reactor
+{
+  private:
+#if __linux__
+	int epollFd;
+	int eventFd;
+#else
+	Map<SOCKET, short> interests;
+#endif
+
+	struct Event
+	{
+		SOCKET fd;
+		bool readable;
+		bool writable;
+	};
+	List<Event> events;
+	Set<SOCKET> waitingToWrite;
+	Set<SOCKET> handshaking;
+
+	bool getEvents(int timeout);
+	void setWriteInterest(SOCKET, bool);
+
+	bool handleRead(const shared_ptr<ServerConnection> &);
+
+	/**
+	 * Continue the handshake of the connection. The socket will be watched for writing if the handshake needs it.
+	 *
+	 * @param fd
+	 * @param connection
+	 *
+	 * @return False if the connection should be closed
+	 */
+	bool handshake(SOCKET, const shared_ptr<ServerConnection> &);
+
+  protected:
+	bool init() override;
+	bool watch(SOCKET, const shared_ptr<ServerConnection> &) override;
+	void unwatch(SOCKET, shared_ptr<ServerConnection> &&) override;
+	bool wait(int timeout) override;
+	void wake() override;
+	bool flush(SOCKET, const shared_ptr<ServerConnection> &) override;
+
+  public:
+	PollReactor(WorkerPool &);
+	~PollReactor();
+};
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,420 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * When recorded packets are forced to disk with fsync
+ */
+enum class SyncMode : uint8_t
+{
+	// Leave it to the operating system
+	Never,
+	// Every N milliseconds
+	Interval,
+	// Every N bytes
+	Bytes
+};
+extern std::ostream &operator<<(std::ostream &, SyncMode);
+
+/**
+ * When segments of a recording are started, deleted and compacted. Zero means no limit.
+ */
+struct ReplayLimits
+{
+	// Start a new segment when the last one has this many bytes or seconds of packets
+	uint64_t segmentSize;
+	uint32_t segmentDuration;
+	// Delete the oldest segments when the recording has more bytes or older packets (in seconds) than this
+	uint64_t maxBytes;
+	uint32_t maxAge;
+	// Compact segments with packets older than this (in seconds)
+	uint32_t compactAge;
+	// Decides which packets are kept by compaction
+	ServerType serverType;
+};
+
+struct RecordedPacket
+{
+	// Serialized Message::Packet. The source may be stored separately.
+	SharedBytes bytes;
+	SharedBytes source;
+	int64_t timestamp;
+
+	RecordedPacket(const Message::Packet &);
+	RecordedPacket(const SharedBytes &bytes, const SharedBytes &source = nullptr);
+	~RecordedPacket();
+
+	/**
+	 * Get the timestamp of a line from a text replay file (timestamp:base64)
+	 *
+	 * @param s
+	 * @param pos [out] Position of the ':'
+	 *
+	 * @return The timestamp or std::nullopt if the line is invalid
+	 */
+	static std::optional<int64_t> getTimestamp(const String &s, std::string::size_type &pos);
+};
+
+/**
+ * Recorded packets of a stream. Packets are appended to segment files in a directory.
+ *
+ * A segment starts with ::Magic, ::Version (2 bytes) and flags (2 bytes). Each record after that is the timestamp
+ * (8 bytes), the size (4 bytes) and the serialized Message::Packet. All numbers are little endian. Next to each segment
+ * is an index file with the offset of the first record of every second. The segments are kept in order with their
+ * time ranges, so finding a timestamp is a binary search over the segments and then over the segment's index. It
+ * doesn't get slower as the recording grows.
+ *
+ * One thread appends while others read. Readers only see records that have been flushed. Packets are appended in
+ * batches with one write per batch. How often they are forced to disk is set with ::setSync.
+ *
+ * Segments that are no longer appended to are deleted and compacted according to ReplayLimits. A compacted segment is
+ * written to a new file with the same number and replaces the original.
+ */
+class ReplayLog
+{
+  public:
+	struct IndexEntry
+	{
+		int64_t timestamp;
+		uint64_t offset;
+	};
+
+	static constexpr std::array<char, 4> Magic{'T', 'S', 'R', 'L'};
+	static constexpr uint16_t Version = 1;
+	static constexpr uint32_t SegmentHeaderSize = 8;
+	static constexpr uint32_t RecordHeaderSize = 12;
+	static constexpr uint32_t IndexEntrySize = 16;
+
+	// Segment flags
+	static constexpr uint16_t Compacted = 0x1;
+
+	/**
+	 * Default size and duration (in seconds) of a segment
+	 */
+	static constexpr uint64_t DefaultSegmentSize = MB(64);
+	static constexpr uint32_t DefaultSegmentDuration = 3600;
+
+	/**
+	 * Largest number of chat messages per second that are kept by compaction
+	 */
+	static constexpr size_t CompactedChatPerSecond = 10;
+
+	/**
+	 * Largest number of bytes that are buffered before they are written
+	 */
+	static constexpr uint32_t MaxWriteSize = MB(4);
+
+  private:
+	struct Segment
+	{
+		String path;
+		List<IndexEntry> index;
+		uint32_t number;
+		int64_t first;
+		int64_t last;
+		// Bytes that readers can see
+		uint64_t size;
+		uint16_t flags;
+	};
+
+	/**
+	 * Records of a batch that haven't been written yet
+	 */
+	struct Pending
+	{
+		ByteList data;
+		ByteList index;
+		List<IndexEntry> entries;
+		int64_t last;
+	};
+
+	mutable Mutex mutex;
+	const String directory;
+	List<Segment> segments;
+	ReplayLimits limits;
+
+	// Held by the writer. The mutex is only held to look at or update the segments, not to write or sync files.
+	Mutex writeMutex;
+	// Path of the segment that is being appended to
+	String writing;
+	FILE *data;
+	FILE *index;
+	TimePoint lastSync;
+	uint64_t unsynced;
+	uint32_t syncEvery;
+	SyncMode syncMode;
+
+	/**
+	 * Load a segment and its index. Records after the last indexed one are scanned. A partial record at the end
+	 * (i.e. the server stopped while writing it) is cut off.
+	 *
+	 * @param path
+	 *
+	 * @return The segment or std::nullopt if it isn't valid
+	 */
+	static std::optional<Segment> load(const String &path);
+
+	/**
+	 * Get the size, first timestamp and flags of the last segment
+	 *
+	 * @param size [out]
+	 * @param first [out]
+	 * @param indexed [out] True if the segment has any records
+	 *
+	 * @return False if there are no segments
+	 */
+	bool getLast(uint64_t &size, int64_t &first, bool &indexed) const;
+
+	/**
+	 * Close the current segment and start a new one
+	 *
+	 * @param timestamp Timestamp of the first record
+	 *
+	 * @return True if successful
+	 */
+	bool startSegment(int64_t timestamp);
+
+	/**
+	 * Open the last segment for appending
+	 *
+	 * @return True if successful
+	 */
+	bool openWriter();
+
+	/**
+	 * Close the segment that is being appended to
+	 *
+	 * @param sync If true, force it to disk first
+	 */
+	void closeWriter(bool sync);
+
+	/**
+	 * Write the pending records to the last segment and clear them
+	 *
+	 * @param pending
+	 *
+	 * @return True if successful
+	 */
+	bool commit(Pending &);
+
+	/**
+	 * Force the segment that is being appended to to disk
+	 *
+	 * @return True if successful
+	 */
+	bool syncFiles();
+
+	/**
+	 * Write the packets of a segment that are kept by compaction to a new segment file
+	 *
+	 * @param segment
+	 * @param type
+	 * @param sync If true, force the new files to disk
+	 *
+	 * @return The new segment or std::nullopt if it couldn't be written
+	 */
+	static std::optional<Segment> compact(const Segment &, ServerType, bool sync);
+
+	/**
+	 * Delete a segment and its index
+	 *
+	 * @param path
+	 */
+	static void remove(const String &path);
+
+	/**
+	 * Find the segment and offset of the first record at or after the timestamp. Must be called with the mutex
+	 * locked.
+	 *
+	 * @param timestamp
+	 *
+	 * @return The index of the segment and the offset or std::nullopt if there is no such record
+	 */
+	std::optional<std::pair<size_t, uint64_t>> find(int64_t) const;
+
+  public:
+	ReplayLog(const String &directory);
+	ReplayLog(const ReplayLog &) = delete;
+	ReplayLog(ReplayLog &&) = delete;
+	~ReplayLog();
+
+	/**
+	 * Load the segments in the directory. Nothing is created until a packet is appended.
+	 *
+	 * @return True if successful
+	 */
+	bool open();
+
+	/**
+	 * Append the packets to the last segment with one write. A new segment is started if the last one is full.
+	 * Timestamps that go backwards (i.e. the clock changed) are recorded as the last timestamp so the index stays
+	 * sorted.
+	 *
+	 * @param packets
+	 *
+	 * @return True if successful
+	 */
+	bool append(const List<RecordedPacket> &);
+
+	/**
+	 * Set how often appended packets are forced to disk
+	 *
+	 * @param mode
+	 * @param every Milliseconds or bytes depending on the mode
+	 */
+	void setSync(SyncMode, uint32_t every);
+
+	void setLimits(const ReplayLimits &);
+
+	/**
+	 * Delete the oldest segments until the recording is within the size and age limits. The last segment is never
+	 * deleted.
+	 *
+	 * @param now
+	 *
+	 * @return The number of segments deleted
+	 */
+	size_t enforceRetention(int64_t now);
+
+	/**
+	 * Compact the oldest segment that is old enough and hasn't been compacted. Only video (keyframes), chat and
+	 * streams that send their whole state (text and links) can be compacted. Readers may use the segment while it is
+	 * compacted.
+	 *
+	 * @param now
+	 *
+	 * @return True if a segment was compacted
+	 */
+	bool compact(int64_t now);
+
+	/**
+	 * Force appended packets to disk if the sync policy says it is time
+	 *
+	 * @return True if successful
+	 */
+	bool sync();
+
+	/**
+	 * Close the segment that is being appended to. It is forced to disk unless the sync mode is SyncMode::Never.
+	 */
+	void close();
+
+	/**
+	 * Copy the packets of a text replay file (from older versions) into the log and rename the file so it is only
+	 * copied once
+	 *
+	 * @param filename
+	 *
+	 * @return The number of packets copied
+	 */
+	size_t importText(const String &filename);
+
+	/**
+	 * Get the first and last timestamp of the recording
+	 *
+	 * @return The range or std::nullopt if nothing is recorded
+	 */
+	std::optional<Message::TimeRange> getTimeRange() const;
+
+	/**
+	 * Read the packets recorded at the timestamp
+	 *
+	 * @param timestamp
+	 * @param callback Called with each serialized Message::Packet. Return false to stop reading.
+	 *
+	 * @return The number of packets read
+	 */
+	size_t read(int64_t timestamp, const std::function<bool(ByteList &&)> &) const;
+
+	/**
+	 * Read the packets recorded from start to end in order. The segments are read sequentially.
+	 *
+	 * @param start
+	 * @param end
+	 * @param callback Called with the timestamp and each serialized Message::Packet. Return false to stop reading.
+	 *
+	 * @return The number of packets read
+	 */
+	size_t read(int64_t start, int64_t end, const std::function<bool(int64_t, ByteList &&)> &) const;
+};
+
+/**
+ * Credit-based flow control of a replay that is streamed to a peer (see Message::GetReplayRange). The thread that
+ * streams it takes credits for the bytes it sends and waits when there are none left. The peer gives credits back as
+ * it plays the packets.
+ */
+class ReplayWindow
+{
+  private:
+	Mutex mutex;
+	std::condition_variable_any cv;
+	const uint32_t maxCredits;
+	int64_t credits;
+	const uint32_t id;
+	bool cancelled;
+
+  public:
+	/**
+	 * Limits of the window that the peer asks for
+	 */
+	static constexpr uint32_t MinCredits = KB(64);
+	static constexpr uint32_t MaxCredits = MB(16);
+
+	/**
+	 * @param id
+	 * @param credits The window that the peer asked for
+	 * @param maxCredits Largest window the connection can hold (i.e. less than its send queue limit)
+	 */
+	ReplayWindow(uint32_t id, uint32_t credits, uint32_t maxCredits);
+	ReplayWindow(const ReplayWindow &) = delete;
+	ReplayWindow(ReplayWindow &&) = delete;
+	~ReplayWindow();
+
+	/**
+	 * Wait until there are credits and take the bytes from them. The credits may become negative so a packet larger
+	 * than the window can still be sent.
+	 *
+	 * @param bytes
+	 *
+	 * @return False if the replay was cancelled or the server is stopping
+	 */
+	bool take(uint32_t bytes);
+
+	/**
+	 * Wait until the time point
+	 *
+	 * @param time
+	 *
+	 * @return False if the replay was cancelled or the server is stopping
+	 */
+	bool waitUntil(TimePoint);
+
+	void give(uint32_t bytes);
+
+	/**
+	 * Stop waiting and make the thread that streams the replay stop
+	 */
+	void cancel();
+
+	uint32_t getId() const
+	{
+		return id;
+	}
+};
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,162 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+namespace TemStream
+{
+/**
+ * A stream hosted by the server. All streams share the listening socket, the reactors and the workers. Each stream
+ * has its own configuration, peers and recording.
+ */
+class ServerStream
+{
+	friend class ServerConnection;
+	friend class MediaServer;
+
+  public:
+	/**
+	 * The stream's image as the chunks that are sent to peers. Each chunk is serialized and framed once and the same
+	 * bytes are queued for every peer that joins.
+	 */
+	struct ImageChunks
+	{
+		List<SharedBytes> bodies;
+		// Header of each body for each Framing
+		std::array<List<SharedBytes>, 3> headers;
+		// Sent after each body to V1 peers. Relays send the source in the body.
+		SharedBytes source;
+	};
+
+  private:
+	static std::atomic<uint32_t> nextId;
+
+	Configuration &configuration;
+	PeerRegistry peers;
+	ConcurrentQueue<RecordedPacket> packetsToRecord;
+	ReplayLog replay;
+	mutable Mutex mutex;
+	std::optional<Message::Source> origin;
+	mutable SharedBytes sourceBytes;
+	mutable shared_ptr<const ImageChunks> image;
+	// Splits frames for peers with a media channel
+	MediaSender media;
+	const uint32_t id;
+
+	void watchLinks();
+	void record();
+
+	/**
+	 * Delete and compact old segments of the recording every minute
+	 */
+	void maintainReplay();
+
+	/**
+	 * Stay connected to the upstream server and send its packets to this stream's peers. Waits longer after each lost or
+	 * rejected connection and stops if the upstream stream has a different type.
+	 */
+	void relayUpstream();
+
+	/**
+	 * Handle a packet from the upstream server
+	 *
+	 * @param packet
+	 *
+	 * @return False if the upstream stream has a different type
+	 */
+	bool relay(Message::Packet &&);
+
+	/**
+	 * Save the payload so it can be sent to peers that join later
+	 *
+	 * @param payload
+	 * @param append
+	 *
+	 * @return True if successful
+	 */
+	bool savePayload(const Message::Payload &, bool append = false) const;
+
+  public:
+	ServerStream(Configuration &);
+	ServerStream(const ServerStream &) = delete;
+	ServerStream(ServerStream &&) = delete;
+	~ServerStream();
+
+	/**
+	 * Start the threads that send link updates and record packets if the stream needs them
+	 */
+	void start();
+
+	const Configuration &getConfiguration() const;
+
+	/**
+	 * Get the source of packets sent by this stream. Relays use the source of the stream they copy.
+	 *
+	 * @return The source
+	 */
+	Message::Source getSource() const;
+
+	/**
+	 * Check if the source refers to this stream
+	 *
+	 * @param source
+	 *
+	 * @return True if the source is this stream's or the stream that it copies
+	 */
+	bool isSource(const Message::Source &) const;
+
+	/**
+	 * Get the id that peers using V2 framing know this stream's source by. Packets sent with the id don't need the
+	 * source.
+	 *
+	 * @return the id
+	 */
+	uint32_t getId() const
+	{
+		return id;
+	}
+
+	/**
+	 * Get the source serialized as it appears at the end of a packet. This is kept until the source changes.
+	 *
+	 * @return the bytes
+	 */
+	SharedBytes getSourceBytes() const;
+
+	/**
+	 * Split the saved image into chunks for peers that join. Called when an upload is finished.
+	 */
+	void cacheImage() const;
+
+	/**
+	 * Forget the cached image (i.e. a new one is being uploaded)
+	 */
+	void clearImage() const;
+
+	/**
+	 * Get the cached image
+	 *
+	 * @return The chunks or nullptr if there is no image
+	 */
+	shared_ptr<const ImageChunks> getImage() const;
+
+	template <const size_t N> void getFilename(std::array<char, N> &arr) const
+	{
+		snprintf(arr.data(), arr.size(), "%s_%u_%" PRId64 ".tsd", configuration.name.c_str(),
+				 (uint32_t)configuration.serverType, configuration.startTime);
+	}
+};
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,93 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <main.hpp>
+
+#if TEMSTREAM_USE_IO_URING
+#include <liburing.h>
+
+namespace TemStream
+{
+/**
+ * Reactor that uses io_uring. Sockets are read with multishot receives into a ring of provided buffers and written
+ * with linked chains of sends. All requests made in one pass are submitted with a single system call.
+ *
+ * Only plain TCP sockets are supported since OpenSSL reads and writes the socket itself.
+ */
+class UringReactor : public Reactor
+{
+  private:
+	enum class Operation : uint8_t
+	{
+		Wake = 1,
+		Receive,
+		Send,
+		Cancel
+	};
+
+	/**
+	 * Requests that the kernel hasn't finished for a socket. The connection is kept alive until all of them complete.
+	 */
+	struct Pending
+	{
+		shared_ptr<ServerConnection> connection;
+		uint32_t sends;
+		uint32_t sent;
+		bool receiving;
+		bool sendFailed;
+		bool closing;
+	};
+
+	static constexpr uint32_t QueueDepth = 512;
+	static constexpr uint32_t BufferCount = 128;
+	static constexpr uint32_t BufferSize = KB(16);
+	static constexpr uint16_t BufferGroup = 0;
+
+	struct io_uring ring;
+	struct io_uring_buf_ring *bufferRing;
+	List<uint8_t> buffers;
+	Map<SOCKET, Pending> pending;
+	int eventFd;
+	bool ringReady;
+
+	static uint64_t encode(Operation, SOCKET);
+
+	struct io_uring_sqe *getSqe();
+
+	bool armWake();
+	bool armReceive(SOCKET);
+	void returnBuffer(uint16_t);
+
+	void handleCompletion(uint64_t, int32_t, uint32_t);
+	void handleReceive(SOCKET, int32_t, uint32_t);
+	void handleSend(SOCKET, int32_t);
+	void release(SOCKET);
+
+  protected:
+	bool init() override;
+	bool watch(SOCKET, const shared_ptr<ServerConnection> &) override;
+	void unwatch(SOCKET, shared_ptr<ServerConnection> &&) override;
+	bool wait(int timeout) override;
+	void wake() override;
+	bool flush(SOCKET, const shared_ptr<ServerConnection> &) override;
+	void shutdown() override;
+
+  public:
+	UringReactor(WorkerPool &);
+	~UringReactor();
+};
+} // namespace TemStream
+#endif
\ No newline at end of file
@@ -23,48 +23,458 @@ namespace Message
 {
 struct Packet;
 }
+enum class FlushState
+{
+	Error,
+	Done,
+	Blocked
+};
+enum class HandshakeState
+{
+	Error,
+	Done,
+	WantRead,
+	WantWrite
+};
+/**
+ * How each message is framed on the wire.
+ *
+ * V1: cereal-serialized Message::Header (endianness byte, 16 byte magic guid, 64-bit size).
+ * V2: magic byte, version byte, payload type, stream id as a varint, then the size as a varint. Peers that send their
+ * credentials with V2 are answered with V2.
+ *
+ * With V2, the highest bit of the type is set if the message ends with its Message::Source. A message with a stream id
+ * and a source tells the receiver to use that id for the source. Messages without a source use the source of their
+ * stream id. Stream id 0 means no stream.
+ *
+ * V3: same as V2 with the version byte set to 3. The second highest bit of the type is set if the message was
+ * compressed (see ::compressMessage). Peers that send V3 headers are answered with V3.
+ */
+enum class Framing : uint8_t
+{
+	V1 = 1,
+	V2 = 2,
+	V3 = 3
+};
+/**
+ * Immutable bytes that can be queued on many sockets without copying
+ */
+using SharedBytes = shared_ptr<const ByteList>;
+/**
+ * A contiguous range of bytes to be written with other ranges in one call
+ */
+struct ByteSpan
+{
+	const uint8_t *data;
+	uint32_t size;
+};
+/**
+ * What to do with a queued message when a peer is reading too slowly
+ */
+enum class SendPolicy : uint8_t
+{
+	// Never drop. The connection is closed if the message can't be queued.
+	Reliable,
+	// Drop the oldest messages first
+	DropOldest,
+	// Drop messages until the next keyframe so the peer can resume decoding
+	DropUntilKeyframe,
+	// Never drop and don't count toward the limits. For messages whose bytes are shared by every peer (i.e. a stored
+	// image) so they don't cost memory per peer and can be larger than the queue.
+	Shared
+};
+/**
+ * How the kernel groups outgoing bytes into TCP segments
+ */
+enum class TcpMode : uint8_t
+{
+	// NoDelay for streams with small messages that must arrive quickly and Cork for streams with large messages
+	Auto,
+	// Kernel default. Small writes are delayed until earlier ones are acknowledged.
+	Nagle,
+	// Every write is sent immediately
+	NoDelay,
+	// Like NoDelay, but a flush that needs several writes only sends full segments until it is done
+	Cork
+};
+extern std::ostream &operator<<(std::ostream &, TcpMode);
+/**
+ * A framed message waiting to be written. The header, payload and trailer are shared with every other socket that the
+ * message was sent to. The trailer is optional (i.e. the source of a packet for peers that need it).
+ */
+struct OutgoingPacket
+{
+	SharedBytes header;
+	SharedBytes payload;
+	SharedBytes trailer;
+	TimePoint queued;
+	SendPolicy policy;
+	bool keyframe;
+
+	OutgoingPacket(const SharedBytes &, const SharedBytes &, SendPolicy = SendPolicy::Reliable, bool keyframe = false);
+	OutgoingPacket(const SharedBytes &, const SharedBytes &, const SharedBytes &trailer,
+				   SendPolicy = SendPolicy::Reliable, bool keyframe = false);
+
+	uint32_t size() const
+	{
+		return header->size() + payload->size() + (trailer == nullptr ? 0 : trailer->size());
+	}
+};
+/**
+ * Maximum amount of outgoing data a socket will hold
+ */
+struct SendLimits
+{
+	size_t maxBytes;
+	std::chrono::milliseconds maxDelay;
+};
+/**
+ * Number of messages that were dropped from a socket's outgoing queue
+ */
+struct DropCounters
+{
+	// Dropped because the queue had too many bytes
+	uint64_t queueFull;
+	// Dropped because the message waited too long
+	uint64_t tooOld;
+	// Dropped while waiting for a keyframe
+	uint64_t waitingForKeyframe;
+	// Total bytes of all dropped messages
+	uint64_t bytes;
+
+	uint64_t total() const
+	{
+		return queueFull + tooOld + waitingForKeyframe;
+	}
+};
+extern std::ostream &operator<<(std::ostream &, const DropCounters &);
 class Socket
 {
   protected:
 	std::array<char, KB(64)> buffer;
-	ByteList outgoing;
+	Deque<OutgoingPacket> outgoing;
+	size_t outgoingBytes;
+	// Bytes of queued Shared messages
+	size_t sharedBytes;
+	uint32_t outgoingOffset;
+	size_t outgoingInFlight;
+	std::optional<SendLimits> limits;
+	DropCounters drops;
+	bool waitingForKeyframe;
+	bool overflowed;
+	std::function<void()> wakeupCallback;
 	Mutex mutex;
+	std::atomic<Framing> framing;
+	uint32_t maxWriteBytes;
+	std::atomic<uint32_t> compressMinBytes;
+	bool corkWrites;
+	bool nonBlocking;
 
 	/**
-	 * Send all bytes in the outgoing list to the peer. Ensure only one thread every calls this
+	 * Write as many bytes as the socket will currently accept. Ensure only one thread ever calls this
 	 *
-	 * @param bytes
+	 * @param data
+	 * @param size
+	 *
+	 * @return The number of bytes written (0 if the socket would block) or std::nullopt on error
+	 */
+	virtual std::optional<uint32_t> write(const uint8_t *, uint32_t) = 0;
+
+	/**
+	 * Write the spans in order with as few calls as possible. By default, calls ::write for each span.
+	 *
+	 * @param spans
+	 * @param count
+	 *
+	 * @return The number of bytes written (0 if the socket would block) or std::nullopt on error
+	 */
+	virtual std::optional<uint32_t> write(const ByteSpan *, size_t);
+
+	/**
+	 * Drop messages until the outgoing queue is within the limits. Messages that are being written are never dropped.
+	 *
+	 * @return False if a reliable message would have to be dropped
+	 */
+	bool enforceLimits();
+
+	void drop(Deque<OutgoingPacket>::iterator &, uint64_t &counter);
+
+	/**
+	 * Turn off Nagle's algorithm
+	 *
+	 * @param enable
 	 *
 	 * @return True if successful
 	 */
-	virtual bool flush(const ByteList &) = 0;
+	virtual bool setNoDelay(bool)
+	{
+		return false;
+	}
+
+	/**
+	 * Hold partial segments until the cork is removed
+	 *
+	 * @param enable
+	 *
+	 * @return True if successful
+	 */
+	virtual bool setCork(bool)
+	{
+		return false;
+	}
 
   public:
 	Socket();
 	virtual ~Socket();
 
-	bool sendPacket(const Message::Packet &, const bool sendImmediately = false);
+	/**
+	 * Maximum number of spans passed to a single write call
+	 */
+	static constexpr size_t MaxWriteSpans = 64;
+
+	/**
+	 * Default number of bytes gathered for a single write call
+	 */
+	static constexpr uint32_t DefaultMaxWriteBytes = KB(64);
+
+	/**
+	 * First byte of a V2 header. V1 headers always start with 0 or 1.
+	 */
+	static constexpr uint8_t FrameMagic = 'T';
+
+	/**
+	 * Set in the type of a V2 header if the message ends with its source
+	 */
+	static constexpr uint8_t FrameHasSource = 0x80;
+
+	/**
+	 * Set in the type of a V3 header if the message is compressed
+	 */
+	static constexpr uint8_t FrameCompressed = 0x40;
+
+	/**
+	 * Largest header of any framing (V1)
+	 */
+	static constexpr size_t MaxHeaderSize = 25;
+
+	/**
+	 * Serialize the packet into shared bytes. This can be sent to many sockets with ::send(const SharedBytes &)
+	 *
+	 * @param packet
+	 * @param withSource If false, the source is left out. Appending ::serialize(const Message::Source &) makes the
+	 * same bytes as including it.
+	 *
+	 * @return the bytes
+	 */
+	static SharedBytes serialize(const Message::Packet &, bool withSource = true);
+
+	/**
+	 * Serialize the source as it appears at the end of a serialized packet
+	 *
+	 * @param source
+	 *
+	 * @return the bytes
+	 */
+	static SharedBytes serialize(const Message::Source &);
+
+	/**
+	 * Create the header that is sent before a message of this size. The header is written with plain stores.
+	 *
+	 * @param size
+	 * @param framing
+	 * @param type Index of the payload in Message::Payload. Only sent with V2.
+	 * @param streamId Only sent with V2
+	 * @param hasSource If the message ends with its source. Only sent with V2.
+	 * @param compressed If the message is compressed. Only sent with V3.
+	 *
+	 * @return the header bytes
+	 */
+	static SharedBytes makeHeader(uint32_t size, Framing = Framing::V1, uint8_t type = 0, uint32_t streamId = 0,
+								  bool hasSource = true, bool compressed = false);
+
+	Framing getFraming() const
+	{
+		return framing;
+	}
+
+	/**
+	 * Set the framing used for messages queued after this call
+	 *
+	 * @param framing
+	 */
+	void setFraming(Framing);
+
+	/**
+	 * Set the smallest message that ::sendPacket compresses. Only messages of types that are worth compressing are
+	 * compressed and only for peers using V3 framing.
+	 *
+	 * @param minBytes 0 disables compression
+	 */
+	void setCompression(uint32_t minBytes);
+
+	/**
+	 * Serialize and queue the packet
+	 *
+	 * @param packet
+	 * @param sendImmediately If true, flush the socket
+	 * @param streamId The stream of the packet if known. Only sent with V2.
+	 * @param withSource If false and there is a stream id, the source isn't sent. Only applies to V2.
+	 *
+	 * @return True if successful
+	 */
+	bool sendPacket(const Message::Packet &, const bool sendImmediately = false, uint32_t streamId = 0,
+					bool withSource = true);
 
 	virtual bool connect(const char *hostname, const char *port) = 0;
-	virtual void send(const uint8_t *, uint32_t);
 	virtual bool read(const int timeout, ByteList &, const bool readAll) = 0;
 
 	/**
-	 * Copies outgoing to temporary and calls ::flush(const ByteList&) with the temporary byte list. This is to avoid
-	 * locking the outgoing list to prevent receiving data from peer in another thread.
+	 * Queue the framed message. No bytes are copied. If the queue is over its limits, messages are dropped according
+	 * to their policy. If that isn't enough, the socket is marked as overflowed and flushing it will fail.
 	 *
-	 * @param bytes
+	 * @param packet
+	 */
+	virtual void send(OutgoingPacket &&);
+
+	void send(const SharedBytes &header, const SharedBytes &payload);
+	void send(const SharedBytes &);
+	void send(const uint8_t *, uint32_t);
+	void send(const ByteList &);
+
+	template <typename T> void send(const T *t, const uint32_t count)
+	{
+		send(reinterpret_cast<const uint8_t *>(t), sizeof(T) * count);
+	}
+
+	/**
+	 * Write until all outgoing bytes are sent. If the socket is non-blocking, this will wait for the socket to be
+	 * writable when the kernel buffer is full.
 	 *
 	 * @return True if successful
 	 */
 	bool flush();
 
-	template <typename T> void send(const T *t, const uint32_t count)
+	/**
+	 * Write queued messages until all bytes are sent or the socket would block. Any unsent bytes are kept for the next
+	 * call. The outgoing list is only locked while gathering and releasing messages so other threads can keep queuing
+	 * messages while this one writes.
+	 *
+	 * @return the flush state
+	 */
+	FlushState flushSome();
+
+	/**
+	 * Get the queued bytes that haven't been written. The messages won't be dropped until ::consume is called. This is
+	 * for callers that write the bytes themselves (i.e. with io_uring). Ensure only one thread ever calls this.
+	 *
+	 * Messages are gathered until they reach the write batch size. A single message larger than that is still
+	 * gathered whole.
+	 *
+	 * @param spans
+	 * @param max size of spans
+	 *
+	 * @return The number of spans or std::nullopt if the outgoing queue overflowed
+	 */
+	std::optional<size_t> gather(ByteSpan *, size_t);
+
+	/**
+	 * Remove bytes that were written from the outgoing queue. If nothing was written, the gathered messages stay
+	 * protected from being dropped until the next write.
+	 *
+	 * @param written
+	 *
+	 * @return The number of bytes still queued
+	 */
+	size_t consume(uint32_t);
+
+	/**
+	 * Limit the amount of outgoing data that can be queued. The socket has no limits by default.
+	 *
+	 * @param limits
+	 */
+	void setLimits(const SendLimits &);
+
+	/**
+	 * Set the number of bytes that a single write call will try to send. Smaller messages are coalesced up to this
+	 * size (i.e. into one TLS record batch).
+	 *
+	 * @param bytes
+	 */
+	void setWriteBatch(uint32_t);
+
+	/**
+	 * Set how the kernel groups outgoing bytes. TcpMode::Auto isn't resolved here and is treated like
+	 * TcpMode::NoDelay.
+	 *
+	 * @param mode
+	 *
+	 * @return True if the socket options were set
+	 */
+	bool setTcpMode(TcpMode);
+
+	/**
+	 * Get the number of messages that were dropped because of the send limits
+	 *
+	 * @return the counters
+	 */
+	DropCounters getDropCounters();
+
+	/**
+	 * Set the function to call whenever data is added to the outgoing list. It is called while the socket is locked.
+	 *
+	 * @param callback
+	 */
+	void setWakeup(std::function<void()> &&);
+
+	/**
+	 * Call the wakeup function if one is set
+	 */
+	void wakeup();
+
+	/**
+	 * Put the socket into non-blocking mode. Reads will return immediately when there is no data and writes will
+	 * stop when the kernel buffer is full.
+	 *
+	 * @return True if successful
+	 */
+	virtual bool setNonBlocking();
+
+	/**
+	 * Check if data was read from the socket but not yet returned by ::read (i.e. buffered SSL records)
+	 *
+	 * @return True if there is buffered data
+	 */
+	virtual bool hasBufferedData() const
 	{
-		send(reinterpret_cast<const uint8_t *>(t), sizeof(T) * count);
+		return false;
 	}
 
-	void send(const ByteList &);
+	/**
+	 * Check if the socket must finish a handshake (i.e. TLS) before it can be read from or written to
+	 *
+	 * @return True if ::handshake needs to be called
+	 */
+	virtual bool isHandshaking() const
+	{
+		return false;
+	}
+
+	/**
+	 * Continue the handshake without blocking. Call again when the socket is ready for the requested operation.
+	 *
+	 * @return the handshake state
+	 */
+	virtual HandshakeState handshake()
+	{
+		return HandshakeState::Done;
+	}
+
+	virtual SOCKET getFd() const
+	{
+		return INVALID_SOCKET;
+	}
+
+	virtual PollState pollWrite(const int timeout) const = 0;
 
 	virtual bool getIpAndPort(std::array<char, INET6_ADDRSTRLEN> &, uint16_t &) const = 0;
 };
@@ -73,7 +483,8 @@ class BasicSocket : public Socket
   protected:
 	SOCKET fd;
 
-	virtual bool flush(const ByteList &) override;
+	virtual std::optional<uint32_t> write(const uint8_t *, uint32_t) override;
+	virtual std::optional<uint32_t> write(const ByteSpan *, size_t) override;
 	void close();
 
 	BasicSocket(BasicSocket &&);
@@ -86,10 +497,31 @@ class BasicSocket : public Socket
 	virtual ~BasicSocket();
 
 	PollState pollRead(const int timeout) const;
-	PollState pollWrite(const int timeout) const;
+	PollState pollWrite(const int timeout) const override;
+
+	bool setNonBlocking() override;
+
+	SOCKET getFd() const override
+	{
+		return fd;
+	}
 
 	bool getIpAndPort(std::array<char, INET6_ADDRSTRLEN> &, uint16_t &) const override;
 };
+/**
+ * Address that a datagram came from or is sent to
+ */
+struct SocketAddress
+{
+	struct sockaddr_storage storage;
+	socklen_t length;
+
+	bool operator==(const SocketAddress &) const;
+	bool operator!=(const SocketAddress &a) const
+	{
+		return !(*this == a);
+	}
+};
 class UdpSocket : public BasicSocket
 {
   public:
@@ -97,7 +529,36 @@ class UdpSocket : public BasicSocket
 	UdpSocket(SOCKET);
 	virtual ~UdpSocket();
 
-	void send(const uint8_t *, uint32_t) override;
+	void send(OutgoingPacket &&) override;
+
+	/**
+	 * Send a single datagram
+	 *
+	 * @param bytes
+	 * @param address If nullptr, the socket must be connected
+	 *
+	 * @return True if successful or if the datagram was dropped because the socket would block
+	 */
+	bool sendTo(const ByteList &, const SocketAddress * = nullptr);
+
+	/**
+	 * Receive a single datagram without waiting. The socket must be non-blocking.
+	 *
+	 * @param bytes [out] Empty if there was no datagram
+	 * @param address [out] Where the datagram came from
+	 *
+	 * @return False on error
+	 */
+	bool receiveFrom(ByteList &, SocketAddress &);
+
+	/**
+	 * Get the address that the socket is connected to
+	 *
+	 * @param address [out]
+	 *
+	 * @return False if the socket isn't connected
+	 */
+	bool getPeer(SocketAddress &) const;
 
 	bool connect(const char *hostname, const char *port) override;
 	bool read(const int timeout, ByteList &, const bool readAll) override;
@@ -109,6 +570,9 @@ class TcpSocket : public BasicSocket
   protected:
 	TcpSocket(TcpSocket &&);
 
+	bool setNoDelay(bool) override;
+	bool setCork(bool) override;
+
   public:
 	TcpSocket();
 	TcpSocket(SOCKET);
@@ -146,24 +610,94 @@ class SSLSocket : public TcpSocket
 {
   private:
 	std::variant<SSLContext, SSLptr, std::pair<SSLContext, SSLptr>> data;
+	Address peerAddress;
+	// Small messages are copied here so they are encrypted together
+	ByteList writeBuffer;
+	// An SSL_write that would block. OpenSSL requires it to be retried with the same bytes.
+	std::optional<ByteSpan> pendingWrite;
+	bool accepting;
+	bool kernelSend;
 
+	// The contexts and sessions are kept until the process exits. OpenSSL frees them when it cleans up at exit.
+	static Mutex contextMutex;
+	static SSL_CTX *serverContext;
+	static SSL_CTX *clientContext;
+	static Map<Address, SSL_SESSION *> sessions;
+
+	/**
+	 * Get a reference to the context shared by all server sockets. Sharing it lets a session from one listening socket
+	 * be resumed on another.
+	 *
+	 * @return the context
+	 */
 	static SSLContext createContext();
 
-	bool flush(const ByteList &) override;
+	/**
+	 * Get a reference to the context shared by all client sockets
+	 *
+	 * @return the context or nullptr if it couldn't be created
+	 */
+	static SSLContext getClientContext();
+
+	/**
+	 * Called by OpenSSL when a server gives the client a session. It is saved so the next connection to that server
+	 * can resume it.
+	 *
+	 * @param ssl
+	 * @param session
+	 *
+	 * @return 1 if the session was kept
+	 */
+	static int onNewSession(SSL *, SSL_SESSION *);
+
+	/**
+	 * Check if OpenSSL handed encryption of outgoing records to the kernel after the handshake. If so, writes skip
+	 * SSL_write and go straight to the socket.
+	 *
+	 * @param ssl
+	 */
+	void checkKernelTls(SSL *);
+
+	std::optional<uint32_t> write(const uint8_t *, uint32_t) override;
+	std::optional<uint32_t> write(const ByteSpan *, size_t) override;
 
   public:
 	SSLSocket();
 	SSLSocket(SOCKET);
 	SSLSocket(SSLSocket &&) = delete;
-	SSLSocket(TcpSocket &&, SSLptr &&);
+	SSLSocket(TcpSocket &&, SSLptr &&, bool accepting = false);
 	~SSLSocket();
 
 	static const char *cert;
 	static const char *key;
+	static uint32_t sessionCacheSize;
+	static uint32_t sessionTimeout;
+	static bool kernelTls;
 
 	bool connect(const char *hostname, const char *port) override;
 	bool read(const int timeout, ByteList &, const bool readAll) override;
 
+	bool hasBufferedData() const override;
+
+	bool setNonBlocking() override;
+
+	bool isHandshaking() const override;
+
+	HandshakeState handshake() override;
+
+	/**
+	 * Check if the kernel encrypts outgoing data for this socket
+	 *
+	 * @return True if kernel TLS is used for sending
+	 */
+	bool usingKernelTls() const
+	{
+		return kernelSend;
+	}
+
+	/**
+	 * Accept a connection. The TLS handshake isn't done here. It must be finished with ::handshake.
+	 */
 	unique_ptr<TcpSocket> acceptConnection(bool &, const int timeout = 1000) const override;
 };
 } // namespace TemStream
\ No newline at end of file
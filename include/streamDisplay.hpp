@@ -45,18 +45,48 @@ struct CheckAudio
 	{
 	}
 };
+/**
+ * Plays a replay that the server streams (see Message::GetReplayRange). Packets are played when the playback clock
+ * reaches their timestamp. The clock stops if it reaches packets that haven't been received or decoded yet.
+ */
 struct ReplayData
 {
-	StringList packets;
+	/**
+	 * Bytes of packets that are buffered. Credits are given back to the server after a quarter of this is played.
+	 */
+	static constexpr uint32_t Window = MB(4);
+
+	shared_ptr<ReplayPlayer> player;
 	Message::TimeRange timeRange;
 	unique_ptr<StreamDisplay> display;
-	TimePoint lastUpdate;
+	// Wall clock time and replay time (in milliseconds) when the playback clock was last set
+	TimePoint clockStart;
+	int64_t clockOrigin;
 	int64_t replayCursor;
-	bool hasData;
+	// Every packet recorded before this timestamp has been received
+	int64_t receivedUntil;
+	// The second that packets were last played from and how many were played
+	int64_t playedSecond;
+	size_t playedInSecond;
+	uint32_t requestId;
+	uint32_t consumed;
+	uint8_t speed;
+	bool finished;
 
 	ReplayData(TemStreamGui &, const Message::Source &, const Message::TimeRange &);
 	ReplayData(ReplayData &&);
 	~ReplayData();
+
+	/**
+	 * Drop the received packets and ask the server to stream the replay from the timestamp
+	 *
+	 * @param gui
+	 * @param source
+	 * @param timestamp
+	 *
+	 * @return True if the request was sent
+	 */
+	bool request(TemStreamGui &, const Message::Source &, int64_t);
 };
 struct ChatLog
 {
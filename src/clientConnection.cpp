@@ -14,28 +14,307 @@
 
 #include <main.hpp>
 
+#if __linux__
+#include <sys/eventfd.h>
+#endif
+
 namespace TemStream
 {
 ClientConnection::ClientConnection(TemStreamGui &gui, const Address &address, unique_ptr<Socket> s)
-	: Connection(address, std::move(s)), gui(gui), verifyLogin(), serverInformation(), lastSentMessage(), opened(true)
+	: Connection(address, std::move(s)), gui(gui), verifyLogin(), serverInformation(), lastSentMessage(), thread(),
+	  onClose(nullptr),
+#if __linux__
+	  eventFd(-1),
+#endif
+	  opened(true), mediaSocket(nullptr), mediaServer(), mediaSender(),
+	  mediaReceiver(MediaReceiver::VideoDelay, maxMessageSize), lastMediaHello(), mediaToken(0), mediaKey(),
+	  mediaHellos(0), mediaReady(false)
 {
 }
 ClientConnection::~ClientConnection()
 {
+	opened = false;
+	wake();
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+	mSocket->setWakeup(nullptr);
+#if __linux__
+	if (eventFd >= 0)
+	{
+		::close(eventFd);
+	}
+#endif
 }
 void ClientConnection::close()
 {
-	if (!isOpened())
+	if (!opened.exchange(false))
 	{
 		return;
 	}
-	opened = false;
+	wake();
 	(*logger)(Logger::Level::Info) << "Closing connection: " << getSource() << std::endl;
 }
+bool ClientConnection::start(std::function<void()> &&f)
+{
+#if __linux__
+	eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eventFd < 0)
+	{
+		perror("eventfd");
+		return false;
+	}
+#endif
+	if (!mSocket->setNonBlocking())
+	{
+		return false;
+	}
+	onClose = std::move(f);
+	mSocket->setWakeup([this]() { wake(); });
+	thread = std::thread(&ClientConnection::run, this);
+	return true;
+}
+void ClientConnection::wake()
+{
+#if __linux__
+	if (eventFd < 0)
+	{
+		return;
+	}
+	const uint64_t value = 1;
+	if (::write(eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		perror("write");
+	}
+#endif
+}
+PollState ClientConnection::wait(const bool writing, const int timeout)
+{
+	std::array<struct pollfd, 3> fds;
+	fds[0].fd = mSocket->getFd();
+	fds[0].events = writing ? (POLLIN | POLLOUT) : POLLIN;
+	fds[0].revents = 0;
+#if __linux__
+	fds[1].fd = eventFd;
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+	// Datagrams are read in ::handleMedia. Missing messages are skipped after a short wait so wake up often.
+	auto media = std::atomic_load(&mediaSocket);
+	fds[2].fd = media == nullptr ? -1 : media->getFd();
+	fds[2].events = POLLIN;
+	fds[2].revents = 0;
+	const int result = poll(fds.data(), 3, media == nullptr ? timeout : std::min(timeout, 10));
+#else
+	// There is no wakeup descriptor for poll so keep the timeout small to pick up new packets quickly
+	(void)timeout;
+	const int result = poll(fds.data(), 1, 10);
+#endif
+	if (result < 0)
+	{
+		if (errno == EINTR)
+		{
+			return PollState::NoData;
+		}
+		perror("poll");
+		return PollState::Error;
+	}
+#if __linux__
+	if (fds[1].revents != 0)
+	{
+		uint64_t value;
+		while (::read(eventFd, &value, sizeof(value)) > 0)
+		{
+		}
+	}
+#endif
+	// Errors and hang ups are found when reading from the socket
+	return (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) != 0 ? PollState::GotData : PollState::NoData;
+}
+void ClientConnection::run()
+{
+	bool writing = false;
+	while (!appDone && isOpened())
+	{
+		switch (wait(writing, 1000))
+		{
+		case PollState::Error:
+			goto end;
+		case PollState::GotData:
+			do
+			{
+				if (!readAndHandle(0))
+				{
+					goto end;
+				}
+			} while (mSocket->hasBufferedData());
+			break;
+		default:
+			break;
+		}
+
+		handleMedia();
+		while (!getPackets().empty())
+		{
+			flushPackets();
+		}
+
+		switch (mSocket->flushSome())
+		{
+		case FlushState::Done:
+			writing = false;
+			break;
+		case FlushState::Blocked:
+			writing = true;
+			break;
+		default:
+			goto end;
+		}
+	}
+
+end:
+	close();
+	if (onClose)
+	{
+		onClose();
+	}
+}
+void ClientConnection::openMedia(const Message::MediaChannel &channel)
+{
+	auto socket = openSocket<UdpSocket>(Address(address.hostname.c_str(), channel.port), SocketType::Client, false);
+	if (socket == nullptr || !socket->setNonBlocking() || !socket->getPeer(mediaServer))
+	{
+		(*logger)(Logger::Level::Warning) << "Failed to open media channel. Using TCP for media." << std::endl;
+		return;
+	}
+	mediaToken = channel.token;
+	mediaKey = channel.key;
+	mediaHellos = 0;
+	lastMediaHello = TimePoint();
+	mediaReceiver.setMaxDelay(verifyLogin.serverType == ServerType::Audio ? MediaReceiver::AudioDelay
+																		   : MediaReceiver::VideoDelay);
+	shared_ptr<UdpSocket> shared = std::move(socket);
+	std::atomic_store(&mediaSocket, std::move(shared));
+}
+void ClientConnection::handleMedia()
+{
+	using namespace std::chrono_literals;
+	auto socket = std::atomic_load(&mediaSocket);
+	if (socket == nullptr)
+	{
+		return;
+	}
+
+	const auto now = std::chrono::system_clock::now();
+	// The server learns where to send media from the hello. Datagrams can be lost so keep trying for a while.
+	if (!mediaReady && now - lastMediaHello > 500ms)
+	{
+		if (mediaHellos >= MaxMediaHellos)
+		{
+			(*logger)(Logger::Level::Warning) << "Media channel didn't open. Using TCP for media." << std::endl;
+			std::atomic_store(&mediaSocket, shared_ptr<UdpSocket>(nullptr));
+			return;
+		}
+		++mediaHellos;
+		lastMediaHello = now;
+		socket->sendTo(*MediaHeader::makeHello(mediaToken, mediaHellos, mediaKey));
+	}
+
+	ByteList bytes;
+	SocketAddress from;
+	for (int i = 0; i < 256; ++i)
+	{
+		if (!socket->receiveFrom(bytes, from) || bytes.empty())
+		{
+			break;
+		}
+		// Only the server may open the channel or add media to it
+		if (from != mediaServer)
+		{
+			continue;
+		}
+		auto header = MediaHeader::read(bytes.data(), bytes.size());
+		if (!header.has_value())
+		{
+			continue;
+		}
+		switch (header->kind)
+		{
+		case MediaKind::Hello:
+			if (MediaHeader::verifyHello(bytes.data(), bytes.size(), mediaKey) && !mediaReady.exchange(true))
+			{
+				(*logger)(Logger::Level::Info) << "Media channel opened" << std::endl;
+			}
+			break;
+		case MediaKind::Data:
+			mediaReceiver.add(*header, bytes.data() + MediaHeader::Size, bytes.size() - MediaHeader::Size, now);
+			break;
+		case MediaKind::Nack:
+			for (const auto &datagram : mediaSender.resend(MediaHeader::readSequences(bytes.data(), bytes.size())))
+			{
+				socket->sendTo(*datagram);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	List<MediaMessage> messages;
+	mediaReceiver.poll(now, messages);
+	for (const auto &message : messages)
+	{
+		// A bad datagram loses one frame. It doesn't close the connection.
+		try
+		{
+			decodePacket(message.bytes.data(), message.bytes.size(), message.id, message.hasSource);
+		}
+		catch (const std::exception &e)
+		{
+			(*logger)(Logger::Level::Warning) << "Invalid media message: " << e.what() << std::endl;
+		}
+	}
+	auto missing = mediaReceiver.takeMissing();
+	if (!missing.empty())
+	{
+		socket->sendTo(*MediaHeader::makeControl(MediaKind::Nack, mediaToken, missing));
+	}
+}
 bool ClientConnection::sendPacket(const Message::Packet &packet, const bool sendImmediately)
 {
 	lastSentMessage = std::chrono::system_clock::now();
-	return mSocket->sendPacket(packet, sendImmediately);
+	if (mediaReady)
+	{
+		// Frames that can be dropped go over the media channel. Everything else stays on TCP.
+		std::optional<bool> keyframe;
+		if (auto video = std::get_if<Message::Video>(&packet.payload))
+		{
+			if (auto frame = std::get_if<Message::Frame>(video))
+			{
+				keyframe = Message::isKeyframe(*frame);
+			}
+		}
+		else if (std::holds_alternative<Message::Audio>(packet.payload))
+		{
+			keyframe = false;
+		}
+		auto socket = std::atomic_load(&mediaSocket);
+		if (keyframe.has_value() && socket != nullptr)
+		{
+			auto bytes = Socket::serialize(packet, false);
+			if (auto datagrams = mediaSender.split(bytes->data(), bytes->size(), mediaToken, *keyframe, false))
+			{
+				for (const auto &datagram : *datagrams)
+				{
+					socket->sendTo(*datagram);
+				}
+				return true;
+			}
+		}
+	}
+	// Once the thread is running, it is the only one that writes to the socket. It is woken up by the queued packet.
+	// The server already knows the source of its own stream id.
+	return mSocket->sendPacket(packet, sendImmediately && !thread.joinable(), getStreamId(packet.source), false);
 }
 bool ClientConnection::flushPackets()
 {
@@ -46,6 +325,13 @@ bool ClientConnection::flushPackets()
 		return true;
 	}
 
+	// The media channel is handled here. The gui doesn't need to know about it.
+	if (auto channel = std::get_if<Message::MediaChannel>(&packet->payload))
+	{
+		openMedia(*channel);
+		return true;
+	}
+
 	// Send audio data to playback immediately to avoid audio delay
 	if (auto message = std::get_if<Message::Audio>(&packet->payload))
 	{
@@ -0,0 +1,149 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+namespace
+{
+// Both ends must use the same bytes. Changing them requires a new framing version. Words that are most likely to be
+// matched are at the end.
+const char ChatDictionary[] = "welcome thanks thank please sorry maybe never always really think going stream "
+							  "server video audio image there where which would could should about their "
+							  "right good great nice cool haha what when have that this with from just like "
+							  "know yeah okay lol the and you for are but not was can how why who yes no ";
+
+constexpr size_t ChunkSize = KB(16);
+
+bool usesDictionary(const size_t type)
+{
+	return type == variant_index<Message::Payload, Message::Chat>();
+}
+} // namespace
+bool isCompressible(const size_t type)
+{
+	switch (type)
+	{
+	case variant_index<Message::Payload, Message::Text>():
+	case variant_index<Message::Payload, Message::Chat>():
+	case variant_index<Message::Payload, Message::ServerLinks>():
+	case variant_index<Message::Payload, Message::ServerInformation>():
+	case variant_index<Message::Payload, Message::Replay>():
+		return true;
+	default:
+		return false;
+	}
+}
+SharedBytes compressMessage(const uint8_t *data, const uint32_t size, const size_t type)
+{
+	z_stream stream{};
+	if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		return nullptr;
+	}
+	if (usesDictionary(type) && deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(ChatDictionary),
+													 sizeof(ChatDictionary) - 1) != Z_OK)
+	{
+		deflateEnd(&stream);
+		return nullptr;
+	}
+
+	auto bytes = tem_shared<ByteList>(size);
+	for (uint32_t i = 0; i < sizeof(uint32_t); ++i)
+	{
+		bytes->append(static_cast<uint8_t>(size >> (i * 8u)));
+	}
+	stream.next_in = const_cast<Bytef *>(data);
+	stream.avail_in = size;
+	std::array<uint8_t, ChunkSize> chunk;
+	int result = Z_OK;
+	while (result == Z_OK)
+	{
+		stream.next_out = chunk.data();
+		stream.avail_out = static_cast<uInt>(chunk.size());
+		result = deflate(&stream, Z_FINISH);
+		bytes->append(chunk.data(), static_cast<uint32_t>(chunk.size() - stream.avail_out));
+		// Stop early if it won't be smaller
+		if (bytes->size() >= size)
+		{
+			break;
+		}
+	}
+	deflateEnd(&stream);
+	if (result != Z_STREAM_END || bytes->size() >= size)
+	{
+		return nullptr;
+	}
+	return bytes;
+}
+bool decompressMessage(const uint8_t *data, const size_t size, const size_t type, const uint64_t maxSize,
+					   ByteList &bytes)
+{
+	bytes.clear();
+	if (size <= sizeof(uint32_t))
+	{
+		return false;
+	}
+	uint32_t expected = 0;
+	for (uint32_t i = 0; i < sizeof(uint32_t); ++i)
+	{
+		expected |= static_cast<uint32_t>(data[i]) << (i * 8u);
+	}
+	if (expected == 0 || expected > maxSize)
+	{
+		(*logger)(Logger::Level::Error) << "Got invalid compressed message size: " << expected
+										<< "; Max size allowed " << maxSize << std::endl;
+		return false;
+	}
+
+	z_stream stream{};
+	if (inflateInit(&stream) != Z_OK)
+	{
+		return false;
+	}
+	bytes.reallocate(expected);
+	stream.next_in = const_cast<Bytef *>(data + sizeof(uint32_t));
+	stream.avail_in = static_cast<uInt>(size - sizeof(uint32_t));
+	std::array<uint8_t, ChunkSize> chunk;
+	int result = Z_OK;
+	while (result == Z_OK)
+	{
+		stream.next_out = chunk.data();
+		stream.avail_out = static_cast<uInt>(chunk.size());
+		result = inflate(&stream, Z_NO_FLUSH);
+		if (result == Z_NEED_DICT && usesDictionary(type))
+		{
+			result = inflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(ChatDictionary),
+										  sizeof(ChatDictionary) - 1);
+			continue;
+		}
+		const uint32_t produced = static_cast<uint32_t>(chunk.size() - stream.avail_out);
+		// Don't let a small message expand past what it claimed
+		if (bytes.size() + produced > expected)
+		{
+			result = Z_DATA_ERROR;
+			break;
+		}
+		bytes.append(chunk.data(), produced);
+	}
+	inflateEnd(&stream);
+	if (result != Z_STREAM_END || stream.avail_in != 0 || bytes.size() != expected)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to decompress message" << std::endl;
+		return false;
+	}
+	return true;
+}
+} // namespace TemStream
\ No newline at end of file
@@ -17,8 +17,9 @@
 namespace TemStream
 {
 Connection::Connection(const Address &address, unique_ptr<Socket> s)
-	: bytes(MB(1)), packets(), nextMessageSize(std::nullopt), address(address), mSocket(std::move(s)),
-	  maxMessageSize(MB(1))
+	: readBuffer(KB(64)), pending(KB(64)), packets(), nextMessageSize(std::nullopt), nextStreamId(0),
+	  nextType(0), nextHasSource(true), nextCompressed(false), gotHeader(false), decompressed(), streamSources(),
+	  streamMutex(), address(address), mSocket(std::move(s)), maxMessageSize(MB(1))
 {
 }
 
@@ -28,99 +29,60 @@ Connection::~Connection()
 
 bool Connection::readAndHandle(const int timeout)
 {
-	if (mSocket == nullptr || !mSocket->read(timeout, bytes, true))
+	readBuffer.clear();
+	if (mSocket == nullptr || !mSocket->read(timeout, readBuffer, true))
 	{
 		return false;
 	}
-
+	return receive(readBuffer.data(), readBuffer.size());
+}
+bool Connection::receive(const uint8_t *data, const uint32_t size)
+{
 	try
 	{
-		while (!appDone)
+		size_t offset = 0;
+		// Messages that arrived whole are decoded straight from the caller's bytes. Only an incomplete message is
+		// copied and kept for the next read.
+		if (pending.empty())
 		{
-			// If the next message isn't known, message of type Message::Header is expected
-			if (!nextMessageSize.has_value())
+			while (!appDone && offset < size)
 			{
-				if (bytes.size() < sizeof(Message::Header) + 1)
-				{
-					return true;
-				}
-
-				Message::Header header;
-				MemoryStream m(std::move(bytes));
+				const auto used = decode(data + offset, size - offset);
+				if (!used.has_value())
 				{
-					cereal::PortableBinaryInputArchive ar(m);
-					ar(header);
+					return false;
 				}
-				// Ensure the size is valid, and the id matches
-				if (header.size > maxMessageSize || header.size == 0 || header.id != Message::MagicGuid)
+				if (*used == 0)
 				{
-#if _DEBUG
-					(*logger)(Logger::Level::Error)
-						<< "Got invalid message header: " << header << "; Max size allowed " << maxMessageSize
-						<< "; Magic Guid: " << Message::MagicGuid << std::endl;
-#else
-					(*logger)(Logger::Level::Error) << "Got invalid message header: " << header.size
-													<< "; Max size allowed " << maxMessageSize << std::endl;
-#endif
-					return false;
+					break;
 				}
-
-				nextMessageSize = header.size;
-				const auto read = static_cast<uint32_t>(m->getReadPoint());
-				bytes = std::move(m->moveBytes());
-				bytes.remove(read);
+				offset += *used;
 			}
+			pending.append(data + offset, size - offset);
+			return true;
+		}
 
-			if (*nextMessageSize == bytes.size())
+		pending.append(data, size);
+		while (!appDone && !pending.empty())
+		{
+			const size_t count = nextMessageSize.has_value() ? static_cast<size_t>(*nextMessageSize)
+															 : std::min(pending.size(), Socket::MaxHeaderSize);
+			if (pending.size() < count)
 			{
-				Message::Packet packet;
-				MemoryStream m(std::move(bytes));
-				{
-					cereal::PortableBinaryInputArchive ar(m);
-					ar(packet);
-				}
-				const auto &tempBytes = m->getBytes();
-				if (static_cast<size_t>(m->getReadPoint()) != tempBytes.size())
-				{
-					(*logger)(Logger::Level::Error) << "Expected to read " << m->getReadPoint() << "bytes. Read "
-													<< tempBytes.size() << " bytes" << std::endl;
-					return false;
-				}
-
-				packets.push(std::move(packet));
-				nextMessageSize = std::nullopt;
-				// Re-acquire the byte list so re-allocation isn't necessary
-				bytes = std::move(m->moveBytes());
-				bytes.clear();
-				return true;
+				break;
 			}
-			else if (*nextMessageSize < bytes.size())
+			const auto used = decode(pending.view(count), count);
+			if (!used.has_value())
 			{
-				Message::Packet packet;
-				MemoryStream m(std::move(bytes));
-				{
-					cereal::PortableBinaryInputArchive ar(m);
-					ar(packet);
-				}
-				if (static_cast<size_t>(m->getReadPoint()) != *nextMessageSize)
-				{
-					(*logger)(Logger::Level::Error) << "Expected to read " << m->getReadPoint() << "bytes. Read "
-													<< bytes.size() << " bytes" << std::endl;
-					return false;
-				}
-
-				packets.push(std::move(packet));
-
-				// Re-acquire bytes and remove what was read
-				bytes = std::move(m->moveBytes());
-				bytes.remove(static_cast<uint32_t>(*nextMessageSize));
-				nextMessageSize = std::nullopt;
+				return false;
 			}
-			else
+			if (*used == 0)
 			{
-				return true;
+				break;
 			}
+			pending.consume(*used);
 		}
+		return true;
 	}
 	catch (const std::bad_alloc &)
 	{
@@ -128,8 +90,212 @@ bool Connection::readAndHandle(const int timeout)
 	}
 	catch (const std::exception &e)
 	{
-		(*logger)(Logger::Level::Error) << "Connection::readAndHandle: " << e.what() << std::endl;
+		(*logger)(Logger::Level::Error) << "Connection::receive: " << e.what() << std::endl;
 	}
 	return false;
 }
+std::optional<size_t> Connection::decodeHeader(const uint8_t *data, const size_t size)
+{
+	uint64_t messageSize = 0;
+	uint32_t streamId = 0;
+	uint8_t type = 0;
+	bool hasSource = true;
+	bool compressed = false;
+	size_t used = 0;
+	if (data[0] == Socket::FrameMagic)
+	{
+		// Magic, version, type, then at most 5 bytes for each varint
+		if (size < 5)
+		{
+			return 0;
+		}
+		// Only V3 headers may be compressed
+		const Framing version = static_cast<Framing>(data[1]);
+		const uint8_t flags =
+			version == Framing::V3 ? (Socket::FrameHasSource | Socket::FrameCompressed) : Socket::FrameHasSource;
+		type = data[2] & ~flags;
+		if ((version != Framing::V2 && version != Framing::V3) || type >= std::variant_size_v<Message::Payload>)
+		{
+			(*logger)(Logger::Level::Error) << "Got invalid message header. Version: " << static_cast<int>(data[1])
+											<< "; Type: " << static_cast<int>(type) << std::endl;
+			return std::nullopt;
+		}
+		hasSource = (data[2] & Socket::FrameHasSource) != 0;
+		compressed = (data[2] & Socket::FrameCompressed & flags) != 0;
+		used = 3;
+		// Returns false if more bytes are needed or std::nullopt if the varint is too long
+		const auto readVarint = [data, size, &used](uint64_t &value) -> std::optional<bool> {
+			value = 0;
+			for (uint32_t shift = 0;; shift += 7)
+			{
+				if (used == size)
+				{
+					return false;
+				}
+				if (shift > 28)
+				{
+					return std::nullopt;
+				}
+				const uint8_t byte = data[used++];
+				value |= static_cast<uint64_t>(byte & 0x7fu) << shift;
+				if ((byte & 0x80u) == 0)
+				{
+					return true;
+				}
+			}
+		};
+		uint64_t id = 0;
+		const auto gotId = readVarint(id);
+		const auto gotSize = gotId.value_or(false) ? readVarint(messageSize) : gotId;
+		if (!gotSize.has_value() || id > UINT32_MAX)
+		{
+			(*logger)(Logger::Level::Error) << "Got invalid message header" << std::endl;
+			return std::nullopt;
+		}
+		if (!*gotSize)
+		{
+			return 0;
+		}
+		streamId = static_cast<uint32_t>(id);
+		if (mSocket != nullptr && mSocket->getFraming() < version)
+		{
+			mSocket->setFraming(version);
+		}
+	}
+	else
+	{
+		// Portable binary archives write one byte for the endianness before the header
+		used = sizeof(Message::Header) + 1;
+		if (size < used)
+		{
+			return 0;
+		}
+		Message::Header header;
+		{
+			ViewStream stream(data, used);
+			cereal::PortableBinaryInputArchive ar(stream);
+			ar(header);
+		}
+		if (header.id != Message::MagicGuid)
+		{
+#if _DEBUG
+			(*logger)(Logger::Level::Error) << "Got invalid message header: " << header
+											<< "; Magic Guid: " << Message::MagicGuid << std::endl;
+#else
+			(*logger)(Logger::Level::Error) << "Got invalid message header" << std::endl;
+#endif
+			return std::nullopt;
+		}
+		messageSize = header.size;
+	}
+
+	// Ensure the size is valid
+	if (messageSize > maxMessageSize || messageSize == 0)
+	{
+		(*logger)(Logger::Level::Error) << "Got invalid message size: " << messageSize << "; Max size allowed "
+										<< maxMessageSize << std::endl;
+		return std::nullopt;
+	}
+	nextMessageSize = messageSize;
+	nextStreamId = streamId;
+	nextType = type;
+	nextHasSource = hasSource;
+	nextCompressed = compressed;
+	gotHeader = true;
+	return used;
+}
+bool Connection::resolveSource(const uint32_t streamId, Message::Source &source)
+{
+	LOCK(streamMutex);
+	auto iter = streamSources.find(streamId);
+	if (iter == streamSources.end())
+	{
+		return false;
+	}
+	source = iter->second;
+	return true;
+}
+void Connection::addSource(const uint32_t streamId, const Message::Source &source)
+{
+	LOCK(streamMutex);
+	streamSources[streamId] = source;
+}
+uint32_t Connection::getStreamId(const Message::Source &source) const
+{
+	LOCK(streamMutex);
+	for (const auto &pair : streamSources)
+	{
+		if (pair.second == source)
+		{
+			return pair.first;
+		}
+	}
+	return 0;
+}
+std::optional<size_t> Connection::decode(const uint8_t *data, const size_t size)
+{
+	// If the next message isn't known, a header is expected
+	if (!nextMessageSize.has_value())
+	{
+		return decodeHeader(data, size);
+	}
+
+	const auto messageSize = static_cast<size_t>(*nextMessageSize);
+	if (size < messageSize)
+	{
+		return 0;
+	}
+	const uint8_t *message = data;
+	size_t bodySize = messageSize;
+	if (nextCompressed)
+	{
+		if (!decompressMessage(data, messageSize, nextType, maxMessageSize, decompressed))
+		{
+			return std::nullopt;
+		}
+		message = decompressed.data();
+		bodySize = decompressed.size();
+	}
+	if (!tryForward(message, bodySize, nextStreamId, nextHasSource) &&
+		!decodePacket(message, bodySize, nextStreamId, nextHasSource))
+	{
+		return std::nullopt;
+	}
+	nextMessageSize = std::nullopt;
+	return messageSize;
+}
+bool Connection::decodePacket(const uint8_t *data, const size_t size, const uint32_t streamId, const bool hasSource)
+{
+	Message::Packet packet;
+	ViewStream stream(data, size);
+	{
+		cereal::PortableBinaryInputArchive ar(stream);
+		ar(packet.payload);
+		if (hasSource)
+		{
+			ar(packet.source);
+		}
+	}
+	if (static_cast<size_t>(stream->getReadPoint()) != size)
+	{
+		(*logger)(Logger::Level::Error) << "Expected to read " << size << " bytes. Read " << stream->getReadPoint()
+										<< " bytes" << std::endl;
+		return false;
+	}
+	if (streamId != 0)
+	{
+		if (hasSource)
+		{
+			addSource(streamId, packet.source);
+		}
+		else if (!resolveSource(streamId, packet.source))
+		{
+			(*logger)(Logger::Level::Error) << "Got message for unknown stream: " << streamId << std::endl;
+			return false;
+		}
+	}
+
+	packets.push(std::move(packet));
+	return true;
+}
 } // namespace TemStream
\ No newline at end of file
@@ -435,11 +435,12 @@ bool TemStreamGui::init()
 	return true;
 }
 
-void TemStreamGui::connect(const Address &address)
+void TemStreamGui::connect(const Address &address, const String &serverName, const Framing framing)
 {
 	*logger << "Connecting to server: " << address << std::endl;
 	// Connect in another thread to avoid freezing the GUI
-	WorkPool::addWork([address = address, this, isSSL = configuration.isEncrypted]() {
+	WorkPool::addWork([address = address, serverName = serverName, this, isSSL = configuration.isEncrypted,
+					   framing]() {
 		unique_ptr<TcpSocket> s = nullptr;
 		if (isSSL)
 		{
@@ -458,10 +459,14 @@ void TemStreamGui::connect(const Address &address)
 		*logger << "Connected to server: " << address << std::endl;
 
 		auto clientConnection = tem_shared<ClientConnection>(*this, address, std::move(s));
+		(*clientConnection)->setFraming(framing);
 
 		// First send credentials to the server
 		{
 			Message::Packet packet;
+			// Tells the server which stream to join
+			packet.source.address = address;
+			packet.source.serverName = serverName;
 			packet.payload.emplace<Message::Credentials>(configuration.credentials);
 			if (!clientConnection->sendPacket(packet, true))
 			{
@@ -477,8 +482,19 @@ void TemStreamGui::connect(const Address &address)
 		{
 			if (!clientConnection->readAndHandle(3000))
 			{
+				if (framing != Framing::V1 && !clientConnection->receivedHeader())
+				{
+					// Older servers close the connection on newer headers without answering. Newer servers answer
+					// before closing it.
+					const Framing older = static_cast<Framing>(static_cast<uint8_t>(framing) - 1);
+					(*logger)(Logger::Level::Trace) << "Server didn't accept V" << static_cast<int>(framing)
+													<< " headers. Reconnecting: " << address << std::endl;
+					this->connect(address, serverName, older);
+					return false;
+				}
 				(*logger)(Logger::Level::Error)
-					<< "Authentication failure for server: " << address << "; No repsonse" << std::endl;
+					<< "Authentication failure for server: " << address << "; "
+					<< (clientConnection->receivedHeader() ? "Rejected" : "No repsonse") << std::endl;
 				return false;
 			}
 		}
@@ -499,6 +515,12 @@ void TemStreamGui::connect(const Address &address)
 			{
 				clientConnection->setVerifyLogin(std::move(*ptr));
 			}
+			else if (std::holds_alternative<std::monostate>(packet->payload))
+			{
+				(*logger)(Logger::Level::Error)
+					<< "Authentication failure for server: " << address << "; Rejected" << std::endl;
+				return false;
+			}
 			else
 			{
 				(*logger)(Logger::Level::Error) << "Authentication failure for server: " << address
@@ -508,38 +530,30 @@ void TemStreamGui::connect(const Address &address)
 		}
 
 		*logger << "Server information: " << clientConnection->getInfo() << std::endl;
+
+		// Handle packets for this connection in its own thread. It is only added to the list once it is running.
+		if (!clientConnection->start([this]() { this->dirty = true; }))
+		{
+			(*logger)(Logger::Level::Error)
+				<< "Failed to start connection thread: " << clientConnection->getInfo() << std::endl;
+			clientConnection->close();
+			return false;
+		}
+
 		if (this->addConnection(clientConnection))
 		{
 			(*logger)(Logger::Level::Trace)
 				<< "Adding connection to list: " << clientConnection->getInfo() << std::endl;
-
-			// Handle packets for this connection in another thread
-			WorkPool::addWork([this, clientConnection]() {
-				if (TemStreamGui::handleClientConnection(*clientConnection))
-				{
-					return true;
-				}
-				else
-				{
-					clientConnection->close();
-					this->dirty = true;
-					return false;
-				}
-			});
 		}
 		else
 		{
 			(*logger)(Logger::Level::Error) << "Failed to add connection" << clientConnection->getInfo() << std::endl;
+			clientConnection->close();
 		}
 		return false;
 	});
 }
 
-bool TemStreamGui::handleClientConnection(ClientConnection &con)
-{
-	return con.isOpened() && con.readAndHandle(0) && con.flushPackets() && con->flush();
-}
-
 bool TemStreamGui::addConnection(const shared_ptr<ClientConnection> &connection)
 {
 	return connections.add(connection->getSource(), connection);
@@ -1638,7 +1652,7 @@ bool TemStreamGui::startReplay(ClientConnection &con)
 	return con.sendPacket(packet);
 }
 
-bool TemStreamGui::getReplays(const Message::Source &source, const int64_t timestamp)
+bool TemStreamGui::getReplays(const Message::Source &source, const Message::GetReplayRange &range)
 {
 	auto con = getConnection(source);
 	if (!con)
@@ -1647,18 +1661,31 @@ bool TemStreamGui::getReplays(const Message::Source &source, const int64_t times
 		return false;
 	}
 
-	return getReplays(*con, timestamp);
+	return getReplays(*con, range);
 }
 
-bool TemStreamGui::getReplays(ClientConnection &con, const int64_t timestamp)
+bool TemStreamGui::getReplays(ClientConnection &con, const Message::GetReplayRange &range)
 {
 	Message::Packet packet;
 	packet.source = con.getSource();
-	Message::GetReplay r{timestamp};
-	packet.payload.emplace<Message::GetReplay>(std::move(r));
+	packet.payload.emplace<Message::GetReplayRange>(range);
 	return con->sendPacket(packet);
 }
 
+bool TemStreamGui::sendReplayCredit(const Message::Source &source, const Message::ReplayCredit &credit)
+{
+	auto con = getConnection(source);
+	if (!con)
+	{
+		return false;
+	}
+
+	Message::Packet packet;
+	packet.source = con->getSource();
+	packet.payload.emplace<Message::ReplayCredit>(credit);
+	return (*con)->sendPacket(packet);
+}
+
 bool TemStreamGui::hasReplayAccess(const Message::Source &source)
 {
 	auto con = getConnection(source);
@@ -2045,6 +2072,9 @@ int runApp(Configuration &configuration)
 		thread.join();
 	}
 
+	// Ensure connection threads stop before the logger is removed
+	gui.connections.clear();
+
 	WorkPool::setGlobalWorkPool(nullptr);
 
 	logger = nullptr;
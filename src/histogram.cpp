@@ -0,0 +1,79 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+Histogram::Histogram() : buckets(), count(0), totalMicroseconds(0), maxMicroseconds(0)
+{
+	for (auto &bucket : buckets)
+	{
+		bucket = 0;
+	}
+}
+Histogram::~Histogram()
+{
+}
+void Histogram::add(const std::chrono::microseconds duration)
+{
+	const uint64_t micros = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+	size_t index = 0;
+	for (uint64_t limit = 1000; index < BucketCount - 1 && micros >= limit; limit *= 2)
+	{
+		++index;
+	}
+	++buckets[index];
+	++count;
+	totalMicroseconds += micros;
+
+	uint64_t max = maxMicroseconds;
+	while (micros > max && !maxMicroseconds.compare_exchange_weak(max, micros))
+	{
+	}
+}
+uint64_t Histogram::getCount() const
+{
+	return count;
+}
+std::ostream &operator<<(std::ostream &os, const Histogram &histogram)
+{
+	const uint64_t count = histogram.count;
+	os << "Count: " << count;
+	if (count == 0)
+	{
+		return os;
+	}
+	os << "; Mean: " << (histogram.totalMicroseconds / count) / 1000.0
+	   << " ms; Max: " << histogram.maxMicroseconds / 1000.0 << " ms";
+	uint64_t limit = 1;
+	for (size_t i = 0; i < Histogram::BucketCount; ++i, limit *= 2)
+	{
+		const uint64_t n = histogram.buckets[i];
+		if (n == 0)
+		{
+			continue;
+		}
+		if (i == Histogram::BucketCount - 1)
+		{
+			os << "\n\t>= " << limit / 2 << " ms: " << n;
+		}
+		else
+		{
+			os << "\n\t< " << limit << " ms: " << n;
+		}
+	}
+	return os;
+}
+} // namespace TemStream
\ No newline at end of file
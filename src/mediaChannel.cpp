@@ -0,0 +1,356 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+namespace
+{
+void writeLittleEndian(uint8_t *&data, const uint64_t value, const size_t bytes)
+{
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		*data++ = static_cast<uint8_t>(value >> (i * 8u));
+	}
+}
+uint64_t readLittleEndian(const uint8_t *&data, const size_t bytes)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		value |= static_cast<uint64_t>(*data++) << (i * 8u);
+	}
+	return value;
+}
+} // namespace
+void MediaHeader::write(uint8_t *data) const
+{
+	*data++ = Magic;
+	*data++ = Version;
+	*data++ = static_cast<uint8_t>(kind);
+	*data++ = flags;
+	writeLittleEndian(data, id, sizeof(id));
+	writeLittleEndian(data, sequence, sizeof(sequence));
+	writeLittleEndian(data, timestamp, sizeof(timestamp));
+	writeLittleEndian(data, fragment, sizeof(fragment));
+	writeLittleEndian(data, fragments, sizeof(fragments));
+}
+std::optional<MediaHeader> MediaHeader::read(const uint8_t *data, const size_t size)
+{
+	if (size < Size || data[0] != Magic || data[1] != Version)
+	{
+		return std::nullopt;
+	}
+	MediaHeader header;
+	header.kind = static_cast<MediaKind>(data[2]);
+	switch (header.kind)
+	{
+	case MediaKind::Hello:
+	case MediaKind::Data:
+	case MediaKind::Nack:
+		break;
+	default:
+		return std::nullopt;
+	}
+	header.flags = data[3];
+	data += 4;
+	header.id = static_cast<uint32_t>(readLittleEndian(data, sizeof(header.id)));
+	header.sequence = static_cast<uint32_t>(readLittleEndian(data, sizeof(header.sequence)));
+	header.timestamp = static_cast<uint32_t>(readLittleEndian(data, sizeof(header.timestamp)));
+	header.fragment = static_cast<uint16_t>(readLittleEndian(data, sizeof(header.fragment)));
+	header.fragments = static_cast<uint16_t>(readLittleEndian(data, sizeof(header.fragments)));
+	return header;
+}
+SharedBytes MediaHeader::makeControl(const MediaKind kind, const uint32_t id, const List<uint32_t> &sequences)
+{
+	MediaHeader header{kind, 0, id, 0, 0, 0, 0};
+	const size_t count = std::min(sequences.size(), static_cast<size_t>((MaxDatagram - Size) / sizeof(uint32_t)));
+	std::array<uint8_t, MaxDatagram> datagram;
+	header.write(datagram.data());
+	uint8_t *data = datagram.data() + Size;
+	for (size_t i = 0; i < count; ++i)
+	{
+		writeLittleEndian(data, sequences[i], sizeof(uint32_t));
+	}
+	return tem_shared<ByteList>(datagram.data(), static_cast<uint32_t>(data - datagram.data()));
+}
+SharedBytes MediaHeader::makeHello(const uint32_t id, const uint32_t sequence, const MediaHeader::Key &key)
+{
+	MediaHeader header{MediaKind::Hello, 0, id, sequence, 0, 0, 0};
+	std::array<uint8_t, Size + SHA256_DIGEST_LENGTH> datagram;
+	header.write(datagram.data());
+	unsigned int length = SHA256_DIGEST_LENGTH;
+	HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), datagram.data(), Size, datagram.data() + Size,
+		 &length);
+	return tem_shared<ByteList>(datagram.data(), static_cast<uint32_t>(datagram.size()));
+}
+bool MediaHeader::verifyHello(const uint8_t *data, const size_t size, const MediaHeader::Key &key)
+{
+	if (size != Size + SHA256_DIGEST_LENGTH)
+	{
+		return false;
+	}
+	std::array<uint8_t, SHA256_DIGEST_LENGTH> digest;
+	unsigned int length = SHA256_DIGEST_LENGTH;
+	return HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), data, Size, digest.data(), &length) !=
+			   nullptr &&
+		   CRYPTO_memcmp(digest.data(), data + Size, digest.size()) == 0;
+}
+List<uint32_t> MediaHeader::readSequences(const uint8_t *data, const size_t size)
+{
+	List<uint32_t> sequences;
+	if (size <= Size)
+	{
+		return sequences;
+	}
+	const size_t count = (size - Size) / sizeof(uint32_t);
+	sequences.reserve(count);
+	data += Size;
+	for (size_t i = 0; i < count; ++i)
+	{
+		sequences.push_back(static_cast<uint32_t>(readLittleEndian(data, sizeof(uint32_t))));
+	}
+	return sequences;
+}
+MediaSender::MediaSender() : mutex(), keyframes(), start(std::chrono::system_clock::now()), nextSequence(0)
+{
+}
+MediaSender::~MediaSender()
+{
+}
+shared_ptr<const MediaSender::Datagrams> MediaSender::split(const uint8_t *data, const uint32_t size,
+															 const uint32_t id, const bool keyframe,
+															 const bool hasSource, const std::optional<uint64_t> author)
+{
+	const uint32_t count = (size + MediaHeader::MaxFragment - 1) / MediaHeader::MaxFragment;
+	if (count == 0 || count > UINT16_MAX)
+	{
+		return nullptr;
+	}
+
+	MediaHeader header;
+	header.kind = MediaKind::Data;
+	header.flags = (keyframe ? MediaHeader::Keyframe : 0) | (hasSource ? MediaHeader::HasSource : 0);
+	header.id = id;
+	header.fragments = static_cast<uint16_t>(count);
+
+	LOCK(mutex);
+	header.sequence = nextSequence++;
+	header.timestamp = static_cast<uint32_t>(
+		std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start).count());
+
+	auto datagrams = tem_shared<Datagrams>();
+	datagrams->reserve(count);
+	std::array<uint8_t, MediaHeader::Size> bytes;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t offset = i * MediaHeader::MaxFragment;
+		const uint32_t length = std::min(size - offset, MediaHeader::MaxFragment);
+		header.fragment = static_cast<uint16_t>(i);
+		header.write(bytes.data());
+		auto datagram = tem_shared<ByteList>(MediaHeader::Size + length);
+		datagram->append(bytes.data(), MediaHeader::Size);
+		datagram->append(data + offset, length);
+		datagrams->emplace_back(std::move(datagram));
+	}
+
+	shared_ptr<const Datagrams> result = std::move(datagrams);
+	if (keyframe)
+	{
+		keyframes.push_back(Keyframe{header.sequence, author, result});
+		if (keyframes.size() > MaxKeyframes)
+		{
+			keyframes.pop_front();
+		}
+	}
+	return result;
+}
+MediaSender::Datagrams MediaSender::resend(const List<uint32_t> &sequences, const std::optional<uint64_t> receiver)
+{
+	Datagrams datagrams;
+	LOCK(mutex);
+	for (const auto sequence : sequences)
+	{
+		auto iter = std::find_if(keyframes.begin(), keyframes.end(),
+								 [sequence](const Keyframe &k) { return k.sequence == sequence; });
+		// Authors don't get their own keyframes
+		if (iter != keyframes.end() && !(receiver.has_value() && iter->author == receiver))
+		{
+			datagrams.insert(datagrams.end(), iter->datagrams->begin(), iter->datagrams->end());
+		}
+	}
+	return datagrams;
+}
+MediaReceiver::MediaReceiver(const std::chrono::milliseconds maxDelay, const uint64_t maxMessageSize)
+	: partials(), requested(), missing(), next(std::nullopt), highest(0), maxDelay(maxDelay),
+	  maxMessageSize(maxMessageSize), partialBytes(0)
+{
+}
+MediaReceiver::~MediaReceiver()
+{
+}
+void MediaReceiver::request(const uint32_t sequence)
+{
+	if (missing.size() < MaxMissing && requested.emplace(sequence).second)
+	{
+		missing.push_back(sequence);
+	}
+}
+void MediaReceiver::reset(const uint32_t sequence)
+{
+	partials.clear();
+	requested.clear();
+	missing.clear();
+	partialBytes = 0;
+	next = sequence;
+	highest = sequence;
+}
+void MediaReceiver::erase(const Map<uint32_t, Partial>::iterator iter)
+{
+	partialBytes -= iter->second.bytes;
+	partials.erase(iter);
+}
+bool MediaReceiver::add(const MediaHeader &header, const uint8_t *data, const size_t size, const TimePoint now)
+{
+	if (header.fragments == 0 || header.fragment >= header.fragments || size == 0 || size > MediaHeader::MaxFragment)
+	{
+		return false;
+	}
+	// Messages can't be larger than the ones sent over TCP
+	if (static_cast<uint64_t>(header.fragments - 1u) * MediaHeader::MaxFragment >= maxMessageSize)
+	{
+		return false;
+	}
+	// Already delivered or skipped
+	if (next.has_value() && header.sequence < *next)
+	{
+		return true;
+	}
+	// Start over if too many messages or bytes are incomplete (i.e. the sender restarted or never finishes messages)
+	const bool isNew = partials.find(header.sequence) == partials.end();
+	if (!next.has_value() || (isNew && partials.size() >= MaxPartials) ||
+		partialBytes + size > std::max(MaxPartialBytes, maxMessageSize))
+	{
+		reset(header.sequence);
+	}
+	if (header.sequence > highest)
+	{
+		// Ask for messages that were skipped over or are still incomplete
+		const uint32_t first =
+			std::max({*next, highest, header.sequence - std::min<uint32_t>(header.sequence, MaxMissing)});
+		for (uint32_t sequence = first; sequence < header.sequence; ++sequence)
+		{
+			auto iter = partials.find(sequence);
+			if (iter == partials.end() || iter->second.received < iter->second.fragments.size())
+			{
+				request(sequence);
+			}
+		}
+		highest = header.sequence;
+	}
+
+	auto &partial = partials[header.sequence];
+	if (partial.fragments.empty())
+	{
+		partial.fragments.resize(header.fragments);
+		partial.firstSeen = now;
+		partial.id = header.id;
+		partial.timestamp = header.timestamp;
+		partial.bytes = 0;
+		partial.received = 0;
+		partial.flags = header.flags;
+	}
+	else if (partial.fragments.size() != header.fragments)
+	{
+		return false;
+	}
+	auto &fragment = partial.fragments[header.fragment];
+	if (fragment.empty())
+	{
+		if (partial.bytes + size > maxMessageSize)
+		{
+			erase(partials.find(header.sequence));
+			return false;
+		}
+		fragment.append(data, static_cast<uint32_t>(size));
+		partial.bytes += static_cast<uint32_t>(size);
+		partialBytes += size;
+		++partial.received;
+	}
+	return true;
+}
+void MediaReceiver::poll(const TimePoint now, List<MediaMessage> &messages)
+{
+	while (next.has_value() && !partials.empty())
+	{
+		auto iter = partials.find(*next);
+		if (iter != partials.end() && iter->second.received == iter->second.fragments.size())
+		{
+			auto &partial = iter->second;
+			MediaMessage message;
+			for (const auto &fragment : partial.fragments)
+			{
+				message.bytes.append(fragment);
+			}
+			message.id = partial.id;
+			message.sequence = *next;
+			message.timestamp = partial.timestamp;
+			message.keyframe = (partial.flags & MediaHeader::Keyframe) != 0;
+			message.hasSource = (partial.flags & MediaHeader::HasSource) != 0;
+			messages.emplace_back(std::move(message));
+			erase(iter);
+			requested.erase(*next);
+			++*next;
+			continue;
+		}
+
+		// Wait for the missing message until the oldest message after it has waited long enough
+		auto oldest = std::min_element(partials.begin(), partials.end(), [](const auto &a, const auto &b) {
+			return a.second.firstSeen < b.second.firstSeen;
+		});
+		if (now - oldest->second.firstSeen < maxDelay)
+		{
+			break;
+		}
+		if (iter != partials.end())
+		{
+			erase(iter);
+		}
+		requested.erase(*next);
+		if (partials.empty())
+		{
+			++*next;
+			break;
+		}
+		auto first = std::min_element(partials.begin(), partials.end(),
+									  [](const auto &a, const auto &b) { return a.first < b.first; });
+		for (auto r = requested.begin(); r != requested.end();)
+		{
+			r = *r < first->first ? requested.erase(r) : std::next(r);
+		}
+		next = first->first;
+	}
+}
+List<uint32_t> MediaReceiver::takeMissing()
+{
+	List<uint32_t> list;
+	list.swap(missing);
+	return list;
+}
+void MediaReceiver::setMaxDelay(const std::chrono::milliseconds delay)
+{
+	maxDelay = delay;
+}
+} // namespace TemStream
\ No newline at end of file
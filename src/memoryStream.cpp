@@ -109,4 +109,19 @@ MemoryStream::MemoryStream(ByteList &&bytes) : std::iostream(&buffer), buffer(st
 MemoryStream::~MemoryStream()
 {
 }
+MemoryView::MemoryView(const uint8_t *data, const size_t size) : std::basic_streambuf<char>()
+{
+	// The get area is never written to
+	char *start = reinterpret_cast<char *>(const_cast<uint8_t *>(data));
+	setg(start, start, start + size);
+}
+MemoryView::~MemoryView()
+{
+}
+ViewStream::ViewStream(const uint8_t *data, const size_t size) : std::istream(&view), view(data, size)
+{
+}
+ViewStream::~ViewStream()
+{
+}
 } // namespace TemStream
\ No newline at end of file
@@ -118,6 +118,151 @@ void prepareLargeBytes(const ByteList &bytes, const std::function<void(LargeFile
 		func(std::move(lf));
 	}
 }
+bool isKeyframe(const Frame &frame)
+{
+	return isKeyframe(frame.bytes.data(), frame.bytes.size());
+}
+bool isKeyframe(const uint8_t *bytes, const size_t size)
+{
+	if (size < 4)
+	{
+		return false;
+	}
+
+	// VP8 frames start with a 3 byte tag. Key frames have the lowest bit cleared and are followed by a start code.
+	if (size >= 6 && bytes[3] == 0x9d && bytes[4] == 0x01 && bytes[5] == 0x2a)
+	{
+		return (bytes[0] & 0x1) == 0;
+	}
+
+	// H264 frames are a list of NAL units. Look for an IDR slice or a sequence parameter set.
+	for (size_t i = 0; i + 3 < size; ++i)
+	{
+		if (bytes[i] != 0 || bytes[i + 1] != 0 || bytes[i + 2] != 1)
+		{
+			continue;
+		}
+		const uint8_t type = bytes[i + 3] & 0x1f;
+		if (type == 5 || type == 7)
+		{
+			return true;
+		}
+		i += 2;
+	}
+	return false;
+}
+std::optional<PacketSummary> summarize(const uint8_t *data, const size_t size, const bool hasSource)
+{
+	struct Reader
+	{
+		const uint8_t *data;
+		const size_t size;
+		size_t offset;
+		const bool littleEndian;
+
+		bool read(uint64_t &value, const size_t count)
+		{
+			if (size - offset < count)
+			{
+				return false;
+			}
+			value = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				const size_t shift = littleEndian ? i : count - 1 - i;
+				value |= static_cast<uint64_t>(data[offset + i]) << (shift * 8u);
+			}
+			offset += count;
+			return true;
+		}
+		bool skip(const uint64_t count)
+		{
+			if (size - offset < count)
+			{
+				return false;
+			}
+			offset += static_cast<size_t>(count);
+			return true;
+		}
+	};
+
+	// The first byte is the endianness of the archive
+	if (size == 0 || data[0] > 1)
+	{
+		return std::nullopt;
+	}
+	Reader reader{data, size, 1, data[0] == 1};
+
+	// Variant indices and ByteList sizes are 32-bit
+	PacketSummary summary;
+	summary.keyframe = false;
+	uint64_t index = 0;
+	uint64_t length = 0;
+	if (!reader.read(index, sizeof(int32_t)))
+	{
+		return std::nullopt;
+	}
+	summary.type = static_cast<size_t>(index);
+	switch (summary.type)
+	{
+	case variant_index<Payload, Audio>():
+		if (!reader.read(length, sizeof(uint32_t)) || !reader.skip(length))
+		{
+			return std::nullopt;
+		}
+		break;
+	case variant_index<Payload, Video>(): {
+		// Large files are rare and are handled like any other packet. Frame width and height are skipped.
+		if (!reader.read(index, sizeof(int32_t)) || index != variant_index<Video, Frame>() ||
+			!reader.skip(sizeof(uint16_t) * 2) || !reader.read(length, sizeof(uint32_t)))
+		{
+			return std::nullopt;
+		}
+		const size_t start = reader.offset;
+		if (!reader.skip(length))
+		{
+			return std::nullopt;
+		}
+		summary.keyframe = isKeyframe(data + start, static_cast<size_t>(length));
+	}
+	break;
+	default:
+		return std::nullopt;
+	}
+
+	summary.sourceOffset = reader.offset;
+	if (!hasSource)
+	{
+		return reader.offset == size ? std::make_optional(std::move(summary)) : std::nullopt;
+	}
+
+	// The source is small. It is copied after an endianness byte so cereal can read it.
+	const size_t sourceSize = size - reader.offset;
+	std::array<uint8_t, KB(1)> buffer;
+	if (sourceSize >= buffer.size())
+	{
+		return std::nullopt;
+	}
+	buffer[0] = data[0];
+	memcpy(buffer.data() + 1, data + reader.offset, sourceSize);
+	try
+	{
+		ViewStream stream(buffer.data(), sourceSize + 1);
+		{
+			cereal::PortableBinaryInputArchive ar(stream);
+			ar(summary.source);
+		}
+		if (static_cast<size_t>(stream->getReadPoint()) != sourceSize + 1)
+		{
+			return std::nullopt;
+		}
+	}
+	catch (const std::exception &)
+	{
+		return std::nullopt;
+	}
+	return summary;
+}
 } // namespace Message
 const char *getExtension(const char *filename)
 {
@@ -160,14 +305,16 @@ String printMemory(const size_t mem)
 	return String(buffer);
 }
 
-bool openSocket(SOCKET &fd, const Address &address, const SocketType t, const bool isTcp)
+bool openSocket(SOCKET &fd, const Address &address, const SocketType t, const bool isTcp, const int backlog,
+				const bool reusePort)
 {
 	char port[64];
 	snprintf(port, sizeof(port), "%d", address.port);
-	return openSocket(fd, address.hostname.c_str(), port, t, isTcp);
+	return openSocket(fd, address.hostname.c_str(), port, t, isTcp, backlog, reusePort);
 }
 
-bool openSocket(SOCKET &fd, const char *hostname, const char *port, const SocketType t, const bool isTcp)
+bool openSocket(SOCKET &fd, const char *hostname, const char *port, const SocketType t, const bool isTcp,
+				const int backlog, const bool reusePort)
 {
 	struct addrinfo hints;
 	memset(&hints, 0, sizeof(hints));
@@ -190,12 +337,25 @@ bool openSocket(SOCKET &fd, const char *hostname, const char *port, const Socket
 	switch (t)
 	{
 	case SocketType::Server:
+#ifdef SO_REUSEPORT
+		if (reusePort)
+		{
+			int yes = 1;
+			if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&yes), sizeof(yes)) < 0)
+			{
+				perror("setsockopt");
+				return false;
+			}
+		}
+#else
+		(void)reusePort;
+#endif
 		if (!info.bind(fd))
 		{
 			perror("bind");
 			return false;
 		}
-		if (isTcp && listen(fd, 10) < 0)
+		if (isTcp && listen(fd, backlog) < 0)
 		{
 			perror("listen");
 			return false;
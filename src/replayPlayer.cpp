@@ -0,0 +1,164 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+ReplayPlayer::ReplayPlayer(const int64_t cursor)
+	: mutex(), encoded(), ready(), decoding(std::nullopt), cursor(cursor), generation(0), prefetch(DefaultPrefetch),
+	  failed(false)
+{
+}
+ReplayPlayer::~ReplayPlayer()
+{
+}
+void ReplayPlayer::add(ByteList &&bytes, const int64_t timestamp)
+{
+	LOCK(mutex);
+	encoded.push_back(EncodedPacket{std::move(bytes), timestamp});
+}
+void ReplayPlayer::clear(const int64_t cursor)
+{
+	LOCK(mutex);
+	encoded.clear();
+	ready.clear();
+	decoding = std::nullopt;
+	this->cursor = cursor;
+	++generation;
+}
+void ReplayPlayer::setCursor(const int64_t cursor)
+{
+	LOCK(mutex);
+	this->cursor = cursor;
+}
+void ReplayPlayer::setPrefetch(const uint32_t prefetch)
+{
+	LOCK(mutex);
+	this->prefetch = std::clamp(prefetch, MinPrefetch, MaxPrefetch);
+}
+uint32_t ReplayPlayer::getPrefetch() const
+{
+	LOCK(mutex);
+	return prefetch;
+}
+bool ReplayPlayer::decode()
+{
+	for (size_t i = 0; i < MaxDecodeBatch && !appDone; ++i)
+	{
+		EncodedPacket packet;
+		uint32_t current;
+		{
+			LOCK(mutex);
+			if (failed || encoded.empty() || encoded.front().timestamp > cursor + prefetch)
+			{
+				return true;
+			}
+			packet = std::move(encoded.front());
+			encoded.pop_front();
+			decoding = packet.timestamp;
+			current = generation;
+		}
+
+		ReadyPacket result{Message::Packet(), packet.timestamp, packet.bytes.size()};
+		bool success = true;
+		try
+		{
+			MemoryStream m(std::move(packet.bytes));
+			cereal::PortableBinaryInputArchive ar(m);
+			ar(result.packet);
+		}
+		catch (const std::exception &e)
+		{
+			(*logger)(Logger::Level::Error) << "Packet failure: " << e.what() << std::endl;
+			success = false;
+		}
+
+		LOCK(mutex);
+		if (current != generation)
+		{
+			continue;
+		}
+		decoding = std::nullopt;
+		if (success)
+		{
+			ready.emplace_back(std::move(result));
+		}
+		else
+		{
+			failed = true;
+		}
+	}
+	return true;
+}
+size_t ReplayPlayer::count(const int64_t timestamp) const
+{
+	LOCK(mutex);
+	auto countIn = [timestamp](const auto &packets) {
+		using T = typename std::decay_t<decltype(packets)>::value_type;
+		const auto first = std::lower_bound(packets.begin(), packets.end(), timestamp,
+											[](const T &p, const int64_t t) { return p.timestamp < t; });
+		const auto last = std::upper_bound(first, packets.end(), timestamp,
+										   [](const int64_t t, const T &p) { return t < p.timestamp; });
+		return static_cast<size_t>(std::distance(first, last));
+	};
+	return countIn(ready) + countIn(encoded) + (decoding == timestamp ? 1 : 0);
+}
+std::optional<int64_t> ReplayPlayer::decodedUntil() const
+{
+	LOCK(mutex);
+	if (decoding.has_value())
+	{
+		return *decoding - 1;
+	}
+	if (!encoded.empty())
+	{
+		return encoded.front().timestamp - 1;
+	}
+	return std::nullopt;
+}
+std::optional<int64_t> ReplayPlayer::next() const
+{
+	LOCK(mutex);
+	if (ready.empty())
+	{
+		return std::nullopt;
+	}
+	return ready.front().timestamp;
+}
+std::optional<ReplayPlayer::ReadyPacket> ReplayPlayer::pop()
+{
+	LOCK(mutex);
+	if (ready.empty())
+	{
+		return std::nullopt;
+	}
+	ReadyPacket packet = std::move(ready.front());
+	ready.pop_front();
+	return packet;
+}
+bool ReplayPlayer::hasFailed() const
+{
+	LOCK(mutex);
+	return failed;
+}
+void ReplayPlayer::startDecoding(const shared_ptr<ReplayPlayer> &player)
+{
+	std::weak_ptr<ReplayPlayer> weak = player;
+	WorkPool::addWork([weak]() {
+		auto player = weak.lock();
+		return player != nullptr && player->decode();
+	});
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,91 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+RingBuffer::RingBuffer(const size_t capacity)
+	: buffer(std::max<size_t>(capacity, 1)), scratch(), initialCapacity(buffer.size()), head(0), used(0)
+{
+}
+RingBuffer::~RingBuffer()
+{
+}
+void RingBuffer::grow(const size_t needed)
+{
+	size_t newCapacity = buffer.size();
+	while (newCapacity < needed)
+	{
+		newCapacity *= 2;
+	}
+	List<uint8_t> newBuffer(newCapacity);
+	const size_t first = std::min(used, buffer.size() - head);
+	memcpy(newBuffer.data(), buffer.data() + head, first);
+	memcpy(newBuffer.data() + first, buffer.data(), used - first);
+	buffer.swap(newBuffer);
+	head = 0;
+}
+void RingBuffer::shrink()
+{
+	// A single large message shouldn't keep its memory for the rest of the connection
+	if (buffer.size() <= initialCapacity * ShrinkFactor)
+	{
+		return;
+	}
+	List<uint8_t>(initialCapacity).swap(buffer);
+	List<uint8_t>().swap(scratch);
+}
+void RingBuffer::append(const uint8_t *data, const size_t size)
+{
+	if (used + size > buffer.size())
+	{
+		grow(used + size);
+	}
+	const size_t tail = (head + used) % buffer.size();
+	const size_t first = std::min(size, buffer.size() - tail);
+	memcpy(buffer.data() + tail, data, first);
+	memcpy(buffer.data(), data + first, size - first);
+	used += size;
+}
+const uint8_t *RingBuffer::view(const size_t count)
+{
+	const size_t first = buffer.size() - head;
+	if (count <= first)
+	{
+		return buffer.data() + head;
+	}
+	scratch.resize(count);
+	memcpy(scratch.data(), buffer.data() + head, first);
+	memcpy(scratch.data() + first, buffer.data(), count - first);
+	return scratch.data();
+}
+void RingBuffer::consume(const size_t count)
+{
+	used -= std::min(count, used);
+	if (used == 0)
+	{
+		clear();
+		return;
+	}
+	head = (head + count) % buffer.size();
+}
+void RingBuffer::clear()
+{
+	// Start over at the front so the next bytes are less likely to wrap
+	head = 0;
+	used = 0;
+	shrink();
+}
+} // namespace TemStream
\ No newline at end of file
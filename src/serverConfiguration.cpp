@@ -31,13 +31,43 @@
 
 namespace TemStream
 {
-const char *banList = nullptr;
 Configuration::Configuration()
-	: access(), address(), name("Server"), startTime(static_cast<int64_t>(time(nullptr))), handle(nullptr),
-	  verifyToken(nullptr), verifyUsernameAndPassword(nullptr), messageRateInSeconds(0), maxClients(UINT32_MAX),
-	  maxMessageSize(MB(1)), serverType(ServerType::UnknownServerType), record(false)
+	: access(), address(), name("Server"), accessFile(), streamsFile(), ssl(), upstream(), upstreamName(),
+	  upstreamToken(), startTime(static_cast<int64_t>(time(nullptr))), handle(nullptr), verifyToken(nullptr),
+	  verifyUsernameAndPassword(nullptr), messageRateInSeconds(0), maxClients(UINT32_MAX), maxMessageSize(MB(1)),
+	  maxSendQueueSize(MB(8)), maxSendDelay(10000), maxWriteBatch(Socket::DefaultMaxWriteBytes),
+	  compressMinBytes(DefaultCompressMinBytes), handshakeTimeout(5000),
+	  sessionCacheSize(SSL_SESSION_CACHE_MAX_SIZE_DEFAULT), sessionTimeout(7200),
+	  ioThreads(std::clamp(std::thread::hardware_concurrency() / 4u, 1u, 4u)), acceptThreads(1),
+	  listenBacklog(SOMAXCONN), workerThreads(std::max(std::thread::hardware_concurrency(), 1u)),
+	  recordSyncEvery(1000), recordSegmentSize(ReplayLog::DefaultSegmentSize),
+	  recordSegmentDuration(ReplayLog::DefaultSegmentDuration), recordMaxBytes(0), recordMaxAge(0),
+	  recordCompactAge(0), serverType(ServerType::UnknownServerType), tcpMode(TcpMode::Auto),
+	  recordSync(SyncMode::Interval), record(false), useIoUring(true), upstreamSsl(false), kernelTls(true),
+	  udpMedia(false)
 {
 }
+Configuration::Configuration(const Configuration &c)
+	: access(c.access), address(c.address), name(c.name), accessFile(c.accessFile), streamsFile(c.streamsFile),
+	  ssl(c.ssl), upstream(c.upstream), upstreamName(c.upstreamName), upstreamToken(c.upstreamToken),
+	  startTime(c.startTime), handle(nullptr), verifyToken(c.verifyToken),
+	  verifyUsernameAndPassword(c.verifyUsernameAndPassword), messageRateInSeconds(c.messageRateInSeconds),
+	  maxClients(c.maxClients), maxMessageSize(c.maxMessageSize), maxSendQueueSize(c.maxSendQueueSize),
+	  maxSendDelay(c.maxSendDelay), maxWriteBatch(c.maxWriteBatch), compressMinBytes(c.compressMinBytes),
+	  handshakeTimeout(c.handshakeTimeout),
+	  sessionCacheSize(c.sessionCacheSize), sessionTimeout(c.sessionTimeout), ioThreads(c.ioThreads),
+	  acceptThreads(c.acceptThreads), listenBacklog(c.listenBacklog), workerThreads(c.workerThreads),
+	  recordSyncEvery(c.recordSyncEvery), recordSegmentSize(c.recordSegmentSize),
+	  recordSegmentDuration(c.recordSegmentDuration), recordMaxBytes(c.recordMaxBytes), recordMaxAge(c.recordMaxAge),
+	  recordCompactAge(c.recordCompactAge), serverType(c.serverType), tcpMode(c.tcpMode), recordSync(c.recordSync),
+	  record(c.record), useIoUring(c.useIoUring),
+	  upstreamSsl(c.upstreamSsl), kernelTls(c.kernelTls), udpMedia(c.udpMedia)
+{
+}
+Configuration::Configuration(Configuration &&c) : Configuration(static_cast<const Configuration &>(c))
+{
+	std::swap(handle, c.handle);
+}
 Configuration::~Configuration()
 {
 	if (handle != nullptr)
@@ -50,7 +80,19 @@ Configuration::~Configuration()
 }
 bool Configuration::valid() const
 {
-	return validServerType(serverType) && (ssl.has_value() ? (!ssl->cert.empty() && !ssl->key.empty()) : true);
+	return (hasStreamsFile() || validServerType(serverType)) &&
+		   (ssl.has_value() ? (!ssl->cert.empty() && !ssl->key.empty()) : true) && ioThreads > 0 && workerThreads > 0 &&
+		   acceptThreads > 0 && listenBacklog > 0 && handshakeTimeout > 0 && maxSendQueueSize > 0 && maxSendDelay > 0 &&
+		   maxWriteBatch > 0 &&
+		   !(isRelay() && serverType == ServerType::Link) && !(udpMedia && ssl.has_value());
+}
+bool Configuration::hasStreamsFile() const
+{
+	return !streamsFile.empty();
+}
+bool Configuration::isRelay() const
+{
+	return upstream.has_value();
 }
 #define SET_TYPE(ShortArg, LongArg, s)                                                                                 \
 	if (strcasecmp("-" #ShortArg, argv[i]) == 0 || strcasecmp("--" #LongArg, argv[i]) == 0)                            \
@@ -59,17 +101,74 @@ bool Configuration::valid() const
 		++i;                                                                                                           \
 		continue;                                                                                                      \
 	}
-Configuration loadConfiguration(const int argc, const char **argv)
+/**
+ * Arguments that affect the whole server process. These can't be different for each stream.
+ */
+const char *serverArguments[] = {
+	"-H", "--hostname",
+	"-P", "--port",
+	"-CT", "--certificate",
+	"-K", "--key",
+	"-M", "--memory",
+	"-MC", "--max-clients",
+	"-IO", "--io-threads",
+	"-AT", "--accept-threads",
+	"-LB", "--listen-backlog",
+	"-HT", "--handshake-timeout",
+	"-SC", "--session-cache-size",
+	"-ST", "--session-timeout",
+	"-W", "--workers",
+	"-EP", "--epoll",
+	"-NK", "--no-ktls",
+	"-UM", "--udp-media",
+	"-AU", "--authentication",
+	"-S", "--streams",
+};
+bool isServerArgument(const char *arg)
 {
-	Configuration configuration;
-	for (int i = 1; i < argc;)
+	return std::any_of(std::begin(serverArguments), std::end(serverArguments),
+					   [arg](const char *s) { return strcasecmp(s, arg) == 0; });
+}
+void parseArguments(Configuration &configuration, int i, const int argc, const char **argv, const bool stream)
+{
+	while (i < argc)
 	{
+		if (stream && isServerArgument(argv[i]))
+		{
+			std::string err("Argument can't be used for a single stream: ");
+			err += argv[i];
+			throw std::invalid_argument(std::move(err));
+		}
 		if (strcasecmp("-R", argv[i]) == 0 || strcasecmp("--record", argv[i]) == 0)
 		{
 			configuration.record = true;
 			++i;
 			continue;
 		}
+		if (strcasecmp("-US", argv[i]) == 0 || strcasecmp("--upstream-ssl", argv[i]) == 0)
+		{
+			configuration.upstreamSsl = true;
+			++i;
+			continue;
+		}
+		if (strcasecmp("-EP", argv[i]) == 0 || strcasecmp("--epoll", argv[i]) == 0)
+		{
+			configuration.useIoUring = false;
+			++i;
+			continue;
+		}
+		if (strcasecmp("-NK", argv[i]) == 0 || strcasecmp("--no-ktls", argv[i]) == 0)
+		{
+			configuration.kernelTls = false;
+			++i;
+			continue;
+		}
+		if (strcasecmp("-UM", argv[i]) == 0 || strcasecmp("--udp-media", argv[i]) == 0)
+		{
+			configuration.udpMedia = true;
+			++i;
+			continue;
+		}
 		SET_TYPE(L, link, Link);
 		SET_TYPE(T, text, Text);
 		SET_TYPE(C, chat, Chat);
@@ -95,7 +194,7 @@ Configuration loadConfiguration(const int argc, const char **argv)
 			{
 				configuration.access.members.emplace(std::move(line));
 			}
-			banList = argv[i + 1];
+			configuration.accessFile = argv[i + 1];
 			i += 2;
 			continue;
 		}
@@ -118,7 +217,7 @@ Configuration loadConfiguration(const int argc, const char **argv)
 				}
 				configuration.access.members.emplace(std::move(line));
 			}
-			banList = argv[i + 1];
+			configuration.accessFile = argv[i + 1];
 			i += 2;
 			continue;
 		}
@@ -151,6 +250,38 @@ Configuration loadConfiguration(const int argc, const char **argv)
 			i += 2;
 			continue;
 		}
+		if (strcasecmp("-UH", argv[i]) == 0 || strcasecmp("--upstream-hostname", argv[i]) == 0)
+		{
+			if (!configuration.upstream)
+			{
+				configuration.upstream = Address();
+			}
+			configuration.upstream->hostname = argv[i + 1];
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-UP", argv[i]) == 0 || strcasecmp("--upstream-port", argv[i]) == 0)
+		{
+			if (!configuration.upstream)
+			{
+				configuration.upstream = Address();
+			}
+			configuration.upstream->port = atoi(argv[i + 1]);
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-UN", argv[i]) == 0 || strcasecmp("--upstream-name", argv[i]) == 0)
+		{
+			configuration.upstreamName = argv[i + 1];
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-UT", argv[i]) == 0 || strcasecmp("--upstream-token", argv[i]) == 0)
+		{
+			configuration.upstreamToken = argv[i + 1];
+			i += 2;
+			continue;
+		}
 		if (strcasecmp("-N", argv[i]) == 0 || strcasecmp("--name", argv[i]) == 0)
 		{
 			configuration.name = argv[i + 1];
@@ -175,12 +306,166 @@ Configuration loadConfiguration(const int argc, const char **argv)
 			i += 2;
 			continue;
 		}
+		if (strcasecmp("-SQ", argv[i]) == 0 || strcasecmp("--send-queue-size", argv[i]) == 0)
+		{
+			configuration.maxSendQueueSize = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-SD", argv[i]) == 0 || strcasecmp("--send-queue-delay", argv[i]) == 0)
+		{
+			configuration.maxSendDelay = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-WB", argv[i]) == 0 || strcasecmp("--write-batch", argv[i]) == 0)
+		{
+			configuration.maxWriteBatch = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-CM", argv[i]) == 0 || strcasecmp("--compress-min", argv[i]) == 0)
+		{
+			configuration.compressMinBytes = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-TM", argv[i]) == 0 || strcasecmp("--tcp-mode", argv[i]) == 0)
+		{
+			const char *mode = argv[i + 1];
+			if (strcasecmp("auto", mode) == 0)
+			{
+				configuration.tcpMode = TcpMode::Auto;
+			}
+			else if (strcasecmp("nagle", mode) == 0)
+			{
+				configuration.tcpMode = TcpMode::Nagle;
+			}
+			else if (strcasecmp("nodelay", mode) == 0)
+			{
+				configuration.tcpMode = TcpMode::NoDelay;
+			}
+			else if (strcasecmp("cork", mode) == 0)
+			{
+				configuration.tcpMode = TcpMode::Cork;
+			}
+			else
+			{
+				std::string err("Unknown TCP mode: ");
+				err += mode;
+				throw std::invalid_argument(std::move(err));
+			}
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RS", argv[i]) == 0 || strcasecmp("--record-sync", argv[i]) == 0)
+		{
+			const char *mode = argv[i + 1];
+			if (strcasecmp("never", mode) == 0)
+			{
+				configuration.recordSync = SyncMode::Never;
+			}
+			else if (strcasecmp("interval", mode) == 0)
+			{
+				configuration.recordSync = SyncMode::Interval;
+			}
+			else if (strcasecmp("bytes", mode) == 0)
+			{
+				configuration.recordSync = SyncMode::Bytes;
+			}
+			else
+			{
+				std::string err("Unknown record sync mode: ");
+				err += mode;
+				throw std::invalid_argument(std::move(err));
+			}
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RE", argv[i]) == 0 || strcasecmp("--record-sync-every", argv[i]) == 0)
+		{
+			configuration.recordSyncEvery = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RSS", argv[i]) == 0 || strcasecmp("--record-segment-size", argv[i]) == 0)
+		{
+			configuration.recordSegmentSize = strtoull(argv[i + 1], nullptr, 10);
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RST", argv[i]) == 0 || strcasecmp("--record-segment-time", argv[i]) == 0)
+		{
+			configuration.recordSegmentDuration = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RMB", argv[i]) == 0 || strcasecmp("--record-max-bytes", argv[i]) == 0)
+		{
+			configuration.recordMaxBytes = strtoull(argv[i + 1], nullptr, 10);
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RMA", argv[i]) == 0 || strcasecmp("--record-max-age", argv[i]) == 0)
+		{
+			configuration.recordMaxAge = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-RCA", argv[i]) == 0 || strcasecmp("--record-compact-age", argv[i]) == 0)
+		{
+			configuration.recordCompactAge = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
 		if (strcasecmp("-MR", argv[i]) == 0 || strcasecmp("--message-rate", argv[i]) == 0)
 		{
 			configuration.messageRateInSeconds = static_cast<uint32_t>(atoi(argv[i + 1]));
 			i += 2;
 			continue;
 		}
+		if (strcasecmp("-IO", argv[i]) == 0 || strcasecmp("--io-threads", argv[i]) == 0)
+		{
+			configuration.ioThreads = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-AT", argv[i]) == 0 || strcasecmp("--accept-threads", argv[i]) == 0)
+		{
+			configuration.acceptThreads = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-LB", argv[i]) == 0 || strcasecmp("--listen-backlog", argv[i]) == 0)
+		{
+			configuration.listenBacklog = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-HT", argv[i]) == 0 || strcasecmp("--handshake-timeout", argv[i]) == 0)
+		{
+			configuration.handshakeTimeout = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-SC", argv[i]) == 0 || strcasecmp("--session-cache-size", argv[i]) == 0)
+		{
+			configuration.sessionCacheSize = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-ST", argv[i]) == 0 || strcasecmp("--session-timeout", argv[i]) == 0)
+		{
+			configuration.sessionTimeout = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
+		if (strcasecmp("-W", argv[i]) == 0 || strcasecmp("--workers", argv[i]) == 0)
+		{
+			configuration.workerThreads = static_cast<uint32_t>(atoi(argv[i + 1]));
+			i += 2;
+			continue;
+		}
 		if (strcasecmp("-CT", argv[i]) == 0 || strcasecmp("--certificate", argv[i]) == 0)
 		{
 			if (!configuration.ssl)
@@ -201,10 +486,30 @@ Configuration loadConfiguration(const int argc, const char **argv)
 			i += 2;
 			continue;
 		}
+		if (strcasecmp("-S", argv[i]) == 0 || strcasecmp("--streams", argv[i]) == 0)
+		{
+			configuration.streamsFile = argv[i + 1];
+			i += 2;
+			continue;
+		}
 		std::string err("Unexpected argument: ");
 		err += argv[i];
 		throw std::invalid_argument(std::move(err));
 	}
+}
+Configuration loadConfiguration(const int argc, const char **argv)
+{
+	Configuration configuration;
+	parseArguments(configuration, 1, argc, argv, false);
+	if (configuration.isRelay() && configuration.serverType == ServerType::Link)
+	{
+		throw std::invalid_argument("Link servers can't be relayed");
+	}
+	if (configuration.udpMedia && configuration.ssl)
+	{
+		// Media on the UDP channel isn't encrypted
+		throw std::invalid_argument("UDP media can't be used with SSL");
+	}
 	if (configuration.valid())
 	{
 		return configuration;
@@ -212,6 +517,75 @@ Configuration loadConfiguration(const int argc, const char **argv)
 
 	throw std::invalid_argument("Unknown server type");
 }
+List<Configuration> loadStreams(const Configuration &configuration)
+{
+	// Required to use STL containers for JSON serializing
+	std::vector<std::vector<std::string>> temp;
+	{
+		std::ifstream file(configuration.streamsFile.c_str());
+		if (!file.is_open())
+		{
+			std::string message = "Failed to open file: ";
+			message += configuration.streamsFile;
+			throw std::invalid_argument(std::move(message));
+		}
+		cereal::JSONInputArchive ar(file);
+		ar(cereal::make_nvp("streams", temp));
+	}
+
+	List<Configuration> streams;
+	Set<String> names;
+	for (const auto &arguments : temp)
+	{
+		Configuration &stream = streams.emplace_back(configuration);
+		stream.streamsFile.clear();
+		stream.serverType = ServerType::UnknownServerType;
+		stream.name.clear();
+		stream.access = Access();
+		stream.accessFile.clear();
+
+		List<const char *> argv;
+		for (const auto &argument : arguments)
+		{
+			argv.push_back(argument.c_str());
+		}
+		parseArguments(stream, 0, static_cast<int>(argv.size()), argv.data(), true);
+
+		if (stream.name.empty())
+		{
+			throw std::invalid_argument("Stream doesn't have a name");
+		}
+		if (stream.isRelay() && stream.serverType == ServerType::Link)
+		{
+			std::string message = "Link streams can't be relayed: ";
+			message += stream.name;
+			throw std::invalid_argument(std::move(message));
+		}
+		if (stream.udpMedia && stream.ssl)
+		{
+			std::string message = "UDP media can't be used with SSL: ";
+			message += stream.name;
+			throw std::invalid_argument(std::move(message));
+		}
+		if (!stream.valid())
+		{
+			std::string message = "Unknown server type for stream: ";
+			message += stream.name;
+			throw std::invalid_argument(std::move(message));
+		}
+		if (!names.emplace(stream.name).second)
+		{
+			std::string message = "Duplicate stream: ";
+			message += stream.name;
+			throw std::invalid_argument(std::move(message));
+		}
+	}
+	if (streams.empty())
+	{
+		throw std::invalid_argument("Streams file doesn't have any streams");
+	}
+	return streams;
+}
 void saveBanList(const char *filename, const Set<String> &members)
 {
 	std::ofstream file(filename);
@@ -227,9 +601,9 @@ void saveBanList(const char *filename, const Set<String> &members)
 }
 void saveConfiguration(const Configuration &c)
 {
-	if (banList != nullptr)
+	if (!c.accessFile.empty())
 	{
-		saveBanList(banList, c.access.members);
+		saveBanList(c.accessFile.c_str(), c.access.members);
 	}
 	else if (!c.access.members.empty())
 	{
@@ -247,18 +621,81 @@ void saveConfiguration(const Configuration &c)
 }
 std::ostream &operator<<(std::ostream &os, const Configuration &configuration)
 {
-	os << "Address: " << configuration.address << "\nName: " << configuration.name
-	   << "\nStream type: " << configuration.serverType << "\nAccess: " << configuration.access
+	os << "Address: " << configuration.address << "\nName: " << configuration.name;
+	if (configuration.hasStreamsFile())
+	{
+		os << "\nStreams: " << configuration.streamsFile;
+	}
+	os << "\nStream type: " << configuration.serverType << "\nAccess: " << configuration.access
 	   << "\nMax Clients: " << configuration.maxClients
-	   << "\nMessage Rate (in seconds): " << configuration.messageRateInSeconds << '\n';
-	printMemory(os, "Max Message Size", configuration.maxMessageSize)
-		<< "\nRecording: " << (configuration.record ? "Yes" : "No") << "\nAuthentication: " << configuration.handle;
+	   << "\nMessage Rate (in seconds): " << configuration.messageRateInSeconds
+	   << "\nI/O Threads: " << configuration.ioThreads << "\nWorker Threads: " << configuration.workerThreads
+	   << "\nAccept Threads: " << configuration.acceptThreads << "\nListen Backlog: " << configuration.listenBacklog
+	   << '\n';
+	printMemory(os, "Max Message Size", configuration.maxMessageSize) << '\n';
+	printMemory(os, "Max Send Queue Size", configuration.maxSendQueueSize)
+		<< "\nMax Send Queue Delay (in milliseconds): " << configuration.maxSendDelay << '\n';
+	printMemory(os, "Write Batch Size", configuration.maxWriteBatch) << '\n';
+	printMemory(os, "Min Compressed Message Size", configuration.compressMinBytes)
+		<< "\nTCP Mode: " << configuration.tcpMode
+		<< "\nRecording: " << (configuration.record ? "Yes" : "No");
+	if (configuration.record)
+	{
+		os << "\nRecord Sync: " << configuration.recordSync;
+		switch (configuration.recordSync)
+		{
+		case SyncMode::Interval:
+			os << " (every " << configuration.recordSyncEvery << " milliseconds)";
+			break;
+		case SyncMode::Bytes:
+			os << " (every " << configuration.recordSyncEvery << " bytes)";
+			break;
+		default:
+			break;
+		}
+		os << '\n';
+		printMemory(os, "Record Segment Size", configuration.recordSegmentSize)
+			<< "\nRecord Segment Duration (in seconds): " << configuration.recordSegmentDuration << '\n';
+		printMemory(os, "Record Max Size", configuration.recordMaxBytes)
+			<< "\nRecord Max Age (in seconds): " << configuration.recordMaxAge
+			<< "\nRecord Compact Age (in seconds): " << configuration.recordCompactAge;
+	}
+	os << "\nUDP Media: " << (configuration.udpMedia ? "Yes" : "No")
+#if TEMSTREAM_USE_IO_URING
+		<< "\nio_uring: " << (configuration.useIoUring ? "Yes" : "No")
+#endif
+		<< "\nAuthentication: " << configuration.handle;
+	if (configuration.upstream)
+	{
+		os << "\nUpstream: " << *configuration.upstream << " ("
+		   << (configuration.upstreamName.empty() ? configuration.name : configuration.upstreamName) << ')'
+		   << "\nUpstream SSL: " << (configuration.upstreamSsl ? "Yes" : "No");
+	}
 	if (configuration.ssl)
 	{
-		os << "\nCertificate: " << configuration.ssl->cert << "\nKey: " << configuration.ssl->key;
+		os << "\nCertificate: " << configuration.ssl->cert << "\nKey: " << configuration.ssl->key
+		   << "\nHandshake Timeout (in milliseconds): " << configuration.handshakeTimeout
+		   << "\nSession Cache Size: " << configuration.sessionCacheSize
+		   << "\nSession Timeout (in seconds): " << configuration.sessionTimeout
+		   << "\nKernel TLS: " << (configuration.kernelTls ? "Yes" : "No");
 	}
 	return os;
 }
+TcpMode Configuration::getTcpMode() const
+{
+	if (tcpMode != TcpMode::Auto)
+	{
+		return tcpMode;
+	}
+	switch (serverType)
+	{
+	case ServerType::Image:
+	case ServerType::Video:
+		return TcpMode::Cork;
+	default:
+		return TcpMode::NoDelay;
+	}
+}
 Message::Source Configuration::getSource() const
 {
 	Message::Source source;
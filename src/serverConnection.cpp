@@ -30,8 +30,10 @@
 namespace TemStream
 {
 std::atomic_int32_t ServerConnection::runningThreads = 0;
-Mutex ServerConnection::peersMutex;
-unique_ptr<LinkedList<std::weak_ptr<ServerConnection>>> ServerConnection::peers = nullptr;
+std::atomic<uint64_t> ServerConnection::nextId = 0;
+unique_ptr<PeerRegistry> ServerConnection::peers = nullptr;
+Map<String, shared_ptr<ServerStream>> ServerConnection::streams;
+unique_ptr<MediaServer> ServerConnection::media = nullptr;
 unique_ptr<StringList> ServerConnection::badWords = nullptr;
 
 int runApp(Configuration &configuration)
@@ -53,59 +55,78 @@ int runApp(Configuration &configuration)
 		}
 	}
 
-	ConcurrentQueue<RecordedPacket> packetsToRecord;
-	ServerConnection::peers = tem_unique<LinkedList<std::weak_ptr<ServerConnection>>>();
+	ServerConnection::peers = tem_unique<PeerRegistry>();
 
-	if (configuration.serverType == ServerType::Link)
-	{
-		++ServerConnection::runningThreads;
-		std::thread thread([&configuration]() {
-			String filename = ServerConnection::sendLinks(configuration);
-			auto lastWrite = fs::last_write_time(filename);
-			using namespace std::chrono_literals;
-			while (!appDone)
-			{
-				const auto now = fs::last_write_time(filename);
-				if (now != lastWrite)
-				{
-					ServerConnection::sendLinks(configuration);
-					lastWrite = now;
-				}
-				std::this_thread::sleep_for(1s);
-			}
-			--ServerConnection::runningThreads;
-		});
-		thread.detach();
+	// Streams from the streams file. Otherwise, the server only has the stream from the command line.
+	List<Configuration> configurations =
+		configuration.hasStreamsFile() ? loadStreams(configuration) : List<Configuration>();
+	for (auto &c : configurations)
+	{
+		ServerConnection::streams.emplace(c.name, tem_shared<ServerStream>(c));
 	}
-
-	if (configuration.record)
+	if (configurations.empty())
 	{
-		++ServerConnection::runningThreads;
-		std::thread thread([&configuration, &packetsToRecord]() {
-			const String filename = ServerConnection::getReplayFilename(configuration);
-			using namespace std::chrono_literals;
-			while (!appDone)
+		ServerConnection::streams.emplace(configuration.name, tem_shared<ServerStream>(configuration));
+	}
+	for (auto &pair : ServerConnection::streams)
+	{
+		if (configuration.hasStreamsFile())
+		{
+			*logger << "Stream:\n" << pair.second->getConfiguration() << std::endl;
+		}
+		pair.second->start();
+	}
+
+	int result = EXIT_FAILURE;
+
+	WorkerPool workers;
+	List<unique_ptr<Reactor>> reactors;
+
+	List<unique_ptr<TcpSocket>> listeners;
+	List<std::thread> acceptors;
+	const auto acceptConnections = [&configuration, &reactors](TcpSocket &socket) {
+		while (!appDone)
+		{
+			auto newCon = socket.acceptConnection(appDone);
+			if (newCon == nullptr)
 			{
-				auto packet = packetsToRecord.pop(1s);
-				if (!packet)
-				{
-					continue;
-				}
+				continue;
+			}
 
-				if (!packet->save(filename))
-				{
-					(*logger)(Logger::Level::Warning) << "Failed to save packet" << std::endl;
-				}
+			if (ServerConnection::peers->size() >= configuration.maxClients)
+			{
+				(*logger)(Logger::Level::Warning) << "Max clients reached (" << configuration.maxClients
+												  << ") Cannot accept new client" << std::endl;
+				continue;
 			}
-			packetsToRecord.flush([&filename](RecordedPacket &&packet) { packet.save(filename); });
-			--ServerConnection::runningThreads;
-		});
-		thread.detach();
-	}
 
-	int result = EXIT_FAILURE;
+			std::array<char, INET6_ADDRSTRLEN> str;
+			uint16_t port;
+			if (newCon->getIpAndPort(str, port))
+			{
+				*logger << "New connection: " << str.data() << ':' << port << std::endl;
 
-	unique_ptr<TcpSocket> socket = nullptr;
+				auto peer =
+					tem_shared<ServerConnection>(configuration, Address(str.data(), port), std::move(newCon));
+				ServerConnection::peers->add(peer);
+				// Give the connection to the least busy reactor
+				auto reactor = std::min_element(reactors.begin(), reactors.end(),
+												[](const auto &a, const auto &b) { return a->size() < b->size(); });
+				(*reactor)->add(std::move(peer));
+			}
+		}
+	};
+
+#ifdef SO_REUSEPORT
+	const uint32_t listenerCount = configuration.acceptThreads;
+#else
+	const uint32_t listenerCount = 1;
+	if (configuration.acceptThreads > 1)
+	{
+		(*logger)(Logger::Level::Warning) << "Multiple accept threads aren't supported on this platform" << std::endl;
+	}
+#endif
+	SSLSocket::kernelTls = configuration.kernelTls;
 	if (configuration.ssl)
 	{
 		SSL_library_init();
@@ -113,266 +134,395 @@ int runApp(Configuration &configuration)
 		SSL_load_error_strings();
 		SSLSocket::cert = configuration.ssl->cert.c_str();
 		SSLSocket::key = configuration.ssl->key.c_str();
-		socket = openSocket<SSLSocket>(configuration.address, SocketType::Server, true);
-	}
-	else
-	{
-		socket = openSocket<TcpSocket>(configuration.address, SocketType::Server, true);
+		SSLSocket::sessionCacheSize = configuration.sessionCacheSize;
+		SSLSocket::sessionTimeout = configuration.sessionTimeout;
 	}
-	if (!socket)
+	for (uint32_t i = 0; i < listenerCount; ++i)
 	{
-		goto end;
+		// Each listener has its own socket on the same port. The kernel spreads new connections between them.
+		const int backlog = static_cast<int>(std::min<uint32_t>(configuration.listenBacklog, INT_MAX));
+		const bool reusePort = listenerCount > 1;
+		unique_ptr<TcpSocket> socket = nullptr;
+		if (configuration.ssl)
+		{
+			socket = openSocket<SSLSocket>(configuration.address, SocketType::Server, true, backlog, reusePort);
+		}
+		else
+		{
+			socket = openSocket<TcpSocket>(configuration.address, SocketType::Server, true, backlog, reusePort);
+		}
+		if (!socket)
+		{
+			goto end;
+		}
+		listeners.emplace_back(std::move(socket));
 	}
 
-	while (!appDone)
+	workers.start(configuration.workerThreads);
+	if (configuration.udpMedia)
 	{
-		auto newCon = socket->acceptConnection(appDone);
-		if (newCon == nullptr)
+		// Peers keep using TCP for media if the UDP socket can't be opened
+		ServerConnection::media = tem_unique<MediaServer>(workers);
+		if (!ServerConnection::media->start(configuration.address))
 		{
-			continue;
+			ServerConnection::media = nullptr;
 		}
-
-		if (ServerConnection::totalPeers() >= configuration.maxClients)
+	}
+	for (uint32_t i = 0; i < configuration.ioThreads; ++i)
+	{
+		auto reactor = Reactor::create(workers, configuration);
+		if (reactor == nullptr)
 		{
-			(*logger)(Logger::Level::Warning)
-				<< "Max clients reached (" << configuration.maxClients << ") Cannot accept new client" << std::endl;
-			continue;
+			goto end;
 		}
+		reactors.emplace_back(std::move(reactor));
+	}
 
-		std::array<char, INET6_ADDRSTRLEN> str;
-		uint16_t port;
-		if (newCon->getIpAndPort(str, port))
-		{
-			*logger << "New connection: " << str.data() << ':' << port << std::endl;
-
-			auto peer = tem_shared<ServerConnection>(configuration, packetsToRecord, Address(str.data(), port),
-													 std::move(newCon));
-			++ServerConnection::runningThreads;
-			std::thread thread(ServerConnection::runPeerConnection, std::move(peer));
-			thread.detach();
-		}
+	for (size_t i = 1; i < listeners.size(); ++i)
+	{
+		acceptors.emplace_back(acceptConnections, std::ref(*listeners[i]));
 	}
+	acceptConnections(*listeners.front());
 
 	result = EXIT_SUCCESS;
 
 end:
 	*logger << "Ending server: " << configuration.name << std::endl;
+	appDone = true;
+	for (auto &acceptor : acceptors)
+	{
+		acceptor.join();
+	}
+	for (auto &reactor : reactors)
+	{
+		reactor->join();
+	}
+	if (ServerConnection::media != nullptr)
+	{
+		ServerConnection::media->join();
+	}
+	workers.join();
 	while (ServerConnection::runningThreads > 0)
 	{
 		using namespace std::chrono_literals;
 		std::this_thread::sleep_for(100ms);
 	}
+	reactors.clear();
+	if (configuration.ssl)
+	{
+		*logger << "TLS handshake durations: " << Reactor::getHandshakeDurations() << std::endl;
+	}
+	for (auto &c : configurations)
+	{
+		saveConfiguration(c);
+	}
+	ServerConnection::media = nullptr;
+	ServerConnection::streams.clear();
 	ServerConnection::peers = nullptr;
 	ServerConnection::badWords = nullptr;
 	logger = nullptr;
 	return result;
 }
-void ServerConnection::runPeerConnection(shared_ptr<ServerConnection> peer)
-{
-	{
-		LOCK(peersMutex);
-		peers->emplace_back(peer);
-	}
-	peer->handleInput();
-	--ServerConnection::runningThreads;
-}
-void ServerConnection::handleInput()
+void ServerConnection::handlePackets()
 {
-	struct ConnectionLog
-	{
-		ServerConnection &connection;
-		ConnectionLog(ServerConnection &connection) : connection(connection)
-		{
-			*logger << "Handling connection: " << connection.getAddress() << std::endl;
-		}
-		~ConnectionLog()
-		{
-			*logger << "Ending connection: " << connection.getAddress() << std::endl;
-		}
-	};
-	ConnectionLog cl(*this);
-
-	maxMessageSize = configuration.maxMessageSize;
-
-	std::thread thread(&ServerConnection::handleOutput, this);
-	std::thread sender([this]() {
-		using namespace std::chrono_literals;
-		while (!appDone && this->stayConnected)
-		{
-			stayConnected = (*this)->flush();
-			std::this_thread::sleep_for(1ms);
-		}
-	});
-
 	using namespace std::chrono_literals;
-	while (!appDone && stayConnected)
+	auto &packets = getPackets();
+	do
 	{
-		try
+		while (!appDone && stayConnected)
 		{
-			if (!readAndHandle(1000))
+			auto packet = packets.pop(0s);
+			if (!packet)
 			{
 				break;
 			}
-			if (!isAuthenticated() && std::chrono::system_clock::now() - startingTime > 10s)
+			try
 			{
-				(*logger)(Logger::Level::Warning) << "Client failed to authenticate within 10 seconds" << std::endl;
-				break;
+				if (!ServerConnection::MessageHandler(*this, std::move(*packet))())
+				{
+					disconnect();
+				}
+			}
+			catch (const std::bad_alloc &)
+			{
+				(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
+			}
+			catch (const std::exception &e)
+			{
+				(*logger)(Logger::Level::Error) << "Exception occurred: " << e.what() << std::endl;
 			}
 		}
-		catch (const std::bad_alloc &)
-		{
-			(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
-		}
-		catch (const std::exception &e)
+		while (!appDone && stayConnected)
 		{
-			(*logger)(Logger::Level::Error) << "Exception occurred: " << e.what() << std::endl;
+			auto packet = forwarded.pop(0s);
+			if (!packet)
+			{
+				break;
+			}
+			try
+			{
+				if (!forward(std::move(*packet)))
+				{
+					disconnect();
+				}
+			}
+			catch (const std::bad_alloc &)
+			{
+				(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
+			}
+			catch (const std::exception &e)
+			{
+				(*logger)(Logger::Level::Error) << "Exception occurred: " << e.what() << std::endl;
+			}
 		}
-	}
-
-	stayConnected = false;
-	thread.join();
-	sender.join();
+		scheduled = false;
+		// The reactor may have added packets after the queue was found to be empty but before the flag was cleared
+	} while (!appDone && stayConnected && hasPackets() && !scheduled.exchange(true));
 }
-void ServerConnection::handleOutput()
+bool ServerConnection::hasPackets()
 {
-	using namespace std::chrono_literals;
-	auto &packets = getPackets();
-	while (!appDone && stayConnected)
+	return !getPackets().empty() || !forwarded.empty();
+}
+bool ServerConnection::tryForward(const uint8_t *data, const size_t size, const uint32_t streamId,
+								  const bool hasSource)
+{
+	// Until the peer has joined a stream, every packet is decoded and handled in order
+	auto s = std::atomic_load(&stream);
+	if (s == nullptr)
 	{
-		auto packet = packets.pop(100ms);
-		if (!packet)
-		{
-			continue;
-		}
-		try
-		{
-			stayConnected = ServerConnection::MessageHandler(*this, std::move(*packet))();
-		}
-		catch (const std::bad_alloc &)
-		{
-			(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
-		}
-		catch (const std::exception &e)
-		{
-			(*logger)(Logger::Level::Error) << "Exception occurred: " << e.what() << std::endl;
-		}
+		return false;
 	}
+	const auto serverType = s->configuration.serverType;
+	if (serverType != ServerType::Audio && serverType != ServerType::Video)
+	{
+		return false;
+	}
+	if (!hasSource && streamId != s->getId())
+	{
+		return false;
+	}
+	auto summary = Message::summarize(data, size, hasSource);
+	if (!summary.has_value() || summary->type != ServerTypeToIndex(serverType))
+	{
+		return false;
+	}
+	const auto offset = static_cast<uint32_t>(summary->sourceOffset);
+	auto body = tem_shared<ByteList>(data, offset);
+	auto source = hasSource ? tem_shared<ByteList>(data + offset, static_cast<uint32_t>(size - offset))
+							: s->getSourceBytes();
+	forwarded.emplace(ForwardedPacket{std::move(*summary), std::move(body), std::move(source), streamId, hasSource});
+	return true;
 }
-void ServerConnection::sendToPeers(Message::Packet &&packet, const ServerConnection *author)
+bool ServerConnection::forward(ForwardedPacket &&packet)
 {
-	MemoryStream m;
+	auto &stream = *this->stream;
+	if (packet.hasSource ? !stream.isSource(packet.summary.source) : packet.streamId != stream.getId())
 	{
-		cereal::PortableBinaryOutputArchive ar(m);
-		ar(packet);
+		(*logger)(Logger::Level::Error) << "Server got message with wrong server address: " << packet.summary.source
+										<< std::endl;
+		return false;
 	}
-	LOCK(peersMutex);
-	for (auto iter = peers->begin(); iter != peers->end();)
+	if (!canPublish(packet.summary.type))
 	{
-		if (shared_ptr<ServerConnection> ptr = iter->lock())
-		{
-			// Don't send packet to peer author or if the peer isn't authenticated
-			if (ptr.get() != author && ptr->isAuthenticated())
-			{
-				const auto &bytes = m->getBytes();
-				(*ptr)->send(bytes.data(), bytes.size());
-			}
-			++iter;
-		}
-		else
-		{
-			iter = peers->erase(iter);
-		}
+		return false;
+	}
+	if (stream.configuration.record)
+	{
+		stream.packetsToRecord.emplace(packet.body, packet.source);
+	}
+	const SendPolicy policy =
+		packet.summary.type == variant_index<Message::Payload, Message::Video>() ? SendPolicy::DropUntilKeyframe
+																				  : SendPolicy::DropOldest;
+	// Relayed streams may change their source. Send it with every packet.
+	if (stream.configuration.isRelay())
+	{
+		auto bytes = tem_shared<ByteList>(*packet.body);
+		bytes->append(*packet.source);
+		sendToPeers(stream, bytes, nullptr, packet.summary.type, policy, packet.summary.keyframe, this);
+	}
+	else
+	{
+		sendToPeers(stream, packet.body, packet.source, packet.summary.type, policy, packet.summary.keyframe, this);
 	}
+	return true;
 }
-
-bool ServerConnection::peerExists(const String &name)
+bool ServerConnection::resolveSource(const uint32_t streamId, Message::Source &source)
 {
-	LOCK(peersMutex);
-	for (auto iter = peers->begin(); iter != peers->end();)
+	auto s = std::atomic_load(&stream);
+	if (s == nullptr || streamId != s->getId())
 	{
-		if (shared_ptr<ServerConnection> ptr = iter->lock())
-		{
-			if ((*ptr).information.name == name)
-			{
-				return true;
-			}
-			++iter;
-		}
-		else
-		{
-			iter = peers->erase(iter);
-		}
+		return false;
 	}
-	return false;
+	source = s->getSource();
+	return true;
 }
-size_t ServerConnection::totalPeers()
+void ServerConnection::disconnect()
 {
-	LOCK(peersMutex);
-	return ServerConnection::peers->size();
+	stayConnected = false;
+	mSocket->wakeup();
 }
-List<PeerInformation> ServerConnection::getPeers()
+void ServerConnection::leave()
 {
-	List<PeerInformation> list;
-	LOCK(peersMutex);
-	for (auto iter = peers->begin(); iter != peers->end();)
+	if (media != nullptr && mediaToken != 0)
 	{
-		if (auto ptr = iter->lock())
-		{
-			list.push_back(ptr->information);
-			++iter;
-		}
-		else
+		media->remove(mediaToken);
+	}
+	if (auto window = std::atomic_exchange(&replayWindow, shared_ptr<ReplayWindow>()))
+	{
+		window->cancel();
+	}
+	peers->remove(id);
+	if (auto s = std::atomic_load(&stream))
+	{
+		s->peers.remove(id);
+	}
+}
+shared_ptr<ServerStream> ServerConnection::findStream(const String &name)
+{
+	// Clients that don't know the stream's name can still join a server with one stream
+	if (streams.size() == 1)
+	{
+		return streams.begin()->second;
+	}
+	auto iter = streams.find(name);
+	return iter == streams.end() ? nullptr : iter->second;
+}
+void ServerConnection::sendToPeers(ServerStream &stream, Message::Packet &&packet, const ServerConnection *author,
+								   const bool record)
+{
+	// Slow peers can skip media but must receive everything else
+	SendPolicy policy = SendPolicy::Reliable;
+	bool keyframe = false;
+	if (auto video = std::get_if<Message::Video>(&packet.payload))
+	{
+		if (auto frame = std::get_if<Message::Frame>(video))
 		{
-			iter = peers->erase(iter);
+			policy = SendPolicy::DropUntilKeyframe;
+			keyframe = Message::isKeyframe(*frame);
 		}
 	}
-	return list;
+	else if (std::holds_alternative<Message::Audio>(packet.payload))
+	{
+		policy = SendPolicy::DropOldest;
+	}
+	// Relayed streams may change their source. Send it with every packet.
+	SharedBytes body;
+	SharedBytes source;
+	if (stream.configuration.isRelay())
+	{
+		body = Socket::serialize(packet);
+	}
+	else
+	{
+		body = Socket::serialize(packet, false);
+		source = Socket::serialize(packet.source);
+	}
+	if (record)
+	{
+		stream.packetsToRecord.emplace(body, source);
+	}
+	sendToPeers(stream, body, source, packet.payload.index(), policy, keyframe, author);
 }
-void ServerConnection::checkAccess(Configuration &configuration)
+void ServerConnection::sendToPeers(ServerStream &stream, const SharedBytes &body, const SharedBytes &source,
+								   const size_t type, const SendPolicy policy, const bool keyframe,
+								   const ServerConnection *author)
 {
-	LOCK(peersMutex);
-	for (auto iter = peers->begin(); iter != peers->end();)
+	// The same bytes are shared with every peer. Each framing's header is only made if a peer uses it. The last
+	// header is for compressed bodies.
+	std::array<SharedBytes, 4> headers;
+	shared_ptr<const MediaSender::Datagrams> datagrams;
+	const uint32_t sourceSize = source == nullptr ? 0 : source->size();
+	const uint32_t compressMinBytes = stream.configuration.compressMinBytes;
+	bool compressible = compressMinBytes != 0 && body->size() >= compressMinBytes && isCompressible(type);
+	SharedBytes compressed;
+	const auto snapshot = stream.peers.snapshot();
+	for (const auto &ptr : *snapshot)
 	{
-		if (auto ptr = iter->lock())
+		// Don't send packet to peer author
+		if (ptr.get() == author)
+		{
+			continue;
+		}
+		// Media that can be dropped goes over UDP if the peer has a media channel
+		if (policy != SendPolicy::Reliable && media != nullptr)
 		{
-			if (configuration.access.isBanned(ptr->information.name))
+			if (auto address = std::atomic_load(&ptr->mediaAddress))
 			{
-				ptr->stayConnected = false;
+				if (datagrams == nullptr)
+				{
+					datagrams = stream.media.split(body->data(), body->size(), source == nullptr ? 0 : stream.getId(),
+												   keyframe, source == nullptr,
+												   author == nullptr ? std::nullopt : std::make_optional(author->id));
+				}
+				if (datagrams != nullptr)
+				{
+					media->send(*datagrams, *address);
+					continue;
+				}
 			}
-			++iter;
+		}
+		const Framing framing = (*ptr)->getFraming();
+		if (framing >= Framing::V2)
+		{
+			// V3 peers can be sent the body compressed. It is only compressed once.
+			if (framing >= Framing::V3 && compressible && compressed == nullptr)
+			{
+				compressed = compressMessage(body->data(), body->size(), type);
+				compressible = compressed != nullptr;
+			}
+			const bool useCompressed = framing >= Framing::V3 && compressible;
+			const auto &bytes = useCompressed ? compressed : body;
+			// V2 peers learned the stream's id when they logged in
+			auto &header = headers[useCompressed ? 3 : static_cast<size_t>(framing) - 1];
+			if (header == nullptr)
+			{
+				header = source == nullptr ? Socket::makeHeader(bytes->size(), framing, static_cast<uint8_t>(type),
+																0, true, useCompressed)
+										   : Socket::makeHeader(bytes->size(), framing, static_cast<uint8_t>(type),
+																stream.getId(), false, useCompressed);
+			}
+			(*ptr)->send(OutgoingPacket(header, bytes, policy, keyframe));
 		}
 		else
 		{
-			iter = peers->erase(iter);
+			auto &header = headers[0];
+			if (header == nullptr)
+			{
+				header = Socket::makeHeader(body->size() + sourceSize);
+			}
+			(*ptr)->send(OutgoingPacket(header, body, source, policy, keyframe));
 		}
 	}
 }
-String ServerConnection::getReplayFilename(Configuration &configuration)
+
+List<PeerInformation> ServerConnection::getPeers(const ServerStream &stream)
 {
-	return configuration.name + "_replay.tsr";
+	List<PeerInformation> list;
+	const auto snapshot = stream.peers.snapshot();
+	for (const auto &ptr : *snapshot)
+	{
+		list.push_back(ptr->information);
+	}
+	return list;
 }
-shared_ptr<ServerConnection> ServerConnection::getPointer() const
+void ServerConnection::checkAccess(ServerStream &stream)
 {
-	LOCK(peersMutex);
-	for (auto iter = peers->begin(); iter != peers->end();)
+	const auto snapshot = stream.peers.snapshot();
+	for (const auto &ptr : *snapshot)
 	{
-		if (auto ptr = iter->lock())
-		{
-			if (ptr.get() == this)
-			{
-				return ptr;
-			}
-			++iter;
-		}
-		else
+		if (stream.configuration.access.isBanned(ptr->information.name))
 		{
-			iter = peers->erase(iter);
+			ptr->disconnect();
 		}
 	}
-	return nullptr;
 }
-String ServerConnection::sendLinks(Configuration &configuration)
+shared_ptr<ServerConnection> ServerConnection::getPointer() const
 {
+	return peers->find(id);
+}
+String ServerConnection::sendLinks(ServerStream &stream)
+{
+	const auto &configuration = stream.configuration;
 	String filename;
 	try
 	{
@@ -395,9 +545,9 @@ String ServerConnection::sendLinks(Configuration &configuration)
 
 		(*logger)(Logger::Level::Trace) << "Sending links: " << links.size() << std::endl;
 		Message::Packet packet;
-		packet.source = configuration.getSource();
+		packet.source = stream.getSource();
 		packet.payload.emplace<Message::ServerLinks>(std::move(links));
-		ServerConnection::sendToPeers(std::move(packet));
+		ServerConnection::sendToPeers(stream, std::move(packet));
 	}
 	catch (const std::exception &e)
 	{
@@ -405,15 +555,24 @@ String ServerConnection::sendLinks(Configuration &configuration)
 	}
 	return filename;
 }
-ServerConnection::ServerConnection(Configuration &configuration, ConcurrentQueue<RecordedPacket> &packetsToRecord,
-								   Address &&address, unique_ptr<Socket> s)
-	: Connection(std::move(address), std::move(s)), startingTime(std::chrono::system_clock::now()),
-	  configuration(configuration), packetsToRecord(packetsToRecord), stayConnected(true)
+ServerConnection::ServerConnection(Configuration &configuration, Address &&address, unique_ptr<Socket> s)
+	: Connection(std::move(address), std::move(s)), id(nextId++), information(),
+	  startingTime(std::chrono::system_clock::now()), configuration(configuration), stream(nullptr),
+	  forwarded(), mediaAddress(nullptr), mediaToken(0), replayWindow(nullptr), stayConnected(true), scheduled(false)
 {
+	setLimits(configuration);
 }
 ServerConnection::~ServerConnection()
 {
 }
+void ServerConnection::setLimits(const Configuration &c)
+{
+	maxMessageSize = c.maxMessageSize;
+	mSocket->setLimits(SendLimits{c.maxSendQueueSize, std::chrono::milliseconds(c.maxSendDelay)});
+	mSocket->setWriteBatch(c.maxWriteBatch);
+	mSocket->setCompression(c.compressMinBytes);
+	mSocket->setTcpMode(c.getTcpMode());
+}
 bool ServerConnection::isAuthenticated() const
 {
 	return !information.name.empty();
@@ -427,41 +586,57 @@ ServerConnection::MessageHandler::~MessageHandler()
 }
 bool ServerConnection::MessageHandler::processCurrentMessage()
 {
-	if (packet.payload.index() != ServerTypeToIndex(connection.configuration.serverType))
+	if (!connection.canPublish(packet.payload.index()))
 	{
-		(*logger)(Logger::Level::Error) << "Server got invalid message type: " << packet.payload.index() << std::endl;
 		return false;
 	}
-	if (!connection.information.hasWriteAccess())
+	auto &stream = *connection.stream;
+	ServerConnection::sendToPeers(stream, std::move(packet), &connection, stream.configuration.record);
+	return true;
+}
+bool ServerConnection::canPublish(const size_t type)
+{
+	if (type != ServerTypeToIndex(stream->configuration.serverType))
 	{
-		(*logger)(Logger::Level::Error) << "Peer doesn't have write access: " << connection.information << std::endl;
+		(*logger)(Logger::Level::Error) << "Server got invalid message type: " << type << std::endl;
+		return false;
+	}
+	if (stream->configuration.isRelay())
+	{
+		(*logger)(Logger::Level::Error) << "Peer tried to send to a relay stream: " << information << std::endl;
+		return false;
+	}
+	if (!information.hasWriteAccess())
+	{
+		(*logger)(Logger::Level::Error) << "Peer doesn't have write access: " << information << std::endl;
 		return false;
 	}
 	const auto now = std::chrono::system_clock::now();
-	if (connection.configuration.messageRateInSeconds != 0)
+	if (stream->configuration.messageRateInSeconds != 0)
 	{
 		const auto timepoint =
-			connection.lastMessage + std::chrono::duration<uint32_t>(connection.configuration.messageRateInSeconds);
+			lastMessage + std::chrono::duration<uint32_t>(stream->configuration.messageRateInSeconds);
 		if (now < timepoint)
 		{
-			(*logger)(Logger::Level::Error)
-				<< "Peer is sending packets too frequently: " << connection.information << std::endl;
+			(*logger)(Logger::Level::Error) << "Peer is sending packets too frequently: " << information << std::endl;
 			return false;
 		}
 	}
-
-	if (connection.configuration.record)
-	{
-		connection.packetsToRecord.emplace(packet);
-	}
-	connection.lastMessage = now;
-	ServerConnection::sendToPeers(std::move(packet), &connection);
+	lastMessage = now;
 	return true;
 }
 bool ServerConnection::MessageHandler::operator()()
 {
-	if (!std::holds_alternative<Message::Credentials>(packet.payload) &&
-		packet.source != connection.configuration.getSource())
+	if (std::holds_alternative<Message::Credentials>(packet.payload))
+	{
+		return std::visit(*this, packet.payload);
+	}
+	if (connection.stream == nullptr)
+	{
+		(*logger)(Logger::Level::Error) << "Got message from peer before getting their information" << std::endl;
+		return false;
+	}
+	if (!connection.stream->isSource(packet.source))
 	{
 		(*logger)(Logger::Level::Error) << "Server got message with wrong server address: " << packet.source
 										<< std::endl;
@@ -506,7 +681,7 @@ bool ServerConnection::MessageHandler::operator()(Message::Chat &chat)
 bool ServerConnection::MessageHandler::operator()(Message::Image &image)
 {
 	CHECK_INFO(Message::Image)
-	std::visit(ImageSaver(connection, packet.source), image.largeFile);
+	std::visit(ImageSaver(*connection.stream, packet.source), image.largeFile);
 	return processCurrentMessage();
 }
 bool ServerConnection::MessageHandler::operator()(Message::Video &)
@@ -525,42 +700,87 @@ std::optional<PeerInformation> ServerConnection::login(const Message::Credential
 }
 bool ServerConnection::MessageHandler::operator()(Message::Credentials &credentials)
 {
-	auto &configuration = connection.configuration;
 	if (!connection.information.name.empty())
 	{
 		(*logger)(Logger::Level::Error) << "Peer sent credentials more than once" << std::endl;
 		return false;
 	}
+	// An empty packet tells peers with newer headers that the server understood them, so they report the failure
+	// instead of reconnecting with older headers
+	const auto reject = [this]() {
+		if (connection->getFraming() >= Framing::V2)
+		{
+			connection->sendPacket(Message::Packet());
+		}
+		return false;
+	};
+	auto stream = findStream(packet.source.serverName);
+	if (stream == nullptr)
+	{
+		(*logger)(Logger::Level::Error) << "Peer tried to join unknown stream: '" << packet.source.serverName << "'"
+										<< std::endl;
+		return reject();
+	}
 	auto info = connection.login(credentials);
 	if (!info.has_value() || info->name.empty())
 	{
 		(*logger)(Logger::Level::Error) << "Invalid credentials sent" << std::endl;
-		return false;
+		return reject();
 	}
-	if (ServerConnection::peerExists(info->name))
+	const String name = info->name;
+	connection.information.swap(*info);
+	// Set before joining so the reactor can remove the connection from the stream
+	std::atomic_store(&connection.stream, stream);
+	auto &configuration = stream->configuration;
+	connection.setLimits(configuration);
+	auto pointer = connection.getPointer();
+	if (pointer == nullptr)
 	{
-		(*logger)(Logger::Level::Error) << "Duplicate peer " << *info << " attempted to connect" << std::endl;
-		return false;
+		return reject();
 	}
-	connection.information.swap(*info);
-	checkAccess(configuration);
-	if (!connection.stayConnected)
+	stream->peers.add(std::move(pointer));
+	if (!stream->peers.reserve(connection.id, name))
+	{
+		(*logger)(Logger::Level::Error) << "Duplicate peer " << connection.information << " attempted to connect"
+										<< std::endl;
+		return reject();
+	}
+	if (configuration.access.isBanned(name))
 	{
 		(*logger)(Logger::Level::Warning) << "Peer " << connection.information << "  is banned" << std::endl;
-		return false;
+		return reject();
 	}
+	checkAccess(*stream);
 	*logger << "Peer: " << connection.address << " -> " << connection.information << std::endl;
 	{
+		// Sent before the peer is published so that it arrives before any packet from the stream. This also gives
+		// V2 peers the stream's id.
 		Message::Packet packet;
-		packet.source = configuration.getSource();
+		packet.source = stream->getSource();
 		Message::VerifyLogin login;
-		login.serverName = configuration.name;
+		login.serverName = packet.source.serverName;
 		login.sendRate = configuration.messageRateInSeconds;
 		login.serverType = configuration.serverType;
 		login.peerInformation = connection.information;
 		packet.payload.emplace<Message::VerifyLogin>(std::move(login));
-		connection->sendPacket(packet);
+		connection->sendPacket(packet, false, stream->getId(), true);
 	}
+	// Older clients don't know about media channels. Peers with V2 framing do.
+	if (media != nullptr && connection->getFraming() >= Framing::V2 &&
+		(configuration.serverType == ServerType::Audio || configuration.serverType == ServerType::Video))
+	{
+		auto pointer = connection.getPointer();
+		auto channel = pointer == nullptr ? std::nullopt : media->add(pointer);
+		if (channel.has_value())
+		{
+			connection.mediaToken = channel->token;
+			Message::Packet packet;
+			packet.source = stream->getSource();
+			packet.payload.emplace<Message::MediaChannel>(std::move(*channel));
+			connection->sendPacket(packet);
+		}
+	}
+	stream->peers.publish();
 
 	return sendStoredPayload();
 }
@@ -572,41 +792,27 @@ bool ServerConnection::MessageHandler::operator()(Message::BanUser &banUser)
 										<< " tried to change ban a user" << std::endl;
 		return false;
 	}
-	if (!connection.configuration.access.banList)
+	if (!connection.stream->configuration.access.banList)
 	{
 		(*logger)(Logger::Level::Error) << "Peer " << connection.information
 										<< " tried to change ban a user when there is no ban list" << std::endl;
 		return false;
 	}
+	auto &stream = *connection.stream;
+	if (auto ptr = stream.peers.find(banUser.name))
 	{
-		LOCK(peersMutex);
-		for (auto iter = ServerConnection::peers->begin(); iter != ServerConnection::peers->end();)
+		if (ptr->information.isModerator())
 		{
-			if (auto ptr = iter->lock())
-			{
-				if (ptr->information.name == banUser.name)
-				{
-					if (ptr->information.isModerator())
-					{
-						(*logger)(Logger::Level::Warning) << "Moderator " << connection.information
-														  << " tried to ban user: " << ptr->information << std::endl;
-					}
-					else
-					{
-						*logger << "Banned user: " << ptr->information << std::endl;
-						connection.configuration.access.members.insert(ptr->information.name);
-					}
-					break;
-				}
-				++iter;
-			}
-			else
-			{
-				iter = ServerConnection::peers->erase(iter);
-			}
+			(*logger)(Logger::Level::Warning) << "Moderator " << connection.information
+											  << " tried to ban user: " << ptr->information << std::endl;
+		}
+		else
+		{
+			*logger << "Banned user: " << ptr->information << std::endl;
+			connection.stream->configuration.access.members.insert(ptr->information.name);
 		}
 	}
-	ServerConnection::checkAccess(connection.configuration);
+	ServerConnection::checkAccess(stream);
 	return true;
 }
 bool ServerConnection::MessageHandler::operator()(Message::GetReplay replay)
@@ -630,7 +836,7 @@ bool ServerConnection::MessageHandler::operator()(Message::GetReplay replay)
 			if (sent == 0)
 			{
 				Message::Packet packet;
-				packet.source = connection.configuration.getSource();
+				packet.source = connection.stream->getSource();
 				packet.payload.emplace<Message::NoReplay>();
 				connection->sendPacket(packet);
 			}
@@ -638,35 +844,19 @@ bool ServerConnection::MessageHandler::operator()(Message::GetReplay replay)
 	};
 	Foo foo(connection);
 
-	auto &configuration = connection.configuration;
-	const String filename = ServerConnection::getReplayFilename(configuration);
-	std::ifstream file(filename.c_str());
-	if (!file.is_open())
-	{
-		return true;
-	}
-
-	String s;
-	while (std::getline(file, s))
-	{
-		auto message = RecordedPacket::getEncodedPacket(s, replay.timestamp);
-		if (message)
+	bool success = true;
+	connection.stream->replay.read(replay.timestamp, [this, &foo, &success](ByteList &&bytes) {
+		Message::Packet packet;
+		packet.source = connection.stream->getSource();
+		packet.payload.emplace<Message::Replay>(Message::Replay{base64_encode(bytes)});
+		success = connection->sendPacket(packet);
+		if (success)
 		{
-			Message::Packet packet;
-			packet.source = configuration.getSource();
-			packet.payload.emplace<Message::Replay>(Message::Replay{std::move(*message)});
-			if (!connection->sendPacket(packet))
-			{
-				return false;
-			}
 			++foo.sent;
 		}
-		else if (foo.sent != 0)
-		{
-			break;
-		}
-	}
-	return true;
+		return success;
+	});
+	return success;
 }
 bool ServerConnection::MessageHandler::operator()(Message::GetTimeRange)
 {
@@ -694,48 +884,11 @@ bool ServerConnection::MessageHandler::operator()(Message::GetTimeRange)
 
 	Foo foo;
 
-	std::optional<int64_t> start = std::nullopt;
-	std::optional<int64_t> last = std::nullopt;
-
-	auto &configuration = connection.configuration;
-	{
-		const String filename = ServerConnection::getReplayFilename(configuration);
-		std::ifstream file(filename.c_str());
-		if (!file.is_open())
-		{
-			return true;
-		}
-
-		String s;
-		std::string::size_type pos;
-		std::getline(file, s);
-		start = RecordedPacket::getTimestamp(s, pos);
-
-		String prev;
-		do
-		{
-			prev = std::move(s);
-		} while (std::getline(file, s));
-
-		last = RecordedPacket::getTimestamp(prev, pos);
-	}
-
-	if (start.has_value())
+	if (auto range = connection.stream->replay.getTimeRange())
 	{
 		Message::Packet packet;
-		packet.source = configuration.getSource();
-		Message::TimeRange range;
-		range.start = *start;
-		if (last.has_value())
-		{
-			range.end = *last;
-		}
-		else
-		{
-			range.end = *start;
-		}
-
-		packet.payload.emplace<Message::TimeRange>(std::move(range));
+		packet.source = connection.stream->getSource();
+		packet.payload.emplace<Message::TimeRange>(std::move(*range));
 		foo.success = true;
 		return connection->sendPacket(packet);
 	}
@@ -745,6 +898,52 @@ bool ServerConnection::MessageHandler::operator()(Message::TimeRange &)
 {
 	BAD_MESSAGE(TimeRange);
 }
+bool ServerConnection::MessageHandler::operator()(Message::MediaChannel &)
+{
+	BAD_MESSAGE(MediaChannel);
+}
+bool ServerConnection::MessageHandler::operator()(Message::GetReplayRange &range)
+{
+	if (!connection.information.hasReplayAccess())
+	{
+		(*logger)(Logger::Level::Error) << "Peer " << connection.information << " does not have replay access"
+										<< std::endl;
+		return false;
+	}
+
+	auto pointer = connection.getPointer();
+	if (pointer == nullptr)
+	{
+		return false;
+	}
+	// Leave half of the send queue for the live stream and for a chunk that goes past the window. Otherwise a full
+	// window would overflow the queue and disconnect the peer.
+	auto stream = std::atomic_load(&connection.stream);
+	const auto &c = stream == nullptr ? connection.configuration : stream->getConfiguration();
+	auto window = tem_shared<ReplayWindow>(range.id, range.window, c.maxSendQueueSize / 2);
+	if (auto previous = std::atomic_exchange(&connection.replayWindow, window))
+	{
+		previous->cancel();
+	}
+	++runningThreads;
+	std::thread thread(MessageHandler::sendReplayRange, std::move(pointer), std::move(window), range);
+	thread.detach();
+	return true;
+}
+bool ServerConnection::MessageHandler::operator()(Message::ReplayCredit &credit)
+{
+	// Credits of an earlier replay are ignored
+	auto window = std::atomic_load(&connection.replayWindow);
+	if (window != nullptr && window->getId() == credit.id)
+	{
+		window->give(credit.bytes);
+	}
+	return true;
+}
+bool ServerConnection::MessageHandler::operator()(Message::ReplayChunk &)
+{
+	BAD_MESSAGE(ReplayChunk);
+}
 bool ServerConnection::MessageHandler::operator()(Message::NoReplay)
 {
 	BAD_MESSAGE(NoReplay);
@@ -774,12 +973,12 @@ bool ServerConnection::MessageHandler::operator()(Message::RequestServerInformat
 		return false;
 	}
 	Message::Packet packet;
-	packet.source = connection.configuration.getSource();
+	packet.source = connection.stream->getSource();
 	Message::ServerInformation info;
-	info.peers = getPeers();
-	if (connection.configuration.access.banList)
+	info.peers = getPeers(*connection.stream);
+	if (connection.stream->configuration.access.banList)
 	{
-		info.banList = connection.configuration.access.members;
+		info.banList = connection.stream->configuration.access.members;
 	}
 	packet.payload.emplace<Message::ServerInformation>(std::move(info));
 	connection->sendPacket(packet);
@@ -787,61 +986,21 @@ bool ServerConnection::MessageHandler::operator()(Message::RequestServerInformat
 }
 bool ServerConnection::MessageHandler::savePayloadIfNedded(bool append) const
 {
-	if (packet.source != connection.configuration.getSource())
-	{
-		return false;
-	}
-
-	std::array<char, KB(1)> buffer;
-	connection.getFilename(buffer);
-#if WIN32
-	int
-#else
-	auto
-#endif
-		flags = std::ios::out;
-	if (append)
-	{
-		flags |= std::ios::app;
-	}
-	else
-	{
-		flags |= std::ios::trunc;
-	}
-	std::ofstream file(buffer.data(), flags);
-	if (!file.is_open())
+	if (!connection.stream->isSource(packet.source))
 	{
 		return false;
 	}
-
-	try
-	{
-		cereal::PortableBinaryOutputArchive ar(file);
-		ar(packet.payload);
-
-		return true;
-	}
-	catch (const std::bad_alloc &)
-	{
-		(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
-	}
-	catch (const std::exception &e)
-	{
-		(*logger)(Logger::Level::Error) << "Failed to save payload for stream " << connection.configuration.name << ": "
-										<< e.what() << std::endl;
-	}
-	return false;
+	return connection.stream->savePayload(packet.payload, append);
 }
 bool ServerConnection::MessageHandler::sendStoredPayload()
 {
 	std::array<char, KB(1)> buffer;
 	connection.getFilename(buffer);
 
-	auto &configuration = connection.configuration;
-	switch (connection.configuration.serverType)
+	switch (connection.stream->configuration.serverType)
 	{
 	case ServerType::Link:
-		ServerConnection::sendLinks(configuration);
+		ServerConnection::sendLinks(*connection.stream);
 		return true;
 	case ServerType::Text:
 		try
@@ -857,7 +1016,7 @@ bool ServerConnection::MessageHandler::sendStoredPayload()
 				ar(payload);
 			}
 			Message::Packet packet;
-			packet.source = configuration.getSource();
+			packet.source = connection.stream->getSource();
 			packet.payload = std::move(payload);
 			connection->sendPacket(packet);
 		}
@@ -867,37 +1026,90 @@ bool ServerConnection::MessageHandler::sendStoredPayload()
 			return false;
 		}
 		break;
-	case ServerType::Image: {
-		std::thread thread(MessageHandler::sendImageBytes, connection.getPointer(), configuration.getSource(),
-						   String(buffer.data()));
-		thread.detach();
-	}
-	break;
+	case ServerType::Image:
+		// Every peer is sent the same chunks
+		if (auto image = connection.stream->getImage())
+		{
+			const Framing framing = connection->getFraming();
+			const auto &headers = image->headers[static_cast<size_t>(framing) - 1];
+			const SharedBytes source = framing == Framing::V1 ? image->source : nullptr;
+			// The chunks may be larger than the send queue and take longer than its delay limit to send. They are
+			// queued at once without counting toward the limits.
+			for (size_t i = 0; i < image->bodies.size(); ++i)
+			{
+				connection->send(OutgoingPacket(headers[i], image->bodies[i], source, SendPolicy::Shared));
+			}
+		}
+		break;
 	default:
 		break;
 	}
 	return true;
 }
-void ServerConnection::MessageHandler::sendImageBytes(shared_ptr<ServerConnection> ptr, Message::Source &&source,
-													  String &&filename)
+void ServerConnection::MessageHandler::sendReplayRange(shared_ptr<ServerConnection> ptr,
+													   shared_ptr<ReplayWindow> window, Message::GetReplayRange range)
 {
-
-	std::ifstream file(filename.c_str(), std::ios::binary | std::ios::out);
-	if (!file.is_open())
+	auto stream = std::atomic_load(&ptr->stream);
+	if (stream == nullptr)
 	{
+		--runningThreads;
 		return;
 	}
+	const auto source = stream->getSource();
+	const int64_t speed = std::clamp<int64_t>(range.speed, 1, Message::GetReplayRange::MaxSpeed);
+	const auto begin = std::chrono::system_clock::now();
 
-	Message::prepareLargeBytes(file, [ptr, &source](Message::LargeFile &&lf) {
+	Message::ReplayChunk chunk{{}, range.start, range.id, false};
+	uint32_t chunkSize = 0;
+	const auto send = [&]() {
+		if (!window->take(chunkSize))
+		{
+			return false;
+		}
 		Message::Packet packet;
 		packet.source = source;
-		Message::Image image{std::move(lf)};
-		packet.payload.emplace<Message::Image>(std::move(image));
-		(*ptr)->sendPacket(packet);
+		packet.payload.emplace<Message::ReplayChunk>(std::move(chunk));
+		chunk = Message::ReplayChunk{{}, chunk.timestamp, range.id, false};
+		chunkSize = 0;
+		return ptr->stayConnected && (*ptr)->sendPacket(packet);
+	};
+
+	// One sequential read of the range. Only the seconds that playback is about to reach are sent.
+	stream->replay.read(range.start, range.end, [&](const int64_t timestamp, ByteList &&bytes) {
+		if (timestamp != chunk.timestamp)
+		{
+			if (!chunk.packets.empty() && !send())
+			{
+				return false;
+			}
+			chunk.timestamp = timestamp;
+			const auto due = begin + std::chrono::milliseconds((timestamp - range.start - ReplayLead) * 1000 / speed);
+			if (std::chrono::system_clock::now() < due)
+			{
+				// Let the peer play through the gap while waiting
+				if (!send() || !window->waitUntil(due))
+				{
+					return false;
+				}
+			}
+		}
+		chunkSize += bytes.size();
+		chunk.packets.emplace_back(std::move(bytes));
+		return chunkSize < MaxReplayChunkSize || send();
 	});
+
+	if (!chunk.packets.empty())
+	{
+		send();
+	}
+	chunk.timestamp = range.end;
+	chunk.last = true;
+	send();
+	std::atomic_compare_exchange_strong(&ptr->replayWindow, &window, shared_ptr<ReplayWindow>());
+	--runningThreads;
 }
-ServerConnection::ImageSaver::ImageSaver(ServerConnection &connection, const Message::Source &source)
-	: connection(connection), source(source)
+ServerConnection::ImageSaver::ImageSaver(const ServerStream &stream, const Message::Source &source)
+	: stream(stream), source(source)
 {
 }
 ServerConnection::ImageSaver::~ImageSaver()
@@ -910,13 +1122,14 @@ void ServerConnection::ImageSaver::operator()(const Message::LargeFile &lf)
 void ServerConnection::ImageSaver::operator()(uint64_t)
 {
 	std::array<char, KB(1)> buffer;
-	connection.getFilename(buffer);
+	stream.getFilename(buffer);
 	fs::remove(buffer.data());
+	stream.clearImage();
 }
 void ServerConnection::ImageSaver::operator()(const ByteList &bytes)
 {
 	std::array<char, KB(1)> buffer;
-	connection.getFilename(buffer);
+	stream.getFilename(buffer);
 	std::ofstream file(buffer.data(), std::ios::app | std::ios::out | std::ios::binary);
 	if (!file.is_open())
 	{
@@ -928,6 +1141,7 @@ void ServerConnection::ImageSaver::operator()(const ByteList &bytes)
 }
 void ServerConnection::ImageSaver::operator()(std::monostate)
 {
+	stream.cacheImage();
 }
 CredentialHandler::CredentialHandler(VerifyToken verifyToken, VerifyUsernameAndPassword verifyUsernameAndPassword)
 	: verifyToken(verifyToken), verifyUsernameAndPassword(verifyUsernameAndPassword)
@@ -991,46 +1205,4 @@ std::optional<PeerInformation> CredentialHandler::operator()(const Message::User
 	}
 	return info;
 }
-RecordedPacket::RecordedPacket(const Message::Packet &packet)
-	: packet(packet), timestamp(static_cast<int64_t>(time(nullptr)))
-{
-}
-RecordedPacket::~RecordedPacket()
-{
-}
-
-bool RecordedPacket::save(const String &filename) const
-{
-	std::ofstream file(filename.c_str(), std::ios::app | std::ios::out);
-	if (!file.is_open())
-	{
-		return false;
-	}
-
-	file << timestamp << ':' << packet << std::endl;
-	return true;
-}
-
-std::optional<int64_t> RecordedPacket::getTimestamp(const String &s, std::string::size_type &pos)
-{
-	pos = s.find(":");
-	if (pos == std::string::npos)
-	{
-		return std::nullopt;
-	}
-
-	const String t(s.begin(), s.begin() + pos);
-	return static_cast<int64_t>(strtoll(t.c_str(), nullptr, 10));
-}
-
-std::optional<String> RecordedPacket::getEncodedPacket(const String &s, const int64_t target)
-{
-	std::string::size_type pos;
-	const auto timestamp = getTimestamp(s, pos);
-	if (*timestamp != target)
-	{
-		return std::nullopt;
-	}
-	return String(s.begin() + pos + 1, s.end());
-}
 } // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,225 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+MediaServer::MediaServer(WorkerPool &workers)
+	: mutex(), peers(), socket(nullptr), workers(workers), thread(), port(0)
+{
+}
+MediaServer::~MediaServer()
+{
+	join();
+}
+bool MediaServer::start(const Address &address)
+{
+	socket = openSocket<UdpSocket>(address, SocketType::Server, false);
+	if (socket == nullptr || !socket->setNonBlocking())
+	{
+		(*logger)(Logger::Level::Error) << "Failed to open media socket: " << address << std::endl;
+		socket = nullptr;
+		return false;
+	}
+	port = address.port;
+	thread = std::thread(&MediaServer::run, this);
+	return true;
+}
+void MediaServer::join()
+{
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+std::optional<Message::MediaChannel> MediaServer::add(const shared_ptr<ServerConnection> &connection)
+{
+	Message::MediaChannel channel{0, port, {}};
+	if (RAND_bytes(channel.key.data(), static_cast<int>(channel.key.size())) != 1)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to make media key" << std::endl;
+		return std::nullopt;
+	}
+	LOCK(mutex);
+	while (channel.token == 0 || peers.find(channel.token) != peers.end())
+	{
+		channel.token = static_cast<uint32_t>(Guid::random().longs[0]);
+	}
+	peers.emplace(channel.token, Peer{connection, std::nullopt, nullptr, channel.key, 0});
+	return channel;
+}
+void MediaServer::remove(const uint32_t token)
+{
+	LOCK(mutex);
+	peers.erase(token);
+}
+void MediaServer::send(const MediaSender::Datagrams &datagrams, const SocketAddress &address)
+{
+	for (const auto &datagram : datagrams)
+	{
+		socket->sendTo(*datagram, &address);
+	}
+}
+void MediaServer::run()
+{
+	using namespace std::chrono_literals;
+	ByteList bytes;
+	SocketAddress address;
+	while (!appDone)
+	{
+		// Wake up often enough to skip messages that won't arrive
+		switch (socket->pollRead(10))
+		{
+		case PollState::Error:
+			(*logger)(Logger::Level::Error) << "Media socket failed" << std::endl;
+			return;
+		case PollState::GotData:
+			for (int i = 0; i < 256; ++i)
+			{
+				if (!socket->receiveFrom(bytes, address))
+				{
+					break;
+				}
+				if (bytes.empty())
+				{
+					break;
+				}
+				handle(bytes, address, std::chrono::system_clock::now());
+			}
+			break;
+		default:
+			break;
+		}
+		deliver(std::chrono::system_clock::now());
+	}
+}
+void MediaServer::handle(const ByteList &bytes, const SocketAddress &address, const TimePoint now)
+{
+	auto header = MediaHeader::read(bytes.data(), bytes.size());
+	if (!header.has_value())
+	{
+		return;
+	}
+
+	LOCK(mutex);
+	auto iter = peers.find(header->id);
+	if (iter == peers.end())
+	{
+		return;
+	}
+	auto &peer = iter->second;
+	auto connection = peer.connection.lock();
+	if (connection == nullptr)
+	{
+		return;
+	}
+
+	switch (header->kind)
+	{
+	case MediaKind::Hello: {
+		// Anyone who sees a datagram knows the token. Only the peer knows the key and an old Hello can't move the
+		// channel to another address.
+		if (!MediaHeader::verifyHello(bytes.data(), bytes.size(), peer.key) ||
+			(peer.address.has_value() && peer.address != address && header->sequence <= peer.hello))
+		{
+			return;
+		}
+		peer.hello = std::max(peer.hello, header->sequence);
+		// Peers behind a NAT are reached at the address their datagrams come from
+		peer.address = address;
+		if (peer.receiver == nullptr)
+		{
+			auto stream = std::atomic_load(&connection->stream);
+			const auto &c = stream == nullptr ? connection->configuration : stream->getConfiguration();
+			peer.receiver = tem_unique<MediaReceiver>(
+				c.serverType == ServerType::Audio ? MediaReceiver::AudioDelay : MediaReceiver::VideoDelay,
+				c.maxMessageSize);
+		}
+		shared_ptr<const SocketAddress> shared = tem_shared<SocketAddress>(address);
+		std::atomic_store(&connection->mediaAddress, std::move(shared));
+		socket->sendTo(*MediaHeader::makeHello(header->id, header->sequence, peer.key), &address);
+	}
+	break;
+	case MediaKind::Data:
+		if (peer.address != address || peer.receiver == nullptr)
+		{
+			return;
+		}
+		if (!peer.receiver->add(*header, bytes.data() + MediaHeader::Size, bytes.size() - MediaHeader::Size, now))
+		{
+			(*logger)(Logger::Level::Warning) << "Invalid media datagram from " << connection->information << std::endl;
+		}
+		break;
+	case MediaKind::Nack: {
+		if (peer.address != address)
+		{
+			return;
+		}
+		auto stream = std::atomic_load(&connection->stream);
+		if (stream != nullptr)
+		{
+			send(stream->media.resend(MediaHeader::readSequences(bytes.data(), bytes.size()), connection->id),
+				 address);
+		}
+	}
+	break;
+	default:
+		break;
+	}
+}
+void MediaServer::deliver(const TimePoint now)
+{
+	List<MediaMessage> messages;
+	LOCK(mutex);
+	for (auto &pair : peers)
+	{
+		auto &peer = pair.second;
+		if (peer.receiver == nullptr || !peer.address.has_value())
+		{
+			continue;
+		}
+		auto connection = peer.connection.lock();
+		if (connection == nullptr)
+		{
+			continue;
+		}
+		peer.receiver->poll(now, messages);
+		if (!messages.empty())
+		{
+			// Handled the same way as frames that came over TCP
+			auto stream = std::atomic_load(&connection->stream);
+			for (const auto &message : messages)
+			{
+				if (stream == nullptr || !connection->tryForward(message.bytes.data(), message.bytes.size(),
+																 stream->getId(), message.hasSource))
+				{
+					(*logger)(Logger::Level::Warning)
+						<< "Dropped media message from " << connection->information << std::endl;
+				}
+			}
+			messages.clear();
+			if (connection->hasPackets() && !connection->scheduled.exchange(true))
+			{
+				workers.schedule(connection);
+			}
+		}
+		auto missing = peer.receiver->takeMissing();
+		if (!missing.empty())
+		{
+			socket->sendTo(*MediaHeader::makeControl(MediaKind::Nack, pair.first, missing), &*peer.address);
+		}
+	}
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,105 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+PeerRegistry::PeerRegistry() : mutex(), peers(), names(), current(tem_shared<Snapshot>())
+{
+}
+PeerRegistry::~PeerRegistry()
+{
+}
+void PeerRegistry::add(shared_ptr<ServerConnection> connection)
+{
+	LOCK(mutex);
+	const uint64_t id = connection->id;
+	peers.emplace(id, Peer{std::move(connection), String()});
+}
+void PeerRegistry::remove(const uint64_t id)
+{
+	LOCK(mutex);
+	auto iter = peers.find(id);
+	if (iter == peers.end())
+	{
+		return;
+	}
+	const auto peer = std::move(iter->second);
+	peers.erase(iter);
+
+	auto name = names.find(peer.name);
+	if (name != names.end() && name->second == id)
+	{
+		names.erase(name);
+		publish();
+	}
+}
+bool PeerRegistry::login(const uint64_t id, const String &name)
+{
+	if (!reserve(id, name))
+	{
+		return false;
+	}
+	publish();
+	return true;
+}
+bool PeerRegistry::reserve(const uint64_t id, const String &name)
+{
+	LOCK(mutex);
+	auto iter = peers.find(id);
+	if (iter == peers.end() || !names.emplace(name, id).second)
+	{
+		return false;
+	}
+	iter->second.name = name;
+	return true;
+}
+void PeerRegistry::publish()
+{
+	LOCK(mutex);
+	auto snapshot = tem_shared<Snapshot>();
+	snapshot->reserve(names.size());
+	for (const auto &pair : names)
+	{
+		auto iter = peers.find(pair.second);
+		if (iter != peers.end())
+		{
+			snapshot->push_back(iter->second.connection);
+		}
+	}
+	std::atomic_store(&current, shared_ptr<const Snapshot>(std::move(snapshot)));
+}
+shared_ptr<ServerConnection> PeerRegistry::find(const uint64_t id) const
+{
+	LOCK(mutex);
+	auto iter = peers.find(id);
+	return iter == peers.end() ? nullptr : iter->second.connection;
+}
+shared_ptr<ServerConnection> PeerRegistry::find(const String &name) const
+{
+	LOCK(mutex);
+	auto iter = names.find(name);
+	return iter == names.end() ? nullptr : find(iter->second);
+}
+shared_ptr<const PeerRegistry::Snapshot> PeerRegistry::snapshot() const
+{
+	return std::atomic_load(&current);
+}
+size_t PeerRegistry::size() const
+{
+	LOCK(mutex);
+	return peers.size();
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,590 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+#if __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace TemStream
+{
+WorkerPool::WorkerPool() : connections(), threads()
+{
+}
+WorkerPool::~WorkerPool()
+{
+	join();
+}
+void WorkerPool::start(const uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		threads.emplace_back(&WorkerPool::run, this);
+	}
+}
+void WorkerPool::join()
+{
+	for (auto &thread : threads)
+	{
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+	threads.clear();
+	connections.clear();
+}
+void WorkerPool::schedule(shared_ptr<ServerConnection> connection)
+{
+	connections.push(std::move(connection));
+}
+void WorkerPool::run()
+{
+	using namespace std::chrono_literals;
+	while (!appDone)
+	{
+		auto connection = connections.pop(100ms);
+		if (!connection)
+		{
+			continue;
+		}
+		(*connection)->handlePackets();
+	}
+}
+
+Histogram Reactor::handshakes;
+
+Reactor::Reactor(WorkerPool &workers)
+	: connections(), incoming(), dirty(), mutex(), workers(workers), thread(), total(0), handshakeTimeout(5000)
+{
+}
+Reactor::~Reactor()
+{
+	join();
+}
+unique_ptr<Reactor> Reactor::create(WorkerPool &workers, const Configuration &configuration)
+{
+	const std::chrono::milliseconds handshakeTimeout(configuration.handshakeTimeout);
+#if TEMSTREAM_USE_IO_URING
+	if (configuration.useIoUring)
+	{
+		if (configuration.ssl)
+		{
+			(*logger)(Logger::Level::Warning) << "io_uring can't be used with SSL. Using epoll instead." << std::endl;
+		}
+		else
+		{
+			unique_ptr<Reactor> reactor = tem_unique<UringReactor>(workers);
+			reactor->handshakeTimeout = handshakeTimeout;
+			if (reactor->start())
+			{
+				return reactor;
+			}
+			(*logger)(Logger::Level::Warning) << "Failed to start io_uring. Using epoll instead." << std::endl;
+		}
+	}
+#endif
+	unique_ptr<Reactor> reactor = tem_unique<PollReactor>(workers);
+	reactor->handshakeTimeout = handshakeTimeout;
+	if (reactor->start())
+	{
+		return reactor;
+	}
+	return nullptr;
+}
+bool Reactor::start()
+{
+	if (!init())
+	{
+		return false;
+	}
+	++ServerConnection::runningThreads;
+	thread = std::thread(&Reactor::run, this);
+	return true;
+}
+void Reactor::join()
+{
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+void Reactor::add(shared_ptr<ServerConnection> connection)
+{
+	++total;
+	{
+		LOCK(mutex);
+		incoming.emplace_back(std::move(connection));
+	}
+	wake();
+}
+void Reactor::markDirty(const SOCKET fd)
+{
+	bool first = false;
+	{
+		LOCK(mutex);
+		first = dirty.empty();
+		dirty.insert(fd);
+	}
+	// Only the first mark needs to wake the reactor. The rest will be handled in the same pass.
+	if (first)
+	{
+		wake();
+	}
+}
+void Reactor::run()
+{
+	auto lastCheck = std::chrono::system_clock::now();
+	while (!appDone)
+	{
+		if (!wait(1000))
+		{
+			break;
+		}
+
+		addIncoming();
+		flushDirty();
+
+		using namespace std::chrono_literals;
+		const auto now = std::chrono::system_clock::now();
+		if (now - lastCheck > 1s)
+		{
+			removeStale();
+			lastCheck = now;
+		}
+	}
+
+	List<SOCKET> fds;
+	for (const auto &pair : connections)
+	{
+		fds.push_back(pair.first);
+	}
+	for (const auto fd : fds)
+	{
+		removeConnection(fd);
+	}
+	{
+		LOCK(mutex);
+		incoming.clear();
+		dirty.clear();
+	}
+	shutdown();
+	--ServerConnection::runningThreads;
+}
+void Reactor::addIncoming()
+{
+	LinkedList<shared_ptr<ServerConnection>> list;
+	{
+		LOCK(mutex);
+		list.swap(incoming);
+	}
+	for (auto &connection : list)
+	{
+		auto &socket = *connection->mSocket;
+		const SOCKET fd = socket.getFd();
+		if (!socket.setNonBlocking() || !watch(fd, connection))
+		{
+			--total;
+			connection->stayConnected = false;
+			connection->leave();
+			continue;
+		}
+		*logger << "Handling connection: " << connection->getAddress() << std::endl;
+		socket.setWakeup([this, fd]() { markDirty(fd); });
+		connections.emplace(fd, std::move(connection));
+	}
+}
+void Reactor::flushDirty()
+{
+	Set<SOCKET> set;
+	{
+		LOCK(mutex);
+		set.swap(dirty);
+	}
+	for (const auto fd : set)
+	{
+		auto iter = connections.find(fd);
+		if (iter == connections.end())
+		{
+			continue;
+		}
+		auto connection = iter->second;
+		// Messages queued before disconnecting (i.e. a rejected login) are sent if the socket takes them right away
+		const bool stayConnected = connection->stayConnected;
+		if (!flush(fd, connection) || !stayConnected)
+		{
+			removeConnection(fd);
+		}
+	}
+}
+void Reactor::removeStale()
+{
+	using namespace std::chrono_literals;
+	const auto now = std::chrono::system_clock::now();
+	List<SOCKET> stale;
+	for (const auto &[fd, connection] : connections)
+	{
+		if (!connection->stayConnected)
+		{
+			stale.push_back(fd);
+		}
+		else if ((*connection)->isHandshaking() && now - connection->startingTime > handshakeTimeout)
+		{
+			(*logger)(Logger::Level::Warning) << "Client " << connection->getAddress()
+											  << " failed to finish the handshake in time" << std::endl;
+			stale.push_back(fd);
+		}
+		else if (!connection->isAuthenticated() && now - connection->startingTime > 10s)
+		{
+			(*logger)(Logger::Level::Warning) << "Client failed to authenticate within 10 seconds" << std::endl;
+			stale.push_back(fd);
+		}
+	}
+	for (const auto fd : stale)
+	{
+		removeConnection(fd);
+	}
+}
+bool Reactor::received(const shared_ptr<ServerConnection> &connection)
+{
+	if (connection->hasPackets() && !connection->scheduled.exchange(true))
+	{
+		workers.schedule(connection);
+	}
+	return connection->stayConnected;
+}
+void Reactor::handshakeFinished(const ServerConnection &connection)
+{
+	const auto duration = std::chrono::system_clock::now() - connection.startingTime;
+	handshakes.add(std::chrono::duration_cast<std::chrono::microseconds>(duration));
+}
+const Histogram &Reactor::getHandshakeDurations()
+{
+	return handshakes;
+}
+void Reactor::removeConnection(const SOCKET fd)
+{
+	auto iter = connections.find(fd);
+	if (iter == connections.end())
+	{
+		return;
+	}
+	auto connection = std::move(iter->second);
+	connections.erase(iter);
+	--total;
+
+	(*connection)->setWakeup(nullptr);
+	connection->stayConnected = false;
+	connection->leave();
+	*logger << "Ending connection: " << connection->getAddress() << std::endl;
+
+	const auto drops = (*connection)->getDropCounters();
+	if (drops.total() > 0)
+	{
+		(*logger)(Logger::Level::Warning) << "Dropped messages for " << connection->getAddress() << ": " << drops
+										  << std::endl;
+	}
+	unwatch(fd, std::move(connection));
+}
+
+PollReactor::PollReactor(WorkerPool &workers)
+	: Reactor(workers),
+#if __linux__
+	  epollFd(-1), eventFd(-1),
+#else
+	  interests(),
+#endif
+	  events(), waitingToWrite(), handshaking()
+{
+}
+PollReactor::~PollReactor()
+{
+	join();
+#if __linux__
+	if (eventFd >= 0)
+	{
+		::close(eventFd);
+	}
+	if (epollFd >= 0)
+	{
+		::close(epollFd);
+	}
+#endif
+}
+bool PollReactor::init()
+{
+#if __linux__
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd < 0)
+	{
+		perror("epoll_create1");
+		return false;
+	}
+	eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eventFd < 0)
+	{
+		perror("eventfd");
+		return false;
+	}
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = eventFd;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event) < 0)
+	{
+		perror("epoll_ctl");
+		return false;
+	}
+#endif
+	return true;
+}
+void PollReactor::wake()
+{
+#if __linux__
+	const uint64_t value = 1;
+	if (::write(eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		perror("write");
+	}
+#endif
+}
+bool PollReactor::watch(const SOCKET fd, const shared_ptr<ServerConnection> &connection)
+{
+#if __linux__
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		perror("epoll_ctl");
+		return false;
+	}
+#else
+	interests[fd] = static_cast<short>(POLLIN);
+#endif
+	// The first flight of the handshake comes from the client so wait for the socket to be readable
+	if ((*connection)->isHandshaking())
+	{
+		handshaking.insert(fd);
+	}
+	return true;
+}
+void PollReactor::unwatch(const SOCKET fd, shared_ptr<ServerConnection> &&)
+{
+	waitingToWrite.erase(fd);
+	handshaking.erase(fd);
+#if __linux__
+	struct epoll_event event;
+	event.events = 0;
+	event.data.fd = fd;
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, &event);
+#else
+	interests.erase(fd);
+#endif
+}
+void PollReactor::setWriteInterest(const SOCKET fd, const bool write)
+{
+#if __linux__
+	struct epoll_event event;
+	event.events = write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) < 0)
+	{
+		perror("epoll_ctl");
+	}
+#else
+	interests[fd] = static_cast<short>(write ? (POLLIN | POLLOUT) : POLLIN);
+#endif
+}
+bool PollReactor::getEvents(const int timeout)
+{
+	events.clear();
+#if __linux__
+	std::array<struct epoll_event, 128> ready;
+	const int count = epoll_wait(epollFd, ready.data(), static_cast<int>(ready.size()), timeout);
+	if (count < 0)
+	{
+		if (errno == EINTR)
+		{
+			return true;
+		}
+		perror("epoll_wait");
+		return false;
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		const auto &e = ready[i];
+		if (e.data.fd == eventFd)
+		{
+			uint64_t value;
+			while (::read(eventFd, &value, sizeof(value)) > 0)
+			{
+			}
+			continue;
+		}
+		// Errors and hang ups are found when reading from the socket
+		const bool readable = (e.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+		events.push_back(Event{e.data.fd, readable, (e.events & EPOLLOUT) != 0});
+	}
+#else
+	// There is no wakeup descriptor for poll so keep the timeout small to pick up new output quickly
+	(void)timeout;
+	List<struct pollfd> fds;
+	fds.reserve(interests.size());
+	for (const auto &[fd, interest] : interests)
+	{
+		struct pollfd p;
+		p.fd = fd;
+		p.events = interest;
+		p.revents = 0;
+		fds.push_back(p);
+	}
+	if (fds.empty())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return true;
+	}
+	const int count = poll(fds.data(), static_cast<uint32_t>(fds.size()), 10);
+	if (count < 0)
+	{
+		perror("poll");
+		return false;
+	}
+	for (const auto &p : fds)
+	{
+		if (p.revents != 0)
+		{
+			const bool readable = (p.revents & (POLLIN | POLLERR | POLLHUP)) != 0;
+			events.push_back(Event{p.fd, readable, (p.revents & POLLOUT) != 0});
+		}
+	}
+#endif
+	return true;
+}
+bool PollReactor::wait(const int timeout)
+{
+	if (!getEvents(timeout))
+	{
+		return false;
+	}
+	for (const auto &event : events)
+	{
+		auto iter = connections.find(event.fd);
+		if (iter == connections.end())
+		{
+			continue;
+		}
+		auto connection = iter->second;
+		try
+		{
+			if (handshaking.find(event.fd) != handshaking.end())
+			{
+				if (!handshake(event.fd, connection))
+				{
+					removeConnection(event.fd);
+				}
+				continue;
+			}
+			if (event.readable && !handleRead(connection))
+			{
+				removeConnection(event.fd);
+				continue;
+			}
+			if (event.writable && !flush(event.fd, connection))
+			{
+				removeConnection(event.fd);
+			}
+		}
+		catch (const std::bad_alloc &)
+		{
+			(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
+			removeConnection(event.fd);
+		}
+		catch (const std::exception &e)
+		{
+			(*logger)(Logger::Level::Error) << "Exception occurred: " << e.what() << std::endl;
+			removeConnection(event.fd);
+		}
+	}
+	return true;
+}
+bool PollReactor::handleRead(const shared_ptr<ServerConnection> &connection)
+{
+	do
+	{
+		if (!connection->readAndHandle(0))
+		{
+			return false;
+		}
+	} while ((*connection)->hasBufferedData());
+	return received(connection);
+}
+bool PollReactor::handshake(const SOCKET fd, const shared_ptr<ServerConnection> &connection)
+{
+	switch ((*connection)->handshake())
+	{
+	case HandshakeState::Done:
+		handshaking.erase(fd);
+		handshakeFinished(*connection);
+		// Send anything that was queued during the handshake. This also stops waiting for the socket to be writable.
+		if (!flush(fd, connection))
+		{
+			return false;
+		}
+		// The client may have sent data with the end of its handshake
+		return !(*connection)->hasBufferedData() || handleRead(connection);
+	case HandshakeState::WantRead:
+		if (waitingToWrite.erase(fd) > 0)
+		{
+			setWriteInterest(fd, false);
+		}
+		return true;
+	case HandshakeState::WantWrite:
+		if (waitingToWrite.insert(fd).second)
+		{
+			setWriteInterest(fd, true);
+		}
+		return true;
+	default:
+		(*logger)(Logger::Level::Warning) << "Handshake failed: " << connection->getAddress() << std::endl;
+		return false;
+	}
+}
+bool PollReactor::flush(const SOCKET fd, const shared_ptr<ServerConnection> &connection)
+{
+	// Outgoing data waits until the handshake is done
+	if (handshaking.find(fd) != handshaking.end())
+	{
+		return true;
+	}
+	switch ((*connection)->flushSome())
+	{
+	case FlushState::Done:
+		if (waitingToWrite.erase(fd) > 0)
+		{
+			setWriteInterest(fd, false);
+		}
+		return true;
+	case FlushState::Blocked:
+		if (waitingToWrite.insert(fd).second)
+		{
+			setWriteInterest(fd, true);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,1008 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+namespace
+{
+// Packets copied from a text replay file per write
+constexpr size_t ImportBatchSize = 1024;
+
+void writeLittleEndian(uint8_t *data, const uint64_t value, const size_t bytes)
+{
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		data[i] = static_cast<uint8_t>(value >> (i * 8u));
+	}
+}
+uint64_t readLittleEndian(const uint8_t *data, const size_t bytes)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		value |= static_cast<uint64_t>(data[i]) << (i * 8u);
+	}
+	return value;
+}
+template <size_t N> bool readBytes(std::ifstream &file, std::array<uint8_t, N> &bytes)
+{
+	return static_cast<bool>(file.read(reinterpret_cast<char *>(bytes.data()), bytes.size()));
+}
+template <size_t N> void writeBytes(std::ofstream &file, const std::array<uint8_t, N> &bytes)
+{
+	file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+bool writeBytes(FILE *file, const uint8_t *data, const size_t size)
+{
+	return size == 0 || (fwrite(data, 1, size, file) == size && fflush(file) == 0);
+}
+bool syncFile(FILE *file)
+{
+#if WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+std::array<uint8_t, ReplayLog::IndexEntrySize> makeIndexEntry(const ReplayLog::IndexEntry &entry)
+{
+	std::array<uint8_t, ReplayLog::IndexEntrySize> bytes;
+	writeLittleEndian(bytes.data(), static_cast<uint64_t>(entry.timestamp), sizeof(int64_t));
+	writeLittleEndian(bytes.data() + sizeof(int64_t), entry.offset, sizeof(uint64_t));
+	return bytes;
+}
+String getIndexPath(const String &path)
+{
+	return String(fs::path(path.c_str()).replace_extension(".tsi").string().c_str());
+}
+String getCompactedPath(const String &path)
+{
+	return String(fs::path(path.c_str()).replace_extension(".compact.tsl").string().c_str());
+}
+std::array<uint8_t, ReplayLog::SegmentHeaderSize> makeSegmentHeader(const uint16_t flags)
+{
+	std::array<uint8_t, ReplayLog::SegmentHeaderSize> header;
+	memcpy(header.data(), ReplayLog::Magic.data(), ReplayLog::Magic.size());
+	writeLittleEndian(header.data() + ReplayLog::Magic.size(), ReplayLog::Version, sizeof(uint16_t));
+	writeLittleEndian(header.data() + ReplayLog::Magic.size() + sizeof(uint16_t), flags, sizeof(uint16_t));
+	return header;
+}
+bool readBody(std::ifstream &file, const uint32_t size, ByteList &bytes)
+{
+	std::array<char, KB(64)> chunk;
+	bytes.reallocate(size);
+	for (uint32_t left = size; left > 0;)
+	{
+		const uint32_t n = std::min(left, static_cast<uint32_t>(chunk.size()));
+		if (!file.read(chunk.data(), n))
+		{
+			return false;
+		}
+		bytes.append(reinterpret_cast<const uint8_t *>(chunk.data()), n);
+		left -= n;
+	}
+	return true;
+}
+/**
+ * Decides which packets of one second are kept when a segment is compacted
+ */
+void compactSecond(List<ByteList> &packets, const ServerType type)
+{
+	switch (type)
+	{
+	case ServerType::Video:
+		// Frames after a keyframe can't be decoded without the frames before them
+		packets.erase(std::remove_if(packets.begin(), packets.end(),
+									 [](const ByteList &bytes) {
+										 auto summary = Message::summarize(bytes.data(), bytes.size());
+										 return summary.has_value() && !summary->keyframe;
+									 }),
+					  packets.end());
+		break;
+	case ServerType::Chat:
+		if (packets.size() > ReplayLog::CompactedChatPerSecond)
+		{
+			packets.resize(ReplayLog::CompactedChatPerSecond);
+		}
+		break;
+	case ServerType::Text:
+	case ServerType::Link:
+		// Every packet has the whole text or list of links
+		if (packets.size() > 1)
+		{
+			packets.erase(packets.begin(), packets.end() - 1);
+		}
+		break;
+	default:
+		break;
+	}
+}
+bool canCompact(const ServerType type)
+{
+	switch (type)
+	{
+	case ServerType::Video:
+	case ServerType::Chat:
+	case ServerType::Text:
+	case ServerType::Link:
+		return true;
+	default:
+		return false;
+	}
+}
+} // namespace
+RecordedPacket::RecordedPacket(const Message::Packet &packet) : RecordedPacket(Socket::serialize(packet))
+{
+}
+RecordedPacket::RecordedPacket(const SharedBytes &bytes, const SharedBytes &source)
+	: bytes(bytes), source(source), timestamp(static_cast<int64_t>(time(nullptr)))
+{
+}
+RecordedPacket::~RecordedPacket()
+{
+}
+std::optional<int64_t> RecordedPacket::getTimestamp(const String &s, std::string::size_type &pos)
+{
+	pos = s.find(":");
+	if (pos == std::string::npos)
+	{
+		return std::nullopt;
+	}
+
+	const String t(s.begin(), s.begin() + pos);
+	return static_cast<int64_t>(strtoll(t.c_str(), nullptr, 10));
+}
+std::ostream &operator<<(std::ostream &os, const SyncMode mode)
+{
+	switch (mode)
+	{
+	case SyncMode::Never:
+		os << "Never";
+		break;
+	case SyncMode::Interval:
+		os << "Interval";
+		break;
+	case SyncMode::Bytes:
+		os << "Bytes";
+		break;
+	default:
+		os << "Unknown";
+		break;
+	}
+	return os;
+}
+ReplayLog::ReplayLog(const String &directory)
+	: mutex(), directory(directory), segments(),
+	  limits{DefaultSegmentSize, DefaultSegmentDuration, 0, 0, 0, ServerType::UnknownServerType}, writeMutex(),
+	  writing(), data(nullptr), index(nullptr), lastSync(std::chrono::system_clock::now()), unsynced(0),
+	  syncEvery(1000), syncMode(SyncMode::Interval)
+{
+}
+ReplayLog::~ReplayLog()
+{
+	close();
+}
+bool ReplayLog::open()
+{
+	std::lock_guard<Mutex> writeLock(writeMutex);
+	LOCK(mutex);
+	segments.clear();
+	const fs::path dir(directory.c_str());
+	std::error_code error;
+	if (!fs::is_directory(dir, error))
+	{
+		return true;
+	}
+
+	List<std::pair<uint32_t, String>> files;
+	for (const auto &entry : fs::directory_iterator(dir, error))
+	{
+		const auto &path = entry.path();
+		if (path.extension() != ".tsl")
+		{
+			continue;
+		}
+		const auto number = strtoul(path.stem().string().c_str(), nullptr, 10);
+		if (number == 0 || number > UINT32_MAX)
+		{
+			continue;
+		}
+		files.emplace_back(static_cast<uint32_t>(number), String(path.string().c_str()));
+	}
+	std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+	for (const auto &pair : files)
+	{
+		auto segment = load(pair.second);
+		if (!segment.has_value())
+		{
+			(*logger)(Logger::Level::Warning) << "Skipping invalid replay segment: " << pair.second << std::endl;
+			continue;
+		}
+		segment->number = pair.first;
+		if (!segments.empty() && segments.back().number == segment->number)
+		{
+			// The server stopped before the original of a compacted segment was deleted
+			auto &previous = segments.back();
+			const bool compacted = (segment->flags & Compacted) != 0;
+			remove(compacted ? previous.path : segment->path);
+			if (compacted)
+			{
+				previous = std::move(*segment);
+			}
+			continue;
+		}
+		segments.emplace_back(std::move(*segment));
+	}
+	return true;
+}
+std::optional<ReplayLog::Segment> ReplayLog::load(const String &path)
+{
+	std::error_code error;
+	const uint64_t fileSize = fs::file_size(fs::path(path.c_str()), error);
+	if (error || fileSize < SegmentHeaderSize)
+	{
+		return std::nullopt;
+	}
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::in);
+	std::array<uint8_t, SegmentHeaderSize> header;
+	if (!file.is_open() || !readBytes(file, header) || memcmp(header.data(), Magic.data(), Magic.size()) != 0 ||
+		readLittleEndian(header.data() + Magic.size(), sizeof(uint16_t)) != Version)
+	{
+		return std::nullopt;
+	}
+
+	const auto flags = static_cast<uint16_t>(readLittleEndian(header.data() + Magic.size() + sizeof(uint16_t), 2));
+	Segment segment{path, {}, 0, 0, 0, SegmentHeaderSize, flags};
+	const String indexPath = getIndexPath(path);
+	{
+		std::ifstream indexFile(indexPath.c_str(), std::ios::binary | std::ios::in);
+		std::array<uint8_t, IndexEntrySize> bytes;
+		while (indexFile.is_open() && readBytes(indexFile, bytes))
+		{
+			IndexEntry entry;
+			entry.timestamp = static_cast<int64_t>(readLittleEndian(bytes.data(), sizeof(int64_t)));
+			entry.offset = readLittleEndian(bytes.data() + sizeof(int64_t), sizeof(uint64_t));
+			// Entries are only kept while they point to records in order
+			if (entry.offset < SegmentHeaderSize || entry.offset + RecordHeaderSize > fileSize ||
+				(!segment.index.empty() && (entry.timestamp <= segment.index.back().timestamp ||
+											entry.offset <= segment.index.back().offset)))
+			{
+				break;
+			}
+			segment.index.push_back(entry);
+		}
+	}
+
+	// Index the records that were written after the last index entry
+	bool changed = false;
+	uint64_t offset = segment.index.empty() ? SegmentHeaderSize : segment.index.back().offset;
+	std::array<uint8_t, RecordHeaderSize> record;
+	while (offset + RecordHeaderSize <= fileSize)
+	{
+		if (!file.seekg(static_cast<std::streamoff>(offset)) || !readBytes(file, record))
+		{
+			break;
+		}
+		const auto timestamp = static_cast<int64_t>(readLittleEndian(record.data(), sizeof(int64_t)));
+		const auto size = readLittleEndian(record.data() + sizeof(int64_t), sizeof(uint32_t));
+		if (offset + RecordHeaderSize + size > fileSize)
+		{
+			break;
+		}
+		if (segment.index.empty() || timestamp > segment.last)
+		{
+			if (segment.index.empty() || segment.index.back().offset != offset)
+			{
+				segment.index.push_back(IndexEntry{timestamp, offset});
+				changed = true;
+			}
+		}
+		else if (timestamp < segment.last)
+		{
+			break;
+		}
+		segment.last = timestamp;
+		offset += RecordHeaderSize + size;
+	}
+	file.close();
+	segment.size = offset;
+	if (!segment.index.empty())
+	{
+		segment.first = segment.index.front().timestamp;
+	}
+
+	if (offset < fileSize)
+	{
+		(*logger)(Logger::Level::Warning) << "Removing " << (fileSize - offset)
+										  << " bytes from the end of replay segment: " << path << std::endl;
+		fs::resize_file(fs::path(path.c_str()), offset, error);
+		if (error)
+		{
+			return std::nullopt;
+		}
+	}
+	if (changed)
+	{
+		std::ofstream indexFile(indexPath.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+		for (const auto &entry : segment.index)
+		{
+			writeBytes(indexFile, makeIndexEntry(entry));
+		}
+	}
+	return segment;
+}
+bool ReplayLog::startSegment(const int64_t timestamp)
+{
+	// The finished segment won't be written again
+	closeWriter(syncMode != SyncMode::Never);
+
+	const fs::path dir(directory.c_str());
+	std::error_code error;
+	fs::create_directories(dir, error);
+	if (error)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to create replay directory " << directory << ": "
+										<< error.message() << std::endl;
+		return false;
+	}
+
+	uint32_t number;
+	{
+		LOCK(mutex);
+		number = segments.empty() ? 1 : segments.back().number + 1;
+	}
+	std::array<char, 32> name;
+	snprintf(name.data(), name.size(), "%010u.tsl", number);
+	const String path((dir / name.data()).string().c_str());
+	data = fopen(path.c_str(), "wb");
+	index = fopen(getIndexPath(path).c_str(), "wb");
+	if (data == nullptr || index == nullptr)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to create replay segment: " << path << std::endl;
+		closeWriter(false);
+		return false;
+	}
+
+	const auto header = makeSegmentHeader(0);
+	if (!writeBytes(data, header.data(), header.size()))
+	{
+		(*logger)(Logger::Level::Error) << "Failed to write to replay segment: " << path << std::endl;
+		closeWriter(false);
+		return false;
+	}
+	writing = path;
+
+	LOCK(mutex);
+	segments.push_back(Segment{path, {}, number, timestamp, timestamp, SegmentHeaderSize, 0});
+	return true;
+}
+bool ReplayLog::openWriter()
+{
+	{
+		LOCK(mutex);
+		writing = segments.back().path;
+	}
+	data = fopen(writing.c_str(), "ab");
+	index = fopen(getIndexPath(writing).c_str(), "ab");
+	if (data == nullptr || index == nullptr)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to open replay segment: " << writing << std::endl;
+		closeWriter(false);
+		return false;
+	}
+	return true;
+}
+void ReplayLog::closeWriter(const bool sync)
+{
+	if (sync && unsynced > 0)
+	{
+		syncFiles();
+	}
+	if (data != nullptr)
+	{
+		fclose(data);
+		data = nullptr;
+	}
+	if (index != nullptr)
+	{
+		fclose(index);
+		index = nullptr;
+	}
+}
+bool ReplayLog::commit(Pending &pending)
+{
+	if (pending.data.empty())
+	{
+		return true;
+	}
+
+	// Index first. Entries past the end of the segment are ignored when it is loaded.
+	if (!writeBytes(index, pending.index.data(), pending.index.size()) ||
+		!writeBytes(data, pending.data.data(), pending.data.size()))
+	{
+		(*logger)(Logger::Level::Error) << "Failed to write to replay segment: " << writing << std::endl;
+		// Reopened and repaired on the next append
+		closeWriter(false);
+		auto repaired = load(writing);
+		pending = Pending{};
+		if (repaired.has_value())
+		{
+			LOCK(mutex);
+			auto &segment = segments.back();
+			repaired->number = segment.number;
+			segment = std::move(*repaired);
+		}
+		return false;
+	}
+	unsynced += pending.data.size() + pending.index.size();
+
+	// Only the writer changes the last segment. Readers see the records once its size is updated.
+	LOCK(mutex);
+	auto &segment = segments.back();
+	if (!pending.entries.empty())
+	{
+		if (segment.index.empty())
+		{
+			segment.first = pending.entries.front().timestamp;
+		}
+		segment.index.insert(segment.index.end(), pending.entries.begin(), pending.entries.end());
+	}
+	segment.last = pending.last;
+	segment.size += pending.data.size();
+	pending = Pending{};
+	return true;
+}
+bool ReplayLog::getLast(uint64_t &size, int64_t &first, bool &indexed) const
+{
+	LOCK(mutex);
+	if (segments.empty())
+	{
+		return false;
+	}
+	const auto &segment = segments.back();
+	size = segment.size;
+	first = segment.first;
+	indexed = !segment.index.empty();
+	return true;
+}
+bool ReplayLog::append(const List<RecordedPacket> &packets)
+{
+	LOCK(writeMutex);
+	if (packets.empty())
+	{
+		return true;
+	}
+
+	int64_t latest;
+	ReplayLimits l;
+	{
+		LOCK(mutex);
+		auto last =
+			std::find_if(segments.rbegin(), segments.rend(), [](const Segment &s) { return !s.index.empty(); });
+		latest = last == segments.rend() ? INT64_MIN : last->last;
+		l = limits;
+	}
+	uint64_t segmentSize = 0;
+	int64_t first = 0;
+	bool indexed = false;
+	bool hasSegment = getLast(segmentSize, first, indexed);
+
+	Pending pending{};
+	std::array<uint8_t, RecordHeaderSize> header;
+	for (const auto &packet : packets)
+	{
+		const int64_t timestamp = std::max(packet.timestamp, latest);
+		bool full = !hasSegment;
+		if (!full)
+		{
+			const uint64_t size = segmentSize + pending.data.size();
+			full = (l.segmentSize != 0 && size >= l.segmentSize) ||
+				   (l.segmentDuration != 0 && size > SegmentHeaderSize &&
+					timestamp - first >= static_cast<int64_t>(l.segmentDuration));
+		}
+		if (full)
+		{
+			if (!commit(pending) || !startSegment(timestamp))
+			{
+				return false;
+			}
+			hasSegment = getLast(segmentSize, first, indexed);
+		}
+		else if (data == nullptr && !openWriter())
+		{
+			return false;
+		}
+		else if (pending.data.size() >= MaxWriteSize)
+		{
+			if (!commit(pending))
+			{
+				return false;
+			}
+			hasSegment = getLast(segmentSize, first, indexed);
+		}
+
+		const uint64_t offset = segmentSize + pending.data.size();
+		if ((!indexed && pending.entries.empty()) || timestamp != latest)
+		{
+			const IndexEntry entry{timestamp, offset};
+			const auto bytes = makeIndexEntry(entry);
+			pending.index.append(bytes.data(), static_cast<uint32_t>(bytes.size()));
+			pending.entries.push_back(entry);
+		}
+
+		const uint32_t size = packet.bytes->size() + (packet.source == nullptr ? 0 : packet.source->size());
+		writeLittleEndian(header.data(), static_cast<uint64_t>(timestamp), sizeof(int64_t));
+		writeLittleEndian(header.data() + sizeof(int64_t), size, sizeof(uint32_t));
+		pending.data.append(header.data(), static_cast<uint32_t>(header.size()));
+		pending.data.append(*packet.bytes);
+		if (packet.source != nullptr)
+		{
+			pending.data.append(*packet.source);
+		}
+		pending.last = timestamp;
+		latest = timestamp;
+	}
+	return commit(pending);
+}
+void ReplayLog::setSync(const SyncMode mode, const uint32_t every)
+{
+	LOCK(writeMutex);
+	syncMode = mode;
+	syncEvery = every;
+}
+void ReplayLog::setLimits(const ReplayLimits &l)
+{
+	LOCK(mutex);
+	limits = l;
+}
+void ReplayLog::remove(const String &path)
+{
+	std::error_code error;
+	fs::remove(fs::path(path.c_str()), error);
+	fs::remove(fs::path(getIndexPath(path).c_str()), error);
+}
+size_t ReplayLog::enforceRetention(const int64_t now)
+{
+	List<Segment> removed;
+	{
+		LOCK(mutex);
+		uint64_t total = 0;
+		for (const auto &segment : segments)
+		{
+			total += segment.size;
+		}
+		// The last segment is still being appended to
+		auto end = segments.begin();
+		for (; end + 1 < segments.end(); ++end)
+		{
+			const bool tooLarge = limits.maxBytes != 0 && total > limits.maxBytes;
+			const bool tooOld = limits.maxAge != 0 && end->last < now - static_cast<int64_t>(limits.maxAge);
+			if (!tooLarge && !tooOld)
+			{
+				break;
+			}
+			total -= end->size;
+		}
+		removed.assign(std::make_move_iterator(segments.begin()), std::make_move_iterator(end));
+		segments.erase(segments.begin(), end);
+	}
+	for (const auto &segment : removed)
+	{
+		(*logger)(Logger::Level::Trace) << "Deleting replay segment: " << segment.path << std::endl;
+		remove(segment.path);
+	}
+	return removed.size();
+}
+std::optional<ReplayLog::Segment> ReplayLog::compact(const Segment &segment, const ServerType type, const bool sync)
+{
+	std::ifstream file(segment.path.c_str(), std::ios::binary | std::ios::in);
+	if (!file.is_open() || !file.seekg(SegmentHeaderSize))
+	{
+		return std::nullopt;
+	}
+
+	const String path = getCompactedPath(segment.path);
+	FILE *output = fopen(path.c_str(), "wb");
+	FILE *outputIndex = fopen(getIndexPath(path).c_str(), "wb");
+	const auto finish = [&output, &outputIndex, &path](const bool success) {
+		if (output != nullptr)
+		{
+			fclose(output);
+		}
+		if (outputIndex != nullptr)
+		{
+			fclose(outputIndex);
+		}
+		if (!success)
+		{
+			(*logger)(Logger::Level::Error) << "Failed to compact replay segment: " << path << std::endl;
+			remove(path);
+		}
+		return success;
+	};
+	const auto header = makeSegmentHeader(segment.flags | Compacted);
+	if (output == nullptr || outputIndex == nullptr || !writeBytes(output, header.data(), header.size()))
+	{
+		finish(false);
+		return std::nullopt;
+	}
+
+	// Packets are kept or dropped one second at a time
+	ByteList buffer;
+	ByteList indexBuffer;
+	List<ByteList> packets;
+	int64_t second = 0;
+	uint64_t offset = SegmentHeaderSize;
+	std::array<uint8_t, RecordHeaderSize> recordHeader;
+	const auto flushSecond = [&]() {
+		compactSecond(packets, type);
+		if (!packets.empty())
+		{
+			const auto entry = makeIndexEntry(IndexEntry{second, offset});
+			indexBuffer.append(entry.data(), static_cast<uint32_t>(entry.size()));
+		}
+		for (const auto &packet : packets)
+		{
+			writeLittleEndian(recordHeader.data(), static_cast<uint64_t>(second), sizeof(int64_t));
+			writeLittleEndian(recordHeader.data() + sizeof(int64_t), packet.size(), sizeof(uint32_t));
+			buffer.append(recordHeader.data(), static_cast<uint32_t>(recordHeader.size()));
+			buffer.append(packet);
+			offset += RecordHeaderSize + packet.size();
+		}
+		packets.clear();
+		if (buffer.size() < MaxWriteSize)
+		{
+			return true;
+		}
+		const bool written = writeBytes(output, buffer.data(), buffer.size());
+		buffer.clear();
+		return written;
+	};
+
+	for (uint64_t position = SegmentHeaderSize; position + RecordHeaderSize <= segment.size;)
+	{
+		if (!readBytes(file, recordHeader))
+		{
+			finish(false);
+			return std::nullopt;
+		}
+		const auto timestamp = static_cast<int64_t>(readLittleEndian(recordHeader.data(), sizeof(int64_t)));
+		const auto size =
+			static_cast<uint32_t>(readLittleEndian(recordHeader.data() + sizeof(int64_t), sizeof(uint32_t)));
+		if (timestamp != second && !packets.empty() && !flushSecond())
+		{
+			finish(false);
+			return std::nullopt;
+		}
+		second = timestamp;
+		packets.emplace_back();
+		if (!readBody(file, size, packets.back()))
+		{
+			finish(false);
+			return std::nullopt;
+		}
+		position += RecordHeaderSize + size;
+	}
+	if (!flushSecond() || !writeBytes(output, buffer.data(), buffer.size()) ||
+		!writeBytes(outputIndex, indexBuffer.data(), indexBuffer.size()) ||
+		(sync && (!syncFile(outputIndex) || !syncFile(output))))
+	{
+		finish(false);
+		return std::nullopt;
+	}
+	finish(true);
+
+	auto compacted = load(path);
+	if (compacted.has_value())
+	{
+		compacted->number = segment.number;
+	}
+	return compacted;
+}
+bool ReplayLog::compact(const int64_t now)
+{
+	std::optional<Segment> segment;
+	ServerType type;
+	bool sync;
+	{
+		LOCK(mutex);
+		type = limits.serverType;
+		sync = syncMode != SyncMode::Never;
+		if (limits.compactAge == 0 || !canCompact(type))
+		{
+			return false;
+		}
+		// The last segment is still being appended to
+		for (auto iter = segments.begin(); iter + 1 < segments.end(); ++iter)
+		{
+			if ((iter->flags & Compacted) == 0 && iter->last < now - static_cast<int64_t>(limits.compactAge))
+			{
+				segment = *iter;
+				break;
+			}
+		}
+	}
+	if (!segment.has_value())
+	{
+		return false;
+	}
+
+	auto compacted = compact(*segment, type, sync);
+	if (!compacted.has_value())
+	{
+		return false;
+	}
+	{
+		LOCK(mutex);
+		auto iter = std::find_if(segments.begin(), segments.end(),
+								 [&segment](const Segment &s) { return s.number == segment->number; });
+		if (iter == segments.end())
+		{
+			// Deleted while it was compacted
+			remove(compacted->path);
+			return false;
+		}
+		*logger << "Compacted replay segment " << segment->path << " from " << segment->size << " to "
+				<< compacted->size << " bytes" << std::endl;
+		*iter = std::move(*compacted);
+	}
+	// Readers that already opened the original can finish reading it
+	remove(segment->path);
+	return true;
+}
+bool ReplayLog::syncFiles()
+{
+	const bool synced = syncFile(index) && syncFile(data);
+	if (!synced)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to sync replay segment: " << writing << std::endl;
+	}
+	unsynced = 0;
+	lastSync = std::chrono::system_clock::now();
+	return synced;
+}
+bool ReplayLog::sync()
+{
+	LOCK(writeMutex);
+	if (data == nullptr || unsynced == 0)
+	{
+		return true;
+	}
+	switch (syncMode)
+	{
+	case SyncMode::Interval:
+		if (std::chrono::system_clock::now() - lastSync < std::chrono::milliseconds(syncEvery))
+		{
+			return true;
+		}
+		break;
+	case SyncMode::Bytes:
+		if (unsynced < syncEvery)
+		{
+			return true;
+		}
+		break;
+	default:
+		return true;
+	}
+	return syncFiles();
+}
+void ReplayLog::close()
+{
+	LOCK(writeMutex);
+	closeWriter(syncMode != SyncMode::Never);
+}
+size_t ReplayLog::importText(const String &filename)
+{
+	std::ifstream file(filename.c_str());
+	if (!file.is_open())
+	{
+		return 0;
+	}
+
+	size_t count = 0;
+	List<RecordedPacket> batch;
+	String line;
+	std::string::size_type pos;
+	while (std::getline(file, line))
+	{
+		const auto timestamp = RecordedPacket::getTimestamp(line, pos);
+		if (!timestamp.has_value())
+		{
+			continue;
+		}
+		batch.emplace_back(tem_shared<ByteList>(base64_decode(String(line.begin() + pos + 1, line.end()))));
+		batch.back().timestamp = *timestamp;
+		if (batch.size() < ImportBatchSize)
+		{
+			continue;
+		}
+		if (!append(batch))
+		{
+			return count;
+		}
+		count += batch.size();
+		batch.clear();
+	}
+	file.close();
+	if (!append(batch))
+	{
+		return count;
+	}
+	count += batch.size();
+
+	std::error_code error;
+	fs::rename(fs::path(filename.c_str()), fs::path((filename + ".imported").c_str()), error);
+	*logger << "Copied " << count << " packets from " << filename << " to " << directory << std::endl;
+	return count;
+}
+std::optional<std::pair<size_t, uint64_t>> ReplayLog::find(const int64_t timestamp) const
+{
+	// Only the last segment can be empty
+	auto end = segments.end();
+	if (!segments.empty() && segments.back().index.empty())
+	{
+		--end;
+	}
+	auto segment = std::lower_bound(segments.begin(), end, timestamp,
+									[](const Segment &s, const int64_t t) { return s.last < t; });
+	if (segment == end)
+	{
+		return std::nullopt;
+	}
+	auto entry = std::lower_bound(segment->index.begin(), segment->index.end(), timestamp,
+								  [](const IndexEntry &e, const int64_t t) { return e.timestamp < t; });
+	if (entry == segment->index.end())
+	{
+		return std::nullopt;
+	}
+	return std::make_pair(static_cast<size_t>(std::distance(segments.begin(), segment)), entry->offset);
+}
+std::optional<Message::TimeRange> ReplayLog::getTimeRange() const
+{
+	LOCK(mutex);
+	auto first = std::find_if(segments.begin(), segments.end(), [](const Segment &s) { return !s.index.empty(); });
+	auto last = std::find_if(segments.rbegin(), segments.rend(), [](const Segment &s) { return !s.index.empty(); });
+	if (first == segments.end() || last == segments.rend())
+	{
+		return std::nullopt;
+	}
+	return Message::TimeRange{first->first, last->last};
+}
+size_t ReplayLog::read(const int64_t timestamp, const std::function<bool(ByteList &&)> &callback) const
+{
+	return read(timestamp, timestamp, [&callback](int64_t, ByteList &&bytes) { return callback(std::move(bytes)); });
+}
+size_t ReplayLog::read(const int64_t start, const int64_t end,
+					   const std::function<bool(int64_t, ByteList &&)> &callback) const
+{
+	struct Range
+	{
+		String path;
+		uint64_t offset;
+		uint64_t size;
+	};
+	List<Range> ranges;
+	{
+		LOCK(mutex);
+		auto found = find(start);
+		if (!found.has_value())
+		{
+			return 0;
+		}
+		uint64_t offset = found->second;
+		for (size_t i = found->first; i < segments.size() && !segments[i].index.empty(); ++i)
+		{
+			const auto &segment = segments[i];
+			if (segment.first > end)
+			{
+				break;
+			}
+			ranges.push_back(Range{segment.path, offset, segment.size});
+			offset = SegmentHeaderSize;
+		}
+	}
+
+	size_t count = 0;
+	std::array<uint8_t, RecordHeaderSize> header;
+	for (const auto &range : ranges)
+	{
+		std::ifstream file(range.path.c_str(), std::ios::binary | std::ios::in);
+		if (!file.is_open() || !file.seekg(static_cast<std::streamoff>(range.offset)))
+		{
+			(*logger)(Logger::Level::Error) << "Failed to read replay segment: " << range.path << std::endl;
+			return count;
+		}
+		uint64_t offset = range.offset;
+		while (offset + RecordHeaderSize <= range.size && readBytes(file, header))
+		{
+			const auto recorded = static_cast<int64_t>(readLittleEndian(header.data(), sizeof(int64_t)));
+			const auto size =
+				static_cast<uint32_t>(readLittleEndian(header.data() + sizeof(int64_t), sizeof(uint32_t)));
+			if (recorded > end)
+			{
+				return count;
+			}
+			ByteList bytes;
+			if (!readBody(file, size, bytes))
+			{
+				return count;
+			}
+			offset += RecordHeaderSize + size;
+			if (recorded >= start)
+			{
+				++count;
+				if (!callback(recorded, std::move(bytes)))
+				{
+					return count;
+				}
+			}
+		}
+	}
+	return count;
+}
+ReplayWindow::ReplayWindow(const uint32_t id, const uint32_t credits, const uint32_t maxCredits)
+	: mutex(), cv(), maxCredits(std::min(maxCredits, MaxCredits)),
+	  credits(std::clamp(credits, std::min(MinCredits, this->maxCredits), this->maxCredits)), id(id), cancelled(false)
+{
+}
+ReplayWindow::~ReplayWindow()
+{
+}
+bool ReplayWindow::take(const uint32_t bytes)
+{
+	using namespace std::chrono_literals;
+	std::unique_lock<Mutex> lock(mutex);
+	// Wake up now and then to check if the server is stopping
+	while (!cancelled && !appDone && credits <= 0)
+	{
+		cv.wait_for(lock, 1s);
+	}
+	if (cancelled || appDone)
+	{
+		return false;
+	}
+	credits -= bytes;
+	return true;
+}
+bool ReplayWindow::waitUntil(const TimePoint time)
+{
+	using namespace std::chrono_literals;
+	std::unique_lock<Mutex> lock(mutex);
+	while (!cancelled && !appDone && std::chrono::system_clock::now() < time)
+	{
+		cv.wait_until(lock, std::min<TimePoint>(time, std::chrono::system_clock::now() + 1s));
+	}
+	return !cancelled && !appDone;
+}
+void ReplayWindow::give(const uint32_t bytes)
+{
+	{
+		LOCK(mutex);
+		credits = std::min(credits + bytes, static_cast<int64_t>(maxCredits));
+	}
+	cv.notify_all();
+}
+void ReplayWindow::cancel()
+{
+	{
+		LOCK(mutex);
+		cancelled = true;
+	}
+	cv.notify_all();
+}
+} // namespace TemStream
\ No newline at end of file
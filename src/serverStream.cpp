@@ -0,0 +1,403 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+namespace TemStream
+{
+std::atomic<uint32_t> ServerStream::nextId = 1;
+ServerStream::ServerStream(Configuration &configuration)
+	: configuration(configuration), peers(), packetsToRecord(), replay(configuration.name + "_replay"), mutex(),
+	  origin(), sourceBytes(nullptr), image(nullptr), media(), id(nextId++)
+{
+	// Until the upstream server responds, assume that its stream is the origin
+	if (configuration.isRelay())
+	{
+		Message::Source source;
+		source.address = *configuration.upstream;
+		source.serverName = configuration.upstreamName.empty() ? configuration.name : configuration.upstreamName;
+		origin.emplace(std::move(source));
+	}
+}
+ServerStream::~ServerStream()
+{
+}
+const Configuration &ServerStream::getConfiguration() const
+{
+	return configuration;
+}
+Message::Source ServerStream::getSource() const
+{
+	LOCK(mutex);
+	return origin.has_value() ? *origin : configuration.getSource();
+}
+bool ServerStream::isSource(const Message::Source &source) const
+{
+	// Compare without building the source since this is called for every packet
+	if (source.serverName == configuration.name && source.address == configuration.address)
+	{
+		return true;
+	}
+	LOCK(mutex);
+	return origin.has_value() && *origin == source;
+}
+SharedBytes ServerStream::getSourceBytes() const
+{
+	LOCK(mutex);
+	if (sourceBytes == nullptr)
+	{
+		sourceBytes = Socket::serialize(getSource());
+	}
+	return sourceBytes;
+}
+void ServerStream::cacheImage() const
+{
+	std::array<char, KB(1)> buffer;
+	getFilename(buffer);
+	std::ifstream file(buffer.data(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		clearImage();
+		return;
+	}
+
+	auto chunks = tem_shared<ImageChunks>();
+	const bool relay = configuration.isRelay();
+	Message::Packet packet;
+	packet.source = getSource();
+	if (!relay)
+	{
+		chunks->source = getSourceBytes();
+	}
+	const uint32_t sourceSize = chunks->source == nullptr ? 0 : chunks->source->size();
+	constexpr auto type = variant_index<Message::Payload, Message::Image>();
+	// Framed the same way as ServerConnection::sendToPeers
+	const auto add = [&](Message::LargeFile &&lf) {
+		packet.payload.emplace<Message::Image>(Message::Image{std::move(lf)});
+		auto body = relay ? Socket::serialize(packet) : Socket::serialize(packet, false);
+		chunks->headers[0].emplace_back(Socket::makeHeader(body->size() + sourceSize));
+		for (const auto framing : {Framing::V2, Framing::V3})
+		{
+			chunks->headers[static_cast<size_t>(framing) - 1].emplace_back(
+				Socket::makeHeader(body->size(), framing, type, relay ? 0 : id, relay));
+		}
+		chunks->bodies.emplace_back(std::move(body));
+	};
+
+	const uint64_t size = static_cast<uint64_t>(file.tellg());
+	file.seekg(0, std::ios::beg);
+	add(size);
+	std::array<char, MAX_FILE_CHUNK> chunk;
+	while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0)
+	{
+		add(ByteList(reinterpret_cast<const uint8_t *>(chunk.data()), static_cast<uint32_t>(file.gcount())));
+	}
+	add(std::monostate{});
+
+	(*logger)(Logger::Level::Trace) << "Cached image of " << configuration.name << ": " << size / KB(1) << "KB in "
+									<< chunks->bodies.size() << " chunks" << std::endl;
+	LOCK(mutex);
+	image = std::move(chunks);
+}
+void ServerStream::clearImage() const
+{
+	LOCK(mutex);
+	image = nullptr;
+}
+shared_ptr<const ServerStream::ImageChunks> ServerStream::getImage() const
+{
+	LOCK(mutex);
+	return image;
+}
+void ServerStream::start()
+{
+	// Recordings from earlier runs can be replayed even if this run doesn't record
+	replay.setLimits(ReplayLimits{configuration.recordSegmentSize, configuration.recordSegmentDuration,
+								  configuration.recordMaxBytes, configuration.recordMaxAge,
+								  configuration.recordCompactAge, configuration.serverType});
+	replay.open();
+	replay.importText(configuration.name + "_replay.tsr");
+
+	// An image saved by an earlier run with the same start time
+	if (configuration.serverType == ServerType::Image)
+	{
+		cacheImage();
+	}
+
+	if (configuration.serverType == ServerType::Link)
+	{
+		++ServerConnection::runningThreads;
+		std::thread thread(&ServerStream::watchLinks, this);
+		thread.detach();
+	}
+
+	if (configuration.record)
+	{
+		++ServerConnection::runningThreads;
+		std::thread thread(&ServerStream::record, this);
+		thread.detach();
+	}
+
+	if (configuration.record &&
+		(configuration.recordMaxBytes != 0 || configuration.recordMaxAge != 0 || configuration.recordCompactAge != 0))
+	{
+		++ServerConnection::runningThreads;
+		std::thread thread(&ServerStream::maintainReplay, this);
+		thread.detach();
+	}
+
+	if (configuration.isRelay())
+	{
+		++ServerConnection::runningThreads;
+		std::thread thread(&ServerStream::relayUpstream, this);
+		thread.detach();
+	}
+}
+void ServerStream::watchLinks()
+{
+	String filename = ServerConnection::sendLinks(*this);
+	auto lastWrite = fs::last_write_time(filename);
+	using namespace std::chrono_literals;
+	while (!appDone)
+	{
+		const auto now = fs::last_write_time(filename);
+		if (now != lastWrite)
+		{
+			ServerConnection::sendLinks(*this);
+			lastWrite = now;
+		}
+		std::this_thread::sleep_for(1s);
+	}
+	--ServerConnection::runningThreads;
+}
+void ServerStream::record()
+{
+	using namespace std::chrono_literals;
+	replay.setSync(configuration.recordSync, configuration.recordSyncEvery);
+	// Wake up in time to sync even when nothing is being recorded
+	const auto wait = configuration.recordSync == SyncMode::Interval
+						  ? std::clamp(std::chrono::milliseconds(configuration.recordSyncEvery),
+									   std::chrono::milliseconds(1), std::chrono::milliseconds(1s))
+						  : std::chrono::milliseconds(1s);
+	List<RecordedPacket> batch;
+	while (!appDone)
+	{
+		if (auto packet = packetsToRecord.pop(wait))
+		{
+			// Write everything that was queued while waiting
+			batch.emplace_back(std::move(*packet));
+			packetsToRecord.flush([&batch](RecordedPacket &&packet) { batch.emplace_back(std::move(packet)); });
+			if (!replay.append(batch))
+			{
+				(*logger)(Logger::Level::Warning) << "Failed to save " << batch.size() << " packet(s)" << std::endl;
+			}
+			batch.clear();
+		}
+		replay.sync();
+	}
+	packetsToRecord.flush([&batch](RecordedPacket &&packet) { batch.emplace_back(std::move(packet)); });
+	replay.append(batch);
+	replay.close();
+	--ServerConnection::runningThreads;
+}
+void ServerStream::maintainReplay()
+{
+	using namespace std::chrono_literals;
+	auto last = std::chrono::system_clock::now();
+	while (!appDone)
+	{
+		std::this_thread::sleep_for(1s);
+		const auto now = std::chrono::system_clock::now();
+		if (now - last < 1min)
+		{
+			continue;
+		}
+		last = now;
+
+		const auto timestamp = static_cast<int64_t>(time(nullptr));
+		replay.enforceRetention(timestamp);
+		while (!appDone && replay.compact(timestamp))
+		{
+		}
+	}
+	--ServerConnection::runningThreads;
+}
+bool ServerStream::savePayload(const Message::Payload &payload, const bool append) const
+{
+	std::array<char, KB(1)> buffer;
+	getFilename(buffer);
+#if WIN32
+	int
+#else
+	auto
+#endif
+		flags = std::ios::out;
+	if (append)
+	{
+		flags |= std::ios::app;
+	}
+	else
+	{
+		flags |= std::ios::trunc;
+	}
+	std::ofstream file(buffer.data(), flags);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	try
+	{
+		cereal::PortableBinaryOutputArchive ar(file);
+		ar(payload);
+
+		return true;
+	}
+	catch (const std::bad_alloc &)
+	{
+		(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
+	}
+	catch (const std::exception &e)
+	{
+		(*logger)(Logger::Level::Error) << "Failed to save payload for stream " << configuration.name << ": "
+										<< e.what() << std::endl;
+	}
+	return false;
+}
+void ServerStream::relayUpstream()
+{
+	using namespace std::chrono_literals;
+	const Address &address = *configuration.upstream;
+	// Wait longer after each failed attempt so an upstream server that is down or rejects the relay isn't flooded
+	constexpr int MinRetrySeconds = 5;
+	constexpr int MaxRetrySeconds = 300;
+	int retrySeconds = MinRetrySeconds;
+	bool retry = false;
+	while (!appDone)
+	{
+		if (retry)
+		{
+			for (int i = 0; i < retrySeconds && !appDone; ++i)
+			{
+				std::this_thread::sleep_for(1s);
+			}
+			retrySeconds = std::min(retrySeconds * 2, MaxRetrySeconds);
+		}
+		retry = true;
+
+		unique_ptr<TcpSocket> s = nullptr;
+		if (configuration.upstreamSsl)
+		{
+			s = address.create<SSLSocket>();
+		}
+		else
+		{
+			s = address.create<TcpSocket>();
+		}
+		if (s == nullptr)
+		{
+			(*logger)(Logger::Level::Error) << "Failed to connect to upstream server: " << address << std::endl;
+			continue;
+		}
+
+		*logger << "Connected to upstream server: " << address << std::endl;
+		Connection upstream(address, std::move(s));
+		{
+			Message::Packet packet;
+			packet.source.address = address;
+			packet.source.serverName =
+				configuration.upstreamName.empty() ? configuration.name : configuration.upstreamName;
+			String token = configuration.upstreamToken;
+			if (token.empty())
+			{
+				// Each relay needs its own name on the upstream server
+				token = configuration.name;
+				token += " relay ";
+				token += std::to_string(configuration.startTime);
+			}
+			packet.payload.emplace<Message::Credentials>(std::move(token));
+			if (!upstream->sendPacket(packet, true))
+			{
+				(*logger)(Logger::Level::Error) << "Failed to send credentials to upstream server" << std::endl;
+				continue;
+			}
+		}
+
+		auto &packets = upstream.getPackets();
+		bool success = true;
+		while (success && !appDone && upstream.readAndHandle(1000))
+		{
+			while (success)
+			{
+				auto packet = packets.pop(0s);
+				if (!packet)
+				{
+					break;
+				}
+				const bool login = std::holds_alternative<Message::VerifyLogin>(packet->payload);
+				success = relay(std::move(*packet));
+				if (success && login)
+				{
+					// The upstream server accepted the relay
+					retrySeconds = MinRetrySeconds;
+				}
+			}
+		}
+		if (!success)
+		{
+			// The upstream stream won't change its type so reconnecting won't help
+			(*logger)(Logger::Level::Error) << "Stopped relaying upstream server: " << address << std::endl;
+			break;
+		}
+		(*logger)(Logger::Level::Warning) << "Lost connection to upstream server: " << address << std::endl;
+	}
+	--ServerConnection::runningThreads;
+}
+bool ServerStream::relay(Message::Packet &&packet)
+{
+	if (auto login = std::get_if<Message::VerifyLogin>(&packet.payload))
+	{
+		if (login->serverType != configuration.serverType)
+		{
+			(*logger)(Logger::Level::Error) << "Upstream stream " << packet.source << " is a " << login->serverType
+											<< " stream. Expected " << configuration.serverType << std::endl;
+			return false;
+		}
+		*logger << "Relaying stream: " << packet.source << std::endl;
+		LOCK(mutex);
+		origin = packet.source;
+		sourceBytes = nullptr;
+		return true;
+	}
+
+	// Only the stream's data is sent to peers
+	if (packet.payload.index() != ServerTypeToIndex(configuration.serverType))
+	{
+		return true;
+	}
+
+	// Keep the data that is sent to peers when they join
+	if (std::holds_alternative<Message::Text>(packet.payload))
+	{
+		savePayload(packet.payload);
+	}
+	else if (auto image = std::get_if<Message::Image>(&packet.payload))
+	{
+		std::visit(ServerConnection::ImageSaver(*this, packet.source), image->largeFile);
+	}
+
+	ServerConnection::sendToPeers(*this, std::move(packet), nullptr, configuration.record);
+	return true;
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,431 @@
+/******************************************************************************
+	Copyright (C) 2022 by Temitope Alaga <temdog007@yaoo.com>
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <main.hpp>
+
+#if TEMSTREAM_USE_IO_URING
+#include <sys/eventfd.h>
+
+namespace TemStream
+{
+UringReactor::UringReactor(WorkerPool &workers)
+	: Reactor(workers), ring(), bufferRing(nullptr), buffers(), pending(), eventFd(-1), ringReady(false)
+{
+}
+UringReactor::~UringReactor()
+{
+	join();
+	if (bufferRing != nullptr)
+	{
+		io_uring_free_buf_ring(&ring, bufferRing, BufferCount, BufferGroup);
+	}
+	if (ringReady)
+	{
+		io_uring_queue_exit(&ring);
+	}
+	if (eventFd >= 0)
+	{
+		::close(eventFd);
+	}
+}
+uint64_t UringReactor::encode(const Operation operation, const SOCKET fd)
+{
+	return (static_cast<uint64_t>(operation) << 56) | static_cast<uint32_t>(fd);
+}
+bool UringReactor::init()
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int result = io_uring_queue_init_params(QueueDepth, &ring, &params);
+	if (result < 0)
+	{
+		(*logger)(Logger::Level::Error) << "io_uring_queue_init_params: " << strerror(-result) << std::endl;
+		return false;
+	}
+	ringReady = true;
+
+	struct io_uring_probe *probe = io_uring_get_probe_ring(&ring);
+	const bool supported = probe != nullptr && io_uring_opcode_supported(probe, IORING_OP_RECV) &&
+						   io_uring_opcode_supported(probe, IORING_OP_SEND) &&
+						   io_uring_opcode_supported(probe, IORING_OP_POLL_ADD) &&
+						   io_uring_opcode_supported(probe, IORING_OP_ASYNC_CANCEL);
+	if (probe != nullptr)
+	{
+		io_uring_free_probe(probe);
+	}
+	if (!supported)
+	{
+		(*logger)(Logger::Level::Error) << "io_uring doesn't support socket operations on this kernel" << std::endl;
+		return false;
+	}
+
+	// Kernel picks a buffer from this ring for each receive so idle connections don't hold any memory
+	bufferRing = io_uring_setup_buf_ring(&ring, BufferCount, BufferGroup, 0, &result);
+	if (bufferRing == nullptr)
+	{
+		(*logger)(Logger::Level::Error) << "io_uring_setup_buf_ring: " << strerror(-result) << std::endl;
+		return false;
+	}
+	buffers.resize(BufferCount * BufferSize);
+	for (uint32_t i = 0; i < BufferCount; ++i)
+	{
+		io_uring_buf_ring_add(bufferRing, buffers.data() + i * BufferSize, BufferSize, static_cast<uint16_t>(i),
+							  io_uring_buf_ring_mask(BufferCount), static_cast<int>(i));
+	}
+	io_uring_buf_ring_advance(bufferRing, BufferCount);
+
+	eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eventFd < 0)
+	{
+		perror("eventfd");
+		return false;
+	}
+	return armWake() && io_uring_submit(&ring) >= 0;
+}
+struct io_uring_sqe *UringReactor::getSqe()
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+	if (sqe == nullptr)
+	{
+		// Submission queue is full. Submit what is there now instead of waiting for the end of the pass.
+		io_uring_submit(&ring);
+		sqe = io_uring_get_sqe(&ring);
+	}
+	return sqe;
+}
+bool UringReactor::armWake()
+{
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == nullptr)
+	{
+		return false;
+	}
+	io_uring_prep_poll_multishot(sqe, eventFd, POLLIN);
+	io_uring_sqe_set_data64(sqe, encode(Operation::Wake, eventFd));
+	return true;
+}
+bool UringReactor::armReceive(const SOCKET fd)
+{
+	struct io_uring_sqe *sqe = getSqe();
+	if (sqe == nullptr)
+	{
+		return false;
+	}
+	io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BufferGroup;
+	io_uring_sqe_set_data64(sqe, encode(Operation::Receive, fd));
+	return true;
+}
+void UringReactor::returnBuffer(const uint16_t id)
+{
+	io_uring_buf_ring_add(bufferRing, buffers.data() + id * BufferSize, BufferSize, id,
+						  io_uring_buf_ring_mask(BufferCount), 0);
+	io_uring_buf_ring_advance(bufferRing, 1);
+}
+void UringReactor::wake()
+{
+	const uint64_t value = 1;
+	if (::write(eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	{
+		perror("write");
+	}
+}
+bool UringReactor::watch(const SOCKET fd, const shared_ptr<ServerConnection> &connection)
+{
+	if (!armReceive(fd))
+	{
+		return false;
+	}
+	pending.emplace(fd, Pending{connection, 0, 0, true, false, false});
+	return true;
+}
+void UringReactor::unwatch(const SOCKET fd, shared_ptr<ServerConnection> &&)
+{
+	auto iter = pending.find(fd);
+	if (iter == pending.end())
+	{
+		return;
+	}
+	auto &p = iter->second;
+	p.closing = true;
+	if (p.receiving || p.sends > 0)
+	{
+		struct io_uring_sqe *sqe = getSqe();
+		if (sqe != nullptr)
+		{
+			io_uring_prep_cancel_fd(sqe, fd, IORING_ASYNC_CANCEL_ALL);
+			io_uring_sqe_set_data64(sqe, encode(Operation::Cancel, fd));
+		}
+	}
+	release(fd);
+}
+void UringReactor::release(const SOCKET fd)
+{
+	auto iter = pending.find(fd);
+	if (iter != pending.end() && iter->second.closing && !iter->second.receiving && iter->second.sends == 0)
+	{
+		pending.erase(iter);
+	}
+}
+bool UringReactor::flush(const SOCKET fd, const shared_ptr<ServerConnection> &connection)
+{
+	auto iter = pending.find(fd);
+	if (iter == pending.end())
+	{
+		return false;
+	}
+	auto &p = iter->second;
+	if (p.sends > 0)
+	{
+		// The rest will be sent when the current chain completes
+		return true;
+	}
+
+	std::array<ByteSpan, Socket::MaxWriteSpans> spans;
+	const auto count = (*connection)->gather(spans.data(), spans.size());
+	if (!count.has_value())
+	{
+		return false;
+	}
+	if (*count == 0)
+	{
+		return true;
+	}
+
+	// A chain is broken if it is split between submissions
+	if (io_uring_sq_space_left(&ring) < *count)
+	{
+		io_uring_submit(&ring);
+	}
+	for (size_t i = 0; i < *count; ++i)
+	{
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+		if (sqe == nullptr)
+		{
+			return false;
+		}
+		// Wait for all bytes so a short send doesn't let the next link run early
+		io_uring_prep_send(sqe, fd, spans[i].data, spans[i].size, MSG_WAITALL | MSG_NOSIGNAL);
+		if (i + 1 < *count)
+		{
+			sqe->flags |= IOSQE_IO_LINK;
+		}
+		io_uring_sqe_set_data64(sqe, encode(Operation::Send, fd));
+	}
+	p.sends = static_cast<uint32_t>(*count);
+	p.sent = 0;
+	p.sendFailed = false;
+	return true;
+}
+bool UringReactor::wait(const int timeout)
+{
+	struct __kernel_timespec ts;
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	struct io_uring_cqe *cqe = nullptr;
+	const int result = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &ts, nullptr);
+	if (result < 0 && result != -ETIME && result != -EINTR)
+	{
+		(*logger)(Logger::Level::Error) << "io_uring_submit_and_wait_timeout: " << strerror(-result) << std::endl;
+		return false;
+	}
+
+	struct Completion
+	{
+		uint64_t data;
+		int32_t result;
+		uint32_t flags;
+	};
+	std::array<struct io_uring_cqe *, 256> cqes;
+	std::array<Completion, 256> completions;
+	const uint32_t count = io_uring_peek_batch_cqe(&ring, cqes.data(), static_cast<uint32_t>(cqes.size()));
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		completions[i] = Completion{io_uring_cqe_get_data64(cqes[i]), cqes[i]->res, cqes[i]->flags};
+	}
+	// Release the slots before handling so new requests can complete while these are handled
+	io_uring_cq_advance(&ring, count);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const auto &c = completions[i];
+		try
+		{
+			handleCompletion(c.data, c.result, c.flags);
+		}
+		catch (const std::bad_alloc &)
+		{
+			(*logger)(Logger::Level::Error) << "Ran out of memory" << std::endl;
+			removeConnection(static_cast<SOCKET>(c.data & UINT32_MAX));
+		}
+		catch (const std::exception &e)
+		{
+			(*logger)(Logger::Level::Error) << "Exception occurred: " << e.what() << std::endl;
+			removeConnection(static_cast<SOCKET>(c.data & UINT32_MAX));
+		}
+	}
+	return true;
+}
+void UringReactor::handleCompletion(const uint64_t data, const int32_t result, const uint32_t flags)
+{
+	const SOCKET fd = static_cast<SOCKET>(data & UINT32_MAX);
+	switch (static_cast<Operation>(data >> 56))
+	{
+	case Operation::Wake: {
+		uint64_t value;
+		while (::read(eventFd, &value, sizeof(value)) > 0)
+		{
+		}
+		if ((flags & IORING_CQE_F_MORE) == 0)
+		{
+			armWake();
+		}
+	}
+	break;
+	case Operation::Receive:
+		handleReceive(fd, result, flags);
+		break;
+	case Operation::Send:
+		handleSend(fd, result);
+		break;
+	default:
+		break;
+	}
+}
+void UringReactor::handleReceive(const SOCKET fd, const int32_t result, const uint32_t flags)
+{
+	const bool hasBuffer = (flags & IORING_CQE_F_BUFFER) != 0;
+	const uint16_t id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+	auto iter = pending.find(fd);
+	if (iter == pending.end())
+	{
+		if (hasBuffer)
+		{
+			returnBuffer(id);
+		}
+		return;
+	}
+
+	auto &p = iter->second;
+	const bool more = (flags & IORING_CQE_F_MORE) != 0;
+	if (!more)
+	{
+		p.receiving = false;
+	}
+
+	bool keep = true;
+	if (result > 0 && hasBuffer)
+	{
+		if (!p.closing)
+		{
+			const auto connection = p.connection;
+			keep = connection->receive(buffers.data() + id * BufferSize, static_cast<uint32_t>(result)) &&
+				   received(connection);
+		}
+	}
+	else if (result == 0)
+	{
+		// Peer closed the connection
+		keep = false;
+	}
+	else if (result < 0 && result != -ENOBUFS && result != -ECANCELED)
+	{
+		(*logger)(Logger::Level::Error) << "Receive failed: " << strerror(-result) << std::endl;
+		keep = false;
+	}
+	// With -ENOBUFS, every buffer is being used. Receiving again once buffers are returned is enough.
+
+	if (hasBuffer)
+	{
+		returnBuffer(id);
+	}
+
+	if (p.closing)
+	{
+		release(fd);
+	}
+	else if (!keep)
+	{
+		removeConnection(fd);
+	}
+	else if (!more)
+	{
+		if (armReceive(fd))
+		{
+			p.receiving = true;
+		}
+		else
+		{
+			removeConnection(fd);
+		}
+	}
+}
+void UringReactor::handleSend(const SOCKET fd, const int32_t result)
+{
+	auto iter = pending.find(fd);
+	if (iter == pending.end())
+	{
+		return;
+	}
+
+	auto &p = iter->second;
+	if (result < 0)
+	{
+		// The sends after a failed one in a chain are cancelled
+		if (result != -ECANCELED && !p.closing)
+		{
+			(*logger)(Logger::Level::Error) << "Send failed: " << strerror(-result) << std::endl;
+		}
+		p.sendFailed = true;
+	}
+	else
+	{
+		p.sent += static_cast<uint32_t>(result);
+	}
+	if (--p.sends > 0)
+	{
+		return;
+	}
+
+	if (p.closing)
+	{
+		release(fd);
+		return;
+	}
+
+	const auto connection = p.connection;
+	const bool failed = p.sendFailed;
+	(*connection)->consume(p.sent);
+	p.sent = 0;
+	p.sendFailed = false;
+	if (failed || !flush(fd, connection))
+	{
+		removeConnection(fd);
+	}
+}
+void UringReactor::shutdown()
+{
+	// Every connection was removed so only cancelled requests are left. Give them time to complete.
+	for (int i = 0; i < 100 && !pending.empty(); ++i)
+	{
+		if (!wait(10))
+		{
+			break;
+		}
+	}
+	pending.clear();
+}
+} // namespace TemStream
+#endif
\ No newline at end of file
@@ -14,48 +14,313 @@
 
 #include <main.hpp>
 
-bool sendAll(const SOCKET fd, const void *, size_t size);
-bool writeAll(SSL *, const void *, int);
+#if !WIN32
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#endif
+
+bool wouldBlock();
 int LogError(const char *str, size_t len, void *u);
 
 namespace TemStream
 {
-Socket::Socket() : buffer(), outgoing(KB(1)), mutex()
+Socket::Socket()
+	: buffer(), outgoing(), outgoingBytes(0), sharedBytes(0), outgoingOffset(0), outgoingInFlight(0),
+	  limits(std::nullopt), drops(),
+	  waitingForKeyframe(false), overflowed(false), wakeupCallback(nullptr), mutex(), framing(Framing::V1),
+	  maxWriteBytes(DefaultMaxWriteBytes), compressMinBytes(DefaultCompressMinBytes), corkWrites(false),
+	  nonBlocking(false)
 {
 }
 Socket::~Socket()
 {
 }
+OutgoingPacket::OutgoingPacket(const SharedBytes &header, const SharedBytes &payload, const SendPolicy policy,
+							   const bool keyframe)
+	: header(header), payload(payload), trailer(nullptr), queued(), policy(policy), keyframe(keyframe)
+{
+}
+OutgoingPacket::OutgoingPacket(const SharedBytes &header, const SharedBytes &payload, const SharedBytes &trailer,
+							   const SendPolicy policy, const bool keyframe)
+	: header(header), payload(payload), trailer(trailer), queued(), policy(policy), keyframe(keyframe)
+{
+}
+std::ostream &operator<<(std::ostream &os, const DropCounters &counters)
+{
+	os << "Queue full: " << counters.queueFull << "; Too old: " << counters.tooOld
+	   << "; Waiting for keyframe: " << counters.waitingForKeyframe;
+	printMemory(os, "; Bytes", counters.bytes);
+	return os;
+}
+std::ostream &operator<<(std::ostream &os, const TcpMode mode)
+{
+	switch (mode)
+	{
+	case TcpMode::Auto:
+		os << "Auto";
+		break;
+	case TcpMode::Nagle:
+		os << "Nagle";
+		break;
+	case TcpMode::NoDelay:
+		os << "No delay";
+		break;
+	case TcpMode::Cork:
+		os << "Cork";
+		break;
+	default:
+		os << "Unknown";
+		break;
+	}
+	return os;
+}
+SharedBytes Socket::serialize(const Message::Packet &packet, const bool withSource)
+{
+	MemoryStream m;
+	{
+		cereal::PortableBinaryOutputArchive ar(m);
+		ar(packet.payload);
+		if (withSource)
+		{
+			ar(packet.source);
+		}
+	}
+	return tem_shared<ByteList>(m->moveBytes());
+}
+SharedBytes Socket::serialize(const Message::Source &source)
+{
+	MemoryStream m;
+	{
+		cereal::PortableBinaryOutputArchive ar(m);
+		ar(source);
+	}
+	// Skip the endianness byte of the archive
+	const ByteList &bytes = m->getBytes();
+	return tem_shared<ByteList>(bytes, bytes.size() - 1, 1);
+}
+SharedBytes Socket::makeHeader(const uint32_t size, const Framing framing, const uint8_t type, const uint32_t streamId,
+								const bool hasSource, const bool compressed)
+{
+	std::array<uint8_t, MaxHeaderSize> header;
+	uint32_t used = 0;
+	const auto writeLittleEndian = [&header, &used](const uint64_t value) {
+		for (uint32_t i = 0; i < sizeof(value); ++i)
+		{
+			header[used++] = static_cast<uint8_t>(value >> (i * 8u));
+		}
+	};
+	const auto writeVarint = [&header, &used](uint32_t value) {
+		while (value >= 0x80u)
+		{
+			header[used++] = static_cast<uint8_t>(value | 0x80u);
+			value >>= 7u;
+		}
+		header[used++] = static_cast<uint8_t>(value);
+	};
+	if (framing >= Framing::V2)
+	{
+		header[used++] = FrameMagic;
+		header[used++] = static_cast<uint8_t>(framing);
+		uint8_t flags = hasSource ? FrameHasSource : 0;
+		if (compressed && framing >= Framing::V3)
+		{
+			flags |= FrameCompressed;
+		}
+		header[used++] = type | flags;
+		writeVarint(streamId);
+		writeVarint(size);
+	}
+	else
+	{
+		// Same bytes that a little endian cereal::PortableBinaryOutputArchive writes for a Message::Header
+		header[used++] = 1;
+		writeLittleEndian(Message::MagicGuid.longs[0]);
+		writeLittleEndian(Message::MagicGuid.longs[1]);
+		writeLittleEndian(static_cast<uint64_t>(size));
+	}
+	return tem_shared<ByteList>(header.data(), used);
+}
+void Socket::setFraming(const Framing f)
+{
+	framing = f;
+}
+void Socket::setCompression(const uint32_t minBytes)
+{
+	compressMinBytes = minBytes;
+}
+void Socket::setWriteBatch(const uint32_t bytes)
+{
+	LOCK(mutex);
+	maxWriteBytes = std::max(bytes, 1u);
+}
+bool Socket::setTcpMode(const TcpMode mode)
+{
+	corkWrites = mode == TcpMode::Cork;
+	return setNoDelay(mode != TcpMode::Nagle);
+}
 void Socket::send(const ByteList &bytes)
 {
 	send(bytes.data(), bytes.size());
 }
 void Socket::send(const uint8_t *data, const uint32_t size)
+{
+	send(tem_shared<ByteList>(data, size));
+}
+void Socket::send(const SharedBytes &payload)
+{
+	send(makeHeader(payload->size(), framing), payload);
+}
+void Socket::send(const SharedBytes &header, const SharedBytes &payload)
+{
+	send(OutgoingPacket(header, payload));
+}
+void Socket::send(OutgoingPacket &&packet)
 {
 	LOCK(mutex);
+	if (overflowed)
+	{
+		return;
+	}
+	if (packet.policy == SendPolicy::DropUntilKeyframe && waitingForKeyframe)
 	{
-		MemoryStream m;
+		if (!packet.keyframe)
 		{
-			Message::Header header;
-			header.size = static_cast<uint64_t>(size);
-			header.id = Message::MagicGuid;
-			cereal::PortableBinaryOutputArchive ar(m);
-			ar(header);
+			++drops.waitingForKeyframe;
+			drops.bytes += packet.size();
+			return;
 		}
-		outgoing.append(m->getBytes());
+		waitingForKeyframe = false;
+	}
+	packet.queued = std::chrono::system_clock::now();
+	outgoingBytes += packet.size();
+	if (packet.policy == SendPolicy::Shared)
+	{
+		sharedBytes += packet.size();
+	}
+	outgoing.emplace_back(std::move(packet));
+	if (limits.has_value() && !enforceLimits())
+	{
+		(*logger)(Logger::Level::Warning) << "Outgoing queue overflowed. Dropped messages: " << drops << std::endl;
+		overflowed = true;
+	}
+	if (wakeupCallback)
+	{
+		wakeupCallback();
 	}
-	outgoing.append(data, size);
 }
-bool Socket::sendPacket(const Message::Packet &packet, const bool sendImmediately)
+bool Socket::enforceLimits()
+{
+	const auto now = std::chrono::system_clock::now();
+	const auto tooOld = [this, &now](const OutgoingPacket &packet) { return now - packet.queued > limits->maxDelay; };
+
+	// Messages being written can't be removed. The front message may also be partially sent.
+	const size_t skip = std::max<size_t>(outgoingInFlight, 1);
+	auto iter = outgoing.begin() + std::min(skip, outgoing.size());
+
+	// Messages are in the order they were queued. Stop at the first one that is new enough if the queue isn't full.
+	while (iter != outgoing.end())
+	{
+		const bool full = outgoingBytes - sharedBytes > limits->maxBytes;
+		if (!full && !tooOld(*iter))
+		{
+			break;
+		}
+		switch (iter->policy)
+		{
+		case SendPolicy::Reliable:
+		case SendPolicy::Shared:
+			++iter;
+			break;
+		case SendPolicy::DropUntilKeyframe:
+			waitingForKeyframe = true;
+			drop(iter, full ? drops.queueFull : drops.tooOld);
+			break;
+		default:
+			drop(iter, full ? drops.queueFull : drops.tooOld);
+			break;
+		}
+	}
+
+	// Any video left must wait for the next keyframe since a frame it depends on was dropped
+	if (waitingForKeyframe)
+	{
+		for (iter = outgoing.begin() + std::min(skip, outgoing.size()); iter != outgoing.end();)
+		{
+			if (iter->policy != SendPolicy::DropUntilKeyframe)
+			{
+				++iter;
+			}
+			else if (iter->keyframe)
+			{
+				waitingForKeyframe = false;
+				break;
+			}
+			else
+			{
+				drop(iter, drops.waitingForKeyframe);
+			}
+		}
+	}
+
+	return outgoingBytes - sharedBytes <= limits->maxBytes &&
+		   (outgoing.empty() || outgoing.front().policy == SendPolicy::Shared || !tooOld(outgoing.front()));
+}
+void Socket::drop(Deque<OutgoingPacket>::iterator &iter, uint64_t &counter)
+{
+	++counter;
+	drops.bytes += iter->size();
+	outgoingBytes -= iter->size();
+	iter = outgoing.erase(iter);
+}
+void Socket::setLimits(const SendLimits &l)
+{
+	LOCK(mutex);
+	limits = l;
+}
+DropCounters Socket::getDropCounters()
+{
+	LOCK(mutex);
+	return drops;
+}
+void Socket::setWakeup(std::function<void()> &&callback)
+{
+	LOCK(mutex);
+	wakeupCallback = std::move(callback);
+}
+void Socket::wakeup()
+{
+	LOCK(mutex);
+	if (wakeupCallback)
+	{
+		wakeupCallback();
+	}
+}
+bool Socket::setNonBlocking()
+{
+	return false;
+}
+bool Socket::sendPacket(const Message::Packet &packet, const bool sendImmediately, const uint32_t streamId,
+						const bool withSource)
 {
 	try
 	{
-		MemoryStream m;
+		const Framing f = framing;
+		const bool hasSource = f == Framing::V1 || withSource || streamId == 0;
+		auto payload = serialize(packet, hasSource);
+		const uint32_t minBytes = compressMinBytes;
+		bool compressed = false;
+		if (f >= Framing::V3 && minBytes != 0 && payload->size() >= minBytes && isCompressible(packet.payload.index()))
 		{
-			cereal::PortableBinaryOutputArchive in(m);
-			in(packet);
+			if (auto bytes = compressMessage(payload->data(), payload->size(), packet.payload.index()))
+			{
+				payload = std::move(bytes);
+				compressed = true;
+			}
 		}
-		send(m->getBytes());
+		send(makeHeader(payload->size(), f, static_cast<uint8_t>(packet.payload.index()), streamId, hasSource,
+						compressed),
+			 payload);
 		if (sendImmediately)
 		{
 			return flush();
@@ -77,12 +342,155 @@ bool Socket::sendPacket(const Message::Packet &packet, const bool sendImmediatel
 }
 bool Socket::flush()
 {
-	ByteList t;
+	while (true)
 	{
-		LOCK(mutex);
-		t.swap(outgoing);
+		switch (flushSome())
+		{
+		case FlushState::Done:
+			return true;
+		case FlushState::Blocked:
+			if (pollWrite(1000) == PollState::Error)
+			{
+				return false;
+			}
+			break;
+		default:
+			return false;
+		}
 	}
-	return flush(t);
+}
+FlushState Socket::flushSome()
+{
+	std::array<ByteSpan, MaxWriteSpans> spans;
+	FlushState state = FlushState::Done;
+	bool corked = false;
+	while (true)
+	{
+		const auto count = gather(spans.data(), spans.size());
+		if (!count.has_value())
+		{
+			state = FlushState::Error;
+			break;
+		}
+		if (*count == 0)
+		{
+			break;
+		}
+
+		const auto written = write(spans.data(), *count);
+		if (!written.has_value())
+		{
+			state = FlushState::Error;
+			break;
+		}
+		const size_t left = consume(*written);
+		if (*written == 0)
+		{
+			state = FlushState::Blocked;
+			break;
+		}
+		// More writes are needed. Only send full segments until the last one.
+		if (corkWrites && !corked && left > 0)
+		{
+			corked = setCork(true);
+		}
+	}
+	if (corked)
+	{
+		setCork(false);
+	}
+	return state;
+}
+std::optional<size_t> Socket::gather(ByteSpan *spans, const size_t max)
+{
+	// Other threads won't remove the packets being written so the bytes stay valid after unlocking
+	LOCK(mutex);
+	if (overflowed)
+	{
+		return std::nullopt;
+	}
+	size_t count = 0;
+	uint32_t offset = outgoingOffset;
+	uint32_t gathered = 0;
+	outgoingInFlight = 0;
+	// Each packet needs up to 3 spans
+	for (auto iter = outgoing.begin(); iter != outgoing.end() && count + 2 < max && gathered < maxWriteBytes; ++iter)
+	{
+		gathered += iter->size() - offset;
+		++outgoingInFlight;
+		for (const auto &bytes : {iter->header, iter->payload, iter->trailer})
+		{
+			if (bytes == nullptr)
+			{
+				continue;
+			}
+			if (offset >= bytes->size())
+			{
+				offset -= bytes->size();
+				continue;
+			}
+			spans[count++] = ByteSpan{bytes->data() + offset, bytes->size() - offset};
+			offset = 0;
+		}
+	}
+	return count;
+}
+size_t Socket::consume(uint32_t written)
+{
+	LOCK(mutex);
+	// Nothing was written so the messages stay in flight. A blocked TLS write must be retried with the same bytes, so
+	// they can't be dropped before the next write.
+	if (written == 0)
+	{
+		return outgoingBytes;
+	}
+	outgoingInFlight = 0;
+	outgoingBytes -= written;
+	bool sharedSent = false;
+	while (!outgoing.empty())
+	{
+		const uint32_t left = outgoing.front().size() - outgoingOffset;
+		const bool shared = outgoing.front().policy == SendPolicy::Shared;
+		// Partially written shared bytes are no longer queued either
+		if (shared)
+		{
+			sharedBytes -= std::min(written, left);
+		}
+		if (written < left)
+		{
+			outgoingOffset += written;
+			break;
+		}
+		written -= left;
+		outgoingOffset = 0;
+		sharedSent = sharedSent || shared;
+		outgoing.pop_front();
+	}
+	// Messages that waited behind shared ones only start aging once they are sent
+	if (sharedSent && !outgoing.empty() && outgoing.front().policy != SendPolicy::Shared)
+	{
+		outgoing.front().queued = std::chrono::system_clock::now();
+	}
+	return outgoingBytes;
+}
+std::optional<uint32_t> Socket::write(const ByteSpan *spans, const size_t count)
+{
+	uint32_t total = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto written = write(spans[i].data, spans[i].size);
+		if (!written.has_value())
+		{
+			// Report what was written. The error will be seen again on the next write.
+			return total == 0 ? std::nullopt : std::make_optional(total);
+		}
+		total += *written;
+		if (*written < spans[i].size)
+		{
+			break;
+		}
+	}
+	return total;
 }
 BasicSocket::BasicSocket() : Socket(), fd(INVALID_SOCKET)
 {
@@ -115,9 +523,86 @@ PollState BasicSocket::pollWrite(const int timeout) const
 {
 	return pollSocket(fd, timeout, POLLOUT);
 }
-bool BasicSocket::flush(const ByteList &bytes)
+std::optional<uint32_t> BasicSocket::write(const uint8_t *data, const uint32_t size)
+{
+	const auto sent = ::send(fd, reinterpret_cast<const char *>(data), static_cast<int>(size), 0);
+	if (sent < 0)
+	{
+		if (nonBlocking && wouldBlock())
+		{
+			return 0u;
+		}
+		perror("send");
+		return std::nullopt;
+	}
+	if (sent == 0)
+	{
+		return std::nullopt;
+	}
+	return static_cast<uint32_t>(sent);
+}
+std::optional<uint32_t> BasicSocket::write(const ByteSpan *spans, const size_t count)
+{
+#if WIN32
+	std::array<WSABUF, MaxWriteSpans> buffers;
+	for (size_t i = 0; i < count; ++i)
+	{
+		buffers[i].buf = const_cast<CHAR *>(reinterpret_cast<const CHAR *>(spans[i].data));
+		buffers[i].len = static_cast<ULONG>(spans[i].size);
+	}
+	DWORD sent = 0;
+	if (WSASend(fd, buffers.data(), static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) != 0)
+	{
+		if (nonBlocking && wouldBlock())
+		{
+			return 0u;
+		}
+		perror("WSASend");
+		return std::nullopt;
+	}
+#else
+	std::array<struct iovec, MaxWriteSpans> buffers;
+	for (size_t i = 0; i < count; ++i)
+	{
+		buffers[i].iov_base = const_cast<uint8_t *>(spans[i].data);
+		buffers[i].iov_len = spans[i].size;
+	}
+	const auto sent = ::writev(fd, buffers.data(), static_cast<int>(count));
+	if (sent < 0)
+	{
+		if (nonBlocking && wouldBlock())
+		{
+			return 0u;
+		}
+		perror("writev");
+		return std::nullopt;
+	}
+#endif
+	if (sent == 0)
+	{
+		return std::nullopt;
+	}
+	return static_cast<uint32_t>(sent);
+}
+bool BasicSocket::setNonBlocking()
 {
-	return sendAll(fd, bytes.data(), bytes.size());
+#if WIN32
+	u_long mode = 1;
+	if (ioctlsocket(fd, FIONBIO, &mode) != 0)
+	{
+		perror("ioctlsocket");
+		return false;
+	}
+#else
+	const int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		perror("fcntl");
+		return false;
+	}
+#endif
+	nonBlocking = true;
+	return true;
 }
 bool BasicSocket::getIpAndPort(std::array<char, INET6_ADDRSTRLEN> &str, uint16_t &port) const
 {
@@ -158,10 +643,60 @@ bool UdpSocket::connect(const char *hostname, const char *port)
 	close();
 	return openSocket(fd, hostname, port, SocketType::Server, false);
 }
-void UdpSocket::send(const uint8_t *, uint32_t)
+void UdpSocket::send(OutgoingPacket &&)
 {
 	throw std::runtime_error("Invalid call to UdpSocket::send");
 }
+bool SocketAddress::operator==(const SocketAddress &a) const
+{
+	return length == a.length && memcmp(&storage, &a.storage, static_cast<size_t>(length)) == 0;
+}
+bool UdpSocket::sendTo(const ByteList &bytes, const SocketAddress *address)
+{
+	const auto sent = address == nullptr
+						  ? ::send(fd, reinterpret_cast<const char *>(bytes.data()), static_cast<int>(bytes.size()), 0)
+						  : ::sendto(fd, reinterpret_cast<const char *>(bytes.data()), static_cast<int>(bytes.size()),
+									 0, reinterpret_cast<const struct sockaddr *>(&address->storage), address->length);
+	if (sent < 0)
+	{
+		// Datagrams may be lost anyway
+		if (nonBlocking && wouldBlock())
+		{
+			return true;
+		}
+		perror("sendto");
+		return false;
+	}
+	return true;
+}
+bool UdpSocket::receiveFrom(ByteList &bytes, SocketAddress &address)
+{
+	bytes.clear();
+	address.length = sizeof(address.storage);
+	const auto r = recvfrom(fd, buffer.data(), static_cast<int>(buffer.size()), 0,
+							reinterpret_cast<struct sockaddr *>(&address.storage), &address.length);
+	if (r < 0)
+	{
+		if (nonBlocking && wouldBlock())
+		{
+			return true;
+		}
+		perror("recvfrom");
+		return false;
+	}
+	bytes.append(reinterpret_cast<const uint8_t *>(buffer.data()), static_cast<uint32_t>(r));
+	return true;
+}
+bool UdpSocket::getPeer(SocketAddress &address) const
+{
+	address.length = sizeof(address.storage);
+	if (getpeername(fd, reinterpret_cast<struct sockaddr *>(&address.storage), &address.length) < 0)
+	{
+		perror("getpeername");
+		return false;
+	}
+	return true;
+}
 bool UdpSocket::read(const int timeout, ByteList &bytes, const bool readAll)
 {
 	int reads = 0;
@@ -202,6 +737,36 @@ TcpSocket::TcpSocket(const SOCKET fd) : BasicSocket(fd)
 TcpSocket::TcpSocket(TcpSocket &&s) : BasicSocket(std::move(s))
 {
 }
+bool TcpSocket::setNoDelay(const bool enable)
+{
+	const int value = enable ? 1 : 0;
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&value), sizeof(value)) < 0)
+	{
+		perror("setsockopt");
+		return false;
+	}
+	return true;
+}
+bool TcpSocket::setCork(const bool enable)
+{
+#if defined(TCP_CORK) || defined(TCP_NOPUSH)
+	const int value = enable ? 1 : 0;
+#if defined(TCP_CORK)
+	const int option = TCP_CORK;
+#else
+	const int option = TCP_NOPUSH;
+#endif
+	if (setsockopt(fd, IPPROTO_TCP, option, reinterpret_cast<const char *>(&value), sizeof(value)) < 0)
+	{
+		perror("setsockopt");
+		return false;
+	}
+	return true;
+#else
+	(void)enable;
+	return false;
+#endif
+}
 TcpSocket::~TcpSocket()
 {
 }
@@ -215,19 +780,27 @@ bool TcpSocket::read(const int timeout, ByteList &bytes, const bool readAll)
 	int reads = 0;
 	do
 	{
-		switch (pollRead(timeout))
+		// Non-blocking sockets are only read when they are known to be readable
+		if (!nonBlocking)
 		{
-		case PollState::Error:
-			return false;
-		case PollState::GotData:
-			break;
-		default:
-			return true;
+			switch (pollRead(timeout))
+			{
+			case PollState::Error:
+				return false;
+			case PollState::GotData:
+				break;
+			default:
+				return true;
+			}
 		}
 
 		const auto r = recv(fd, buffer.data(), static_cast<int>(buffer.size()), 0);
 		if (r < 0)
 		{
+			if (nonBlocking && wouldBlock())
+			{
+				return true;
+			}
 			perror("recv");
 			return false;
 		}
@@ -265,13 +838,26 @@ unique_ptr<TcpSocket> TcpSocket::acceptConnection(bool &error, const int timeout
 }
 const char *SSLSocket::cert = nullptr;
 const char *SSLSocket::key = nullptr;
-SSLSocket::SSLSocket() : TcpSocket(), data(SSLptr(nullptr))
+uint32_t SSLSocket::sessionCacheSize = SSL_SESSION_CACHE_MAX_SIZE_DEFAULT;
+uint32_t SSLSocket::sessionTimeout = 7200;
+bool SSLSocket::kernelTls = true;
+Mutex SSLSocket::contextMutex;
+SSL_CTX *SSLSocket::serverContext = nullptr;
+SSL_CTX *SSLSocket::clientContext = nullptr;
+Map<Address, SSL_SESSION *> SSLSocket::sessions;
+SSLSocket::SSLSocket()
+	: TcpSocket(), data(SSLptr(nullptr)), peerAddress(), writeBuffer(), pendingWrite(std::nullopt), accepting(false),
+	  kernelSend(false)
 {
 }
-SSLSocket::SSLSocket(const SOCKET fd) : TcpSocket(fd), data(createContext())
+SSLSocket::SSLSocket(const SOCKET fd)
+	: TcpSocket(fd), data(createContext()), peerAddress(), writeBuffer(), pendingWrite(std::nullopt), accepting(false),
+	  kernelSend(false)
 {
 }
-SSLSocket::SSLSocket(TcpSocket &&tcp, SSLptr &&s) : TcpSocket(std::move(tcp)), data(std::move(s))
+SSLSocket::SSLSocket(TcpSocket &&tcp, SSLptr &&s, const bool accepting)
+	: TcpSocket(std::move(tcp)), data(std::move(s)), peerAddress(), writeBuffer(), pendingWrite(std::nullopt),
+	  accepting(accepting), kernelSend(false)
 {
 }
 SSLSocket::~SSLSocket()
@@ -279,61 +865,195 @@ SSLSocket::~SSLSocket()
 }
 SSLContext SSLSocket::createContext()
 {
-	const SSL_METHOD *method = TLS_server_method();
+	LOCK(contextMutex);
+	if (serverContext == nullptr)
+	{
+		const SSL_METHOD *method = TLS_server_method();
+
+		SSLContext ctx(SSL_CTX_new(method));
+		if (!ctx)
+		{
+			perror("Unable to create SSL context");
+			ERR_print_errors_cb(LogError, nullptr);
+			throw std::runtime_error("Unable to create SSL context");
+		}
 
-	SSL_CTX *ctx = SSL_CTX_new(method);
-	if (!ctx)
+		if (SSL_CTX_use_certificate_file(ctx.get(), SSLSocket::cert, SSL_FILETYPE_PEM) <= 0)
+		{
+			ERR_print_errors_cb(LogError, nullptr);
+			throw std::runtime_error("Unable to use certificate file");
+		}
+
+		if (SSL_CTX_use_PrivateKey_file(ctx.get(), SSLSocket::key, SSL_FILETYPE_PEM) <= 0)
+		{
+			ERR_print_errors_cb(LogError, nullptr);
+			throw std::runtime_error("Unable to use private key");
+		}
+
+		// Clients can resume a session with a ticket or from the cache and skip the full handshake
+		if (sessionCacheSize > 0)
+		{
+			static const unsigned char context[] = "TemStream";
+			SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+			SSL_CTX_sess_set_cache_size(ctx.get(), static_cast<long>(sessionCacheSize));
+			SSL_CTX_set_timeout(ctx.get(), static_cast<long>(sessionTimeout));
+			SSL_CTX_set_session_id_context(ctx.get(), context, sizeof(context) - 1);
+		}
+		else
+		{
+			SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_OFF);
+			SSL_CTX_set_options(ctx.get(), SSL_OP_NO_TICKET);
+		}
+#ifdef SSL_OP_ENABLE_KTLS
+		if (kernelTls)
+		{
+			SSL_CTX_set_options(ctx.get(), SSL_OP_ENABLE_KTLS);
+		}
+#endif
+
+		serverContext = ctx.release();
+	}
+	SSL_CTX_up_ref(serverContext);
+	return SSLContext(serverContext);
+}
+SSLContext SSLSocket::getClientContext()
+{
+	LOCK(contextMutex);
+	if (clientContext == nullptr)
 	{
-		perror("Unable to create SSL context");
-		ERR_print_errors_cb(LogError, nullptr);
-		throw std::runtime_error("Unable to create SSL context");
+		clientContext = SSL_CTX_new(TLS_client_method());
+		if (clientContext == nullptr)
+		{
+			ERR_print_errors_cb(LogError, nullptr);
+			return nullptr;
+		}
+		// OpenSSL's internal cache isn't used by clients. Sessions are saved by server address instead.
+		SSL_CTX_set_session_cache_mode(clientContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(clientContext, &SSLSocket::onNewSession);
+#ifdef SSL_OP_ENABLE_KTLS
+		if (kernelTls)
+		{
+			SSL_CTX_set_options(clientContext, SSL_OP_ENABLE_KTLS);
+		}
+#endif
 	}
-
-	if (SSL_CTX_use_certificate_file(ctx, SSLSocket::cert, SSL_FILETYPE_PEM) <= 0)
+	SSL_CTX_up_ref(clientContext);
+	return SSLContext(clientContext);
+}
+int SSLSocket::onNewSession(SSL *ssl, SSL_SESSION *session)
+{
+	auto socket = static_cast<SSLSocket *>(SSL_get_app_data(ssl));
+	if (socket == nullptr)
 	{
-		ERR_print_errors_cb(LogError, nullptr);
-		throw std::runtime_error("Unable to use certificate file");
+		return 0;
 	}
-
-	if (SSL_CTX_use_PrivateKey_file(ctx, SSLSocket::key, SSL_FILETYPE_PEM) <= 0)
+	LOCK(contextMutex);
+	auto &stored = sessions[socket->peerAddress];
+	if (stored != nullptr)
 	{
-		ERR_print_errors_cb(LogError, nullptr);
-		throw std::runtime_error("Unable to use private key");
+		SSL_SESSION_free(stored);
 	}
-
-	return SSLContext(ctx);
+	stored = session;
+	return 1;
+}
+void SSLSocket::checkKernelTls(SSL *ssl)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	// Falls back to SSL_write if the kernel or cipher doesn't support it
+	kernelSend = kernelTls && BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+	if (kernelSend)
+	{
+		(*logger)(Logger::Level::Trace) << "Using kernel TLS for sending" << std::endl;
+	}
+#else
+	(void)ssl;
+	kernelSend = false;
+#endif
 }
-bool SSLSocket::flush(const ByteList &bytes)
+std::optional<uint32_t> SSLSocket::write(const uint8_t *bytes, const uint32_t size)
 {
+	if (kernelSend)
+	{
+		return BasicSocket::write(bytes, size);
+	}
 	struct Foo
 	{
-		const ByteList &bytes;
+		const uint8_t *bytes;
+		const uint32_t size;
+		std::optional<ByteSpan> &pendingWrite;
 
-		bool operator()(SSLptr &ptr)
+		std::optional<uint32_t> operator()(SSLptr &ptr)
 		{
-			return writeAll(ptr.get(), bytes.data(), bytes.size());
+			const int sent = SSL_write(ptr.get(), bytes, static_cast<int>(size));
+			if (sent > 0)
+			{
+				pendingWrite = std::nullopt;
+				return static_cast<uint32_t>(sent);
+			}
+			switch (SSL_get_error(ptr.get(), sent))
+			{
+			case SSL_ERROR_WANT_WRITE:
+			case SSL_ERROR_WANT_READ:
+				pendingWrite = ByteSpan{bytes, size};
+				return 0u;
+			default:
+				perror("SSL_write");
+				ERR_print_errors_cb(LogError, nullptr);
+				return std::nullopt;
+			}
 		}
-		bool operator()(SSLContext &)
+		std::optional<uint32_t> operator()(SSLContext &)
 		{
-			return false;
+			return std::nullopt;
 		}
-		bool operator()(std::pair<SSLContext, SSLptr> &pair)
+		std::optional<uint32_t> operator()(std::pair<SSLContext, SSLptr> &pair)
 		{
 			return operator()(pair.second);
 		}
 	};
-	return std::visit(Foo{bytes}, data);
+	return std::visit(Foo{bytes, size, pendingWrite}, data);
+}
+std::optional<uint32_t> SSLSocket::write(const ByteSpan *spans, const size_t count)
+{
+	// The kernel encrypts whatever is written to the socket so the spans can be written with one call
+	if (kernelSend)
+	{
+		return BasicSocket::write(spans, count);
+	}
+	// A blocked write is retried with the bytes it was given. They are the start of the spans since the messages
+	// being written stay queued until the write completes (see Socket::consume).
+	if (pendingWrite.has_value())
+	{
+		const ByteSpan span = *pendingWrite;
+		return write(span.data, span.size);
+	}
+	// Large messages are encrypted from where they are
+	if (count == 1 || spans[0].size >= maxWriteBytes)
+	{
+		return write(spans[0].data, spans[0].size);
+	}
+	// Small messages are copied so they become one SSL_write instead of one record each
+	writeBuffer.clear();
+	for (size_t i = 0; i < count && writeBuffer.size() < maxWriteBytes; ++i)
+	{
+		writeBuffer.append(spans[i].data, std::min(spans[i].size, maxWriteBytes - writeBuffer.size()));
+	}
+	return write(writeBuffer.data(), writeBuffer.size());
 }
 bool SSLSocket::connect(const char *hostname, const char *port)
 {
 	close();
+	pendingWrite = std::nullopt;
 	if (!openSocket(fd, hostname, port, SocketType::Client, true))
 	{
 		return false;
 	}
 
-	const SSL_METHOD *method = TLS_client_method();
-	auto ctx = SSLContext(SSL_CTX_new(method));
+	auto ctx = getClientContext();
+	if (ctx == nullptr)
+	{
+		return false;
+	}
 	auto ssl = SSLptr(SSL_new(ctx.get()));
 	if (ssl == nullptr)
 	{
@@ -341,6 +1061,18 @@ bool SSLSocket::connect(const char *hostname, const char *port)
 		return false;
 	}
 
+	// Resume the last session with this server if there is one
+	peerAddress = Address(hostname, atoi(port));
+	SSL_set_app_data(ssl.get(), this);
+	{
+		LOCK(contextMutex);
+		auto iter = sessions.find(peerAddress);
+		if (iter != sessions.end())
+		{
+			SSL_set_session(ssl.get(), iter->second);
+		}
+	}
+
 	SSL_set_fd(ssl.get(), static_cast<int>(fd));
 	int err = SSL_connect(ssl.get());
 	if (err <= 0)
@@ -349,6 +1081,11 @@ bool SSLSocket::connect(const char *hostname, const char *port)
 		ERR_print_errors_cb(LogError, nullptr);
 		return false;
 	}
+	if (SSL_session_reused(ssl.get()))
+	{
+		(*logger)(Logger::Level::Trace) << "Resumed SSL session with " << peerAddress << std::endl;
+	}
+	checkKernelTls(ssl.get());
 
 	auto pair = std::make_pair(std::move(ctx), std::move(ssl));
 	data.emplace<std::pair<SSLContext, SSLptr>>(std::move(pair));
@@ -369,19 +1106,27 @@ bool SSLSocket::read(const int timeout, ByteList &bytes, const bool readAll)
 			int reads = 0;
 			do
 			{
-				switch (s.pollRead(timeout))
+				if (!s.nonBlocking && SSL_pending(ptr.get()) == 0)
 				{
-				case PollState::Error:
-					return false;
-				case PollState::GotData:
-					break;
-				default:
-					return true;
+					switch (s.pollRead(timeout))
+					{
+					case PollState::Error:
+						return false;
+					case PollState::GotData:
+						break;
+					default:
+						return true;
+					}
 				}
 
 				const auto r = SSL_read(ptr.get(), s.buffer.data(), static_cast<int>(s.buffer.size()));
 				if (r < 0)
 				{
+					const int err = SSL_get_error(ptr.get(), r);
+					if (s.nonBlocking && (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE))
+					{
+						return true;
+					}
 					ERR_print_errors_cb(LogError, nullptr);
 					perror("SSL_read");
 					return false;
@@ -405,6 +1150,85 @@ bool SSLSocket::read(const int timeout, ByteList &bytes, const bool readAll)
 	};
 	return std::visit(Foo{*this, bytes, timeout, readAll}, data);
 }
+bool SSLSocket::setNonBlocking()
+{
+	if (!TcpSocket::setNonBlocking())
+	{
+		return false;
+	}
+	// Writes that would block are retried later with the same bytes from a list that may have moved
+	struct Foo
+	{
+		void operator()(const SSLptr &ptr) const
+		{
+			if (ptr != nullptr)
+			{
+				SSL_set_mode(ptr.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+			}
+		}
+		void operator()(const SSLContext &) const
+		{
+		}
+		void operator()(const std::pair<SSLContext, SSLptr> &pair) const
+		{
+			operator()(pair.second);
+		}
+	};
+	std::visit(Foo{}, data);
+	return true;
+}
+bool SSLSocket::hasBufferedData() const
+{
+	struct Foo
+	{
+		bool operator()(const SSLptr &ptr) const
+		{
+			return ptr != nullptr && SSL_pending(ptr.get()) > 0;
+		}
+		bool operator()(const SSLContext &) const
+		{
+			return false;
+		}
+		bool operator()(const std::pair<SSLContext, SSLptr> &pair) const
+		{
+			return operator()(pair.second);
+		}
+	};
+	return std::visit(Foo{}, data);
+}
+bool SSLSocket::isHandshaking() const
+{
+	return accepting;
+}
+HandshakeState SSLSocket::handshake()
+{
+	if (!accepting)
+	{
+		return HandshakeState::Done;
+	}
+	auto ptr = std::get_if<SSLptr>(&data);
+	if (ptr == nullptr || *ptr == nullptr)
+	{
+		return HandshakeState::Error;
+	}
+	const int r = SSL_do_handshake(ptr->get());
+	if (r == 1)
+	{
+		accepting = false;
+		checkKernelTls(ptr->get());
+		return HandshakeState::Done;
+	}
+	switch (SSL_get_error(ptr->get(), r))
+	{
+	case SSL_ERROR_WANT_READ:
+		return HandshakeState::WantRead;
+	case SSL_ERROR_WANT_WRITE:
+		return HandshakeState::WantWrite;
+	default:
+		ERR_print_errors_cb(LogError, nullptr);
+		return HandshakeState::Error;
+	}
+}
 unique_ptr<TcpSocket> SSLSocket::acceptConnection(bool &error, const int timeout) const
 {
 	auto ptr = TcpSocket::acceptConnection(error, timeout);
@@ -415,59 +1239,26 @@ unique_ptr<TcpSocket> SSLSocket::acceptConnection(bool &error, const int timeout
 
 	auto &ctx = std::get<SSLContext>(data);
 	auto ssl = SSLptr(SSL_new(ctx.get()));
-	SSL_set_fd(ssl.get(), static_cast<int>(ptr->fd));
-
-	if (SSL_accept(ssl.get()) <= 0)
+	if (ssl == nullptr)
 	{
 		ERR_print_errors_cb(LogError, nullptr);
 		return nullptr;
 	}
+	SSL_set_fd(ssl.get(), static_cast<int>(ptr->fd));
+	// The reactor finishes the handshake so a slow client can't hold up the accept loop
+	SSL_set_accept_state(ssl.get());
 
-	return tem_unique<SSLSocket>(std::move(*ptr), std::move(ssl));
+	return tem_unique<SSLSocket>(std::move(*ptr), std::move(ssl), true);
 }
 } // namespace TemStream
 
-bool sendAll(const SOCKET fd, const void *ptr, size_t size)
-{
-	size_t written = 0;
-	const char *data = reinterpret_cast<const char *>(ptr);
-	while (written < size)
-	{
-		const auto sent = ::send(fd, data + written, static_cast<int>(size - written), 0);
-		if (sent < 0)
-		{
-			perror("send");
-			return false;
-		}
-		if (sent == 0)
-		{
-			return false;
-		}
-		written += sent;
-	}
-	return true;
-}
-
-bool writeAll(SSL *ssl, const void *ptr, const int size)
+bool wouldBlock()
 {
-	int written = 0;
-	const char *data = reinterpret_cast<const char *>(ptr);
-	while (written < size)
-	{
-		const int sent = SSL_write(ssl, data + written, size - written);
-		if (sent < 0)
-		{
-			perror("SSL_write");
-			ERR_print_errors_cb(LogError, nullptr);
-			return false;
-		}
-		if (sent == 0)
-		{
-			return false;
-		}
-		written += sent;
-	}
-	return true;
+#if WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
 }
 
 int LogError(const char *str, size_t len, void *)
@@ -215,8 +215,7 @@ bool StreamDisplay::operator()(Message::TimeRange &timeRange)
 	}
 	else
 	{
-		data.emplace<ReplayData>(gui, source, timeRange);
-		gui.getReplays(source, timeRange.start);
+		data.emplace<ReplayData>(gui, source, timeRange).request(gui, source, timeRange.start);
 	}
 	return true;
 }
@@ -240,17 +239,28 @@ bool StreamDisplay::operator()(Message::Replay &r)
 {
 	if (auto ptr = std::get_if<ReplayData>(&data))
 	{
-		ptr->hasData = true;
-		ptr->packets.emplace_back(std::move(r.message));
+		ptr->player->add(base64_decode(r.message), ptr->replayCursor);
 	}
 	return true;
 }
 bool StreamDisplay::operator()(Message::NoReplay)
 {
-	if (auto ptr = std::get_if<ReplayData>(&data))
+	return true;
+}
+bool StreamDisplay::operator()(Message::ReplayChunk &chunk)
+{
+	auto ptr = std::get_if<ReplayData>(&data);
+	// Chunks of an earlier request are ignored
+	if (ptr == nullptr || chunk.id != ptr->requestId)
 	{
-		ptr->hasData = true;
+		return true;
 	}
+	ptr->receivedUntil = std::max(ptr->receivedUntil, chunk.timestamp);
+	for (auto &bytes : chunk.packets)
+	{
+		ptr->player->add(std::move(bytes), chunk.timestamp);
+	}
+	ptr->finished = ptr->finished || chunk.last;
 	return true;
 }
 bool StreamDisplay::operator()(Message::GetReplay)
@@ -281,6 +291,18 @@ bool StreamDisplay::operator()(Message::GetTimeRange)
 {
 	BAD_MESSAGE(GetTimeRange);
 }
+bool StreamDisplay::operator()(Message::MediaChannel &)
+{
+	BAD_MESSAGE(MediaChannel);
+}
+bool StreamDisplay::operator()(Message::GetReplayRange &)
+{
+	BAD_MESSAGE(GetReplayRange);
+}
+bool StreamDisplay::operator()(Message::ReplayCredit &)
+{
+	BAD_MESSAGE(ReplayCredit);
+}
 StreamDisplay::Draw::Draw(StreamDisplay &d) : display(d)
 {
 }
@@ -400,7 +422,7 @@ bool StreamDisplay::Draw::operator()(Message::ServerLinks &links)
 				ImGui::TableNextColumn();
 				if (ImGui::Button("Connect"))
 				{
-					display.gui.connect(link.address);
+					display.gui.connect(link.address, link.name);
 				}
 
 				ImGui::PopID();
@@ -517,52 +539,73 @@ bool StreamDisplay::Draw::operator()(CheckAudio &t)
 
 bool StreamDisplay::Draw::operator()(ReplayData &v)
 {
-	if (!v.hasData)
+	if (v.player->hasFailed())
 	{
+		return false;
 	}
-	else if (v.packets.empty())
+
+	// Replay time in milliseconds. It stops before packets that haven't been received or decoded.
+	const auto now = std::chrono::system_clock::now();
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - v.clockStart).count();
+	int64_t clock = v.clockOrigin + static_cast<int64_t>(elapsed) * v.speed;
+	int64_t until = v.finished ? v.timeRange.end : v.receivedUntil;
+	if (auto decoded = v.player->decodedUntil())
+	{
+		until = std::min(until, *decoded);
+	}
+	const int64_t limit = std::max(v.clockOrigin, until * 1000 + 999);
+	if (clock > limit)
+	{
+		clock = limit;
+		v.clockOrigin = limit;
+		v.clockStart = now;
+	}
+	const int64_t second = clock / 1000;
+	const int64_t millisecond = clock % 1000;
+	v.replayCursor = std::clamp(second, v.timeRange.start, v.timeRange.end);
+	v.player->setCursor(second);
+
+	// Packets of the current second are spread over it
+	const size_t inSecond = v.player->count(second) + (v.playedSecond == second ? v.playedInSecond : 0);
+	for (auto timestamp = v.player->next(); timestamp.has_value() && *timestamp <= second;
+		 timestamp = v.player->next())
 	{
-		const auto now = std::chrono::system_clock::now();
-		if (now > v.lastUpdate + std::chrono::seconds(1))
+		if (*timestamp == second)
 		{
-			v.hasData = false;
-			if (v.replayCursor != v.timeRange.end)
+			const size_t index = v.playedSecond == second ? v.playedInSecond : 0;
+			if (static_cast<int64_t>(index) * 1000 > millisecond * static_cast<int64_t>(inSecond))
 			{
-				v.replayCursor = std::clamp(v.replayCursor + 1, v.timeRange.start, v.timeRange.end);
-				display.gui.getReplays(display.source, v.replayCursor);
-				v.lastUpdate = now;
+				break;
 			}
 		}
-	}
-	else
-	{
-		try
+		if (*timestamp == v.playedSecond)
 		{
-			ByteList bytes = base64_decode(v.packets.front());
-			v.packets.erase(v.packets.begin());
-			MemoryStream m(std::move(bytes));
-			Message::Packet packet;
-			{
-				cereal::PortableBinaryInputArchive ar(m);
-				ar(packet);
-			}
-			if (auto message = std::get_if<Message::Audio>(&packet.payload))
-			{
-				display.gui.useAudio(
-					display.source, [&message](AudioSource &a) { a.enqueueAudio(message->bytes); }, true);
-			}
-
-			if (!std::visit(*v.display, packet.payload))
-			{
-				return false;
-			}
+			++v.playedInSecond;
 		}
-		catch (const std::exception &e)
+		else
+		{
+			v.playedSecond = *timestamp;
+			v.playedInSecond = 1;
+		}
+		auto ready = v.player->pop();
+		v.consumed += ready->size;
+		auto &packet = ready->packet;
+		if (auto message = std::get_if<Message::Audio>(&packet.payload))
+		{
+			display.gui.useAudio(
+				display.source, [&message](AudioSource &a) { a.enqueueAudio(message->bytes); }, true);
+		}
+
+		if (!std::visit(*v.display, packet.payload))
 		{
-			(*logger)(Logger::Level::Error) << "Packet failure: " << e.what() << std::endl;
 			return false;
 		}
 	}
+	if (v.consumed >= ReplayData::Window / 4)
+	{
+		display.gui.sendReplayCredit(display.source, Message::ReplayCredit{v.requestId, v.consumed});
+		v.consumed = 0;
+	}
 
 	bool success = true;
 	SetWindowMinSize(display.gui.getWindow());
@@ -633,10 +676,30 @@ bool StreamDisplay::ContextMenu::operator()(ReplayData &r)
 	const auto seconds = r.replayCursor - r.timeRange.start;
 	snprintf(buffer, sizeof(buffer), "%02" PRId64 ":%02" PRId64 ":%02" PRId64, (seconds / 3600) % 60,
 			 (seconds / 60) % 60, seconds % 60);
-	if (ImGui::SliderScalar(buffer, ImGuiDataType_S64, &r.replayCursor, &r.timeRange.start, &r.timeRange.end, PRId64,
-							0))
+	int64_t cursor = r.replayCursor;
+	if (ImGui::SliderScalar(buffer, ImGuiDataType_S64, &cursor, &r.timeRange.start, &r.timeRange.end, PRId64, 0))
 	{
-		success = display.gui.getReplays(display.getSource(), r.replayCursor);
+		success = r.request(display.gui, display.getSource(), cursor);
+	}
+	// Faster playback to catch up
+	for (const int speed : {1, 2, 4})
+	{
+		if (speed != 1)
+		{
+			ImGui::SameLine();
+		}
+		snprintf(buffer, sizeof(buffer), "%dx", speed);
+		if (ImGui::RadioButton(buffer, r.speed == speed) && r.speed != speed)
+		{
+			r.speed = static_cast<uint8_t>(speed);
+			success = r.request(display.gui, display.getSource(), r.replayCursor) && success;
+		}
+	}
+	int prefetch = static_cast<int>(r.player->getPrefetch());
+	if (ImGui::SliderInt("Prefetch (seconds)", &prefetch, static_cast<int>(ReplayPlayer::MinPrefetch),
+						 static_cast<int>(ReplayPlayer::MaxPrefetch)))
+	{
+		r.player->setPrefetch(static_cast<uint32_t>(prefetch));
 	}
 	r.display->flags = display.flags;
 	return success;
@@ -697,16 +760,34 @@ bool StreamDisplay::ContextMenu::operator()(SDL_TextureWrapper &w)
 	return true;
 }
 ReplayData::ReplayData(TemStreamGui &gui, const Message::Source &source, const Message::TimeRange &r)
-	: packets(), timeRange(r), display(tem_unique<StreamDisplay>(gui, source, false)), lastUpdate(),
-	  replayCursor(r.start), hasData(false)
+	: player(tem_shared<ReplayPlayer>(r.start)), timeRange(r), display(tem_unique<StreamDisplay>(gui, source, false)),
+	  clockStart(std::chrono::system_clock::now()), clockOrigin(r.start * 1000), replayCursor(r.start),
+	  receivedUntil(r.start - 1), playedSecond(r.start - 1), playedInSecond(0), requestId(0), consumed(0), speed(1),
+	  finished(false)
 {
+	ReplayPlayer::startDecoding(player);
 }
 ReplayData::ReplayData(ReplayData &&data)
-	: packets(std::move(data.packets)), timeRange(data.timeRange), display(std::move(data.display)),
-	  lastUpdate(data.lastUpdate), replayCursor(data.replayCursor), hasData(data.hasData)
+	: player(std::move(data.player)), timeRange(data.timeRange), display(std::move(data.display)),
+	  clockStart(data.clockStart), clockOrigin(data.clockOrigin), replayCursor(data.replayCursor),
+	  receivedUntil(data.receivedUntil), playedSecond(data.playedSecond), playedInSecond(data.playedInSecond),
+	  requestId(data.requestId), consumed(data.consumed), speed(data.speed), finished(data.finished)
 {
 }
 ReplayData::~ReplayData()
 {
 }
+bool ReplayData::request(TemStreamGui &gui, const Message::Source &source, const int64_t timestamp)
+{
+	replayCursor = std::clamp(timestamp, timeRange.start, timeRange.end);
+	player->clear(replayCursor);
+	clockStart = std::chrono::system_clock::now();
+	clockOrigin = replayCursor * 1000;
+	receivedUntil = replayCursor - 1;
+	playedSecond = replayCursor - 1;
+	playedInSecond = 0;
+	consumed = 0;
+	finished = false;
+	return gui.getReplays(source, Message::GetReplayRange{replayCursor, timeRange.end, ++requestId, Window, speed});
+}
 } // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "unitTest.hpp"
+
+namespace TemStream
+{
+namespace
+{
+/**
+ * Decode a header and the body that follows it
+ */
+void testRoundTrip(const Framing framing, const uint32_t size, const uint32_t streamId, const bool hasSource)
+{
+	const auto header = Socket::makeHeader(size, framing, 1, streamId, hasSource);
+	TestConnection connection;
+	CHECK(!connection.receivedHeader());
+	CHECK(connection.decodeHeader(header->data(), header->size()) == header->size());
+	CHECK(connection.receivedHeader());
+
+	const List<uint8_t> body(size, 5);
+	CHECK(connection.receive(body.data(), size));
+	CHECK(connection.messages.size() == 1);
+	if (connection.messages.size() == 1)
+	{
+		const auto &message = connection.messages.front();
+		CHECK(message.bytes.size() == size);
+		CHECK(message.streamId == streamId);
+		CHECK(message.hasSource == hasSource);
+	}
+}
+
+void testRoundTrips()
+{
+	// One to five byte varints
+	const uint32_t ids[] = {0, 1, 127, 128, 300, 16384, 2097152, 268435456, UINT32_MAX};
+	const uint32_t sizes[] = {1, 127, 128, 16383, 16384, MB(1)};
+	for (const auto framing : {Framing::V2, Framing::V3})
+	{
+		for (const auto id : ids)
+		{
+			for (const auto size : sizes)
+			{
+				testRoundTrip(framing, size, id, true);
+				testRoundTrip(framing, size, id, false);
+			}
+		}
+	}
+
+	// The body isn't decompressed here so only the header is checked
+	const auto header = Socket::makeHeader(1000, Framing::V3, 1, 300, true, true);
+	TestConnection connection;
+	CHECK(connection.decodeHeader(header->data(), header->size()) == header->size());
+}
+
+void testTruncated()
+{
+	for (const auto framing : {Framing::V2, Framing::V3})
+	{
+		const auto header = Socket::makeHeader(70000, framing, 1, 300);
+		for (uint32_t size = 1; size < header->size(); ++size)
+		{
+			TestConnection connection;
+			CHECK(connection.decodeHeader(header->data(), size) == 0u);
+			CHECK(!connection.receivedHeader());
+		}
+	}
+}
+
+std::optional<size_t> decode(const List<uint8_t> &bytes, const uint64_t maxMessageSize = MB(1))
+{
+	TestConnection connection;
+	connection.setMaxMessageSize(maxMessageSize);
+	return connection.decodeHeader(bytes.data(), bytes.size());
+}
+
+void testInvalid()
+{
+	const uint8_t magic = Socket::FrameMagic;
+	const uint8_t v2 = static_cast<uint8_t>(Framing::V2);
+
+	// Varints longer than 5 bytes
+	CHECK(!decode({magic, v2, 1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 1}).has_value());
+	CHECK(!decode({magic, v2, 1, 1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01}).has_value());
+	// Stream id that doesn't fit in 32 bits
+	CHECK(!decode({magic, v2, 1, 0xff, 0xff, 0xff, 0xff, 0x7f, 1}).has_value());
+
+	// Sizes that are too large or empty
+	CHECK(decode({magic, v2, 1, 0, 0xe8, 0x07}, 1000) == 3u + 3u);
+	CHECK(!decode({magic, v2, 1, 0, 0xe9, 0x07}, 1000).has_value());
+	CHECK(!decode({magic, v2, 1, 0, 0xff, 0xff, 0xff, 0xff, 0x0f}).has_value());
+	CHECK(!decode({magic, v2, 1, 0, 0}).has_value());
+
+	// Unknown versions
+	for (const uint8_t version : {0, 1, 4, 255})
+	{
+		CHECK(!decode({magic, version, 1, 0, 1}).has_value());
+	}
+
+	// Unknown types. V2 headers can't be compressed so the flag makes the type invalid.
+	CHECK(!decode({magic, v2, static_cast<uint8_t>(std::variant_size_v<Message::Payload>), 0, 1}).has_value());
+	CHECK(!decode({magic, v2, Socket::FrameCompressed | 1, 0, 1}).has_value());
+}
+} // namespace
+
+void testHeader()
+{
+	testRoundTrips();
+	testTruncated();
+	testInvalid();
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "unitTest.hpp"
+
+namespace TemStream
+{
+namespace
+{
+constexpr int PacketsPerSecond = 3;
+constexpr uint32_t PacketSize = 100;
+constexpr char Source[] = "source";
+constexpr uint32_t SourceSize = sizeof(Source) - 1;
+
+String toString(const fs::path &path)
+{
+	return String(path.string().c_str());
+}
+
+fs::path getSegmentPath(const fs::path &directory, const uint32_t number)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%010u.tsl", number);
+	return directory / name;
+}
+
+uint8_t getMarker(const int64_t timestamp, const int n)
+{
+	return static_cast<uint8_t>(timestamp * PacketsPerSecond + n);
+}
+
+/**
+ * Every byte of a packet is the same so its timestamp and position can be checked when it is read. The second packet
+ * of every second has a source that is stored after it.
+ */
+List<RecordedPacket> makePackets(const int64_t start, const int64_t end)
+{
+	List<RecordedPacket> packets;
+	for (int64_t timestamp = start; timestamp < end; ++timestamp)
+	{
+		for (int n = 0; n < PacketsPerSecond; ++n)
+		{
+			const List<uint8_t> bytes(PacketSize, getMarker(timestamp, n));
+			auto source = n == 1 ? tem_shared<ByteList>(reinterpret_cast<const uint8_t *>(Source), SourceSize) : nullptr;
+			RecordedPacket packet(tem_shared<ByteList>(bytes.data(), PacketSize), std::move(source));
+			packet.timestamp = timestamp;
+			packets.push_back(std::move(packet));
+		}
+	}
+	return packets;
+}
+
+bool isPacket(const ByteList &bytes, const int64_t timestamp, const int n)
+{
+	const uint32_t size = PacketSize + (n == 1 ? SourceSize : 0);
+	if (bytes.size() != size)
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < PacketSize; ++i)
+	{
+		if (bytes[i] != getMarker(timestamp, n))
+		{
+			return false;
+		}
+	}
+	return n != 1 || memcmp(bytes.data() + PacketSize, Source, SourceSize) == 0;
+}
+
+/**
+ * Check that every packet from start to end (exclusive) is recorded and nothing else
+ */
+void checkRecorded(const ReplayLog &log, const int64_t start, const int64_t end)
+{
+	const auto range = log.getTimeRange();
+	CHECK(range.has_value());
+	if (range.has_value())
+	{
+		CHECK(range->start == start);
+		CHECK(range->end == end - 1);
+	}
+	for (int64_t timestamp = start; timestamp < end; ++timestamp)
+	{
+		int n = 0;
+		const size_t count = log.read(timestamp, [timestamp, &n](ByteList &&bytes) {
+			CHECK(isPacket(bytes, timestamp, n));
+			++n;
+			return true;
+		});
+		CHECK(count == PacketsPerSecond);
+	}
+	const auto ignore = [](ByteList &&) { return true; };
+	CHECK(log.read(start - 1, ignore) == 0u);
+	CHECK(log.read(end, ignore) == 0u);
+}
+
+void testSegments()
+{
+	const auto directory = makeDirectory("TemStreamReplayLogTest");
+	{
+		ReplayLog log(toString(directory));
+		log.setLimits(ReplayLimits{0, 10, 0, 0, 0, ServerType::Chat});
+		CHECK(log.open());
+		CHECK(!log.getTimeRange().has_value());
+		CHECK(log.append(makePackets(100, 150)));
+		CHECK(log.append(makePackets(150, 200)));
+		CHECK(countSegments(directory) == 10u);
+		checkRecorded(log, 100, 200);
+	}
+
+	ReplayLog log(toString(directory));
+	log.setLimits(ReplayLimits{0, 10, 0, 0, 0, ServerType::Chat});
+	CHECK(log.open());
+	checkRecorded(log, 100, 200);
+	// The last segment is full so appending starts a new one
+	CHECK(log.append(makePackets(200, 201)));
+	CHECK(countSegments(directory) == 11u);
+	checkRecorded(log, 100, 201);
+	fs::remove_all(directory);
+}
+
+void testRanges()
+{
+	const auto directory = makeDirectory("TemStreamReplayLogTest");
+	ReplayLog log(toString(directory));
+	log.setLimits(ReplayLimits{0, 10, 0, 0, 0, ServerType::Chat});
+	CHECK(log.open());
+	CHECK(log.append(makePackets(100, 200)));
+
+	// Starts and ends in the middle of segments
+	int64_t expected = 105;
+	int n = 0;
+	size_t count = log.read(105, 155, [&expected, &n](const int64_t timestamp, ByteList &&bytes) {
+		CHECK(timestamp == expected);
+		CHECK(isPacket(bytes, timestamp, n));
+		if (++n == PacketsPerSecond)
+		{
+			n = 0;
+			++expected;
+		}
+		return true;
+	});
+	CHECK(count == 51u * PacketsPerSecond);
+	CHECK(expected == 156);
+
+	const auto ignore = [](int64_t, ByteList &&) { return true; };
+	CHECK(log.read(195, 1000, ignore) == 5u * PacketsPerSecond);
+	CHECK(log.read(0, 99, ignore) == 0u);
+	CHECK(log.read(200, 1000, ignore) == 0u);
+
+	// Stops when the callback returns false
+	count = log.read(108, 112, [](const int64_t timestamp, ByteList &&) { return timestamp < 110; });
+	CHECK(count == 2u * PacketsPerSecond + 1u);
+	fs::remove_all(directory);
+}
+
+/**
+ * The server stopped while writing: the last record is cut short and the indexes are missing or cut short
+ */
+void testTruncated()
+{
+	const auto directory = makeDirectory("TemStreamReplayLogTest");
+	{
+		ReplayLog log(toString(directory));
+		log.setLimits(ReplayLimits{0, 10, 0, 0, 0, ServerType::Chat});
+		CHECK(log.open());
+		CHECK(log.append(makePackets(100, 130)));
+	}
+	CHECK(countSegments(directory) == 3u);
+
+	const auto last = getSegmentPath(directory, 3);
+	const auto lastSize = fs::file_size(last);
+	{
+		// Record header of a 100 byte packet followed by part of the packet
+		std::array<uint8_t, ReplayLog::RecordHeaderSize + 10> partial{};
+		partial[0] = 130;
+		partial[sizeof(int64_t)] = 100;
+		std::ofstream file(last, std::ios::binary | std::ios::app);
+		file.write(reinterpret_cast<const char *>(partial.data()), partial.size());
+	}
+	fs::remove(fs::path(getSegmentPath(directory, 1)).replace_extension(".tsi"));
+	const auto middleIndex = fs::path(getSegmentPath(directory, 2)).replace_extension(".tsi");
+	CHECK(fs::file_size(middleIndex) == 10u * ReplayLog::IndexEntrySize);
+	fs::resize_file(middleIndex, ReplayLog::IndexEntrySize * 3 / 2);
+
+	{
+		ReplayLog log(toString(directory));
+		log.setLimits(ReplayLimits{0, 10, 0, 0, 0, ServerType::Chat});
+		CHECK(log.open());
+		CHECK(fs::file_size(last) == lastSize);
+		CHECK(fs::file_size(middleIndex) == 10u * ReplayLog::IndexEntrySize);
+		checkRecorded(log, 100, 130);
+		CHECK(log.append(makePackets(130, 135)));
+		checkRecorded(log, 100, 135);
+	}
+
+	ReplayLog log(toString(directory));
+	CHECK(log.open());
+	checkRecorded(log, 100, 135);
+	fs::remove_all(directory);
+}
+} // namespace
+
+void testReplayLog()
+{
+	testSegments();
+	testRanges();
+	testTruncated();
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "unitTest.hpp"
+
+namespace TemStream
+{
+namespace
+{
+constexpr uint32_t PacketSize = 1000;
+// Size of a segment with one packet per second for ten seconds
+constexpr uint64_t SegmentSize = ReplayLog::SegmentHeaderSize + 10 * (ReplayLog::RecordHeaderSize + PacketSize);
+
+size_t count(const ReplayLog &log, const int64_t timestamp)
+{
+	return log.read(timestamp, [](ByteList &&) { return true; });
+}
+
+/**
+ * Record one packet per second from 100 to 199 in segments of ten seconds
+ */
+void record(ReplayLog &log, const ReplayLimits &limits)
+{
+	log.setLimits(limits);
+	CHECK(log.open());
+	List<RecordedPacket> packets;
+	const List<uint8_t> bytes(PacketSize, 1);
+	for (int64_t timestamp = 100; timestamp < 200; ++timestamp)
+	{
+		RecordedPacket packet(tem_shared<ByteList>(bytes.data(), PacketSize));
+		packet.timestamp = timestamp;
+		packets.push_back(std::move(packet));
+	}
+	CHECK(log.append(packets));
+}
+
+bool hasRange(const ReplayLog &log, const int64_t start, const int64_t end)
+{
+	const auto range = log.getTimeRange();
+	return range.has_value() && range->start == start && range->end == end;
+}
+
+void testMaxAge()
+{
+	const auto directory = makeDirectory("TemStreamRetentionTest");
+	ReplayLog log(String(directory.string().c_str()));
+	record(log, ReplayLimits{0, 10, 0, 50, 0, ServerType::Chat});
+	CHECK(countSegments(directory) == 10u);
+
+	// Segments that end before 150
+	CHECK(log.enforceRetention(200) == 5u);
+	CHECK(log.enforceRetention(200) == 0u);
+	CHECK(countSegments(directory) == 5u);
+	CHECK(hasRange(log, 150, 199));
+	CHECK(count(log, 149) == 0u);
+	CHECK(count(log, 150) == 1u);
+
+	// The last segment is still being appended to so it is kept
+	CHECK(log.enforceRetention(100000) == 4u);
+	CHECK(countSegments(directory) == 1u);
+	CHECK(hasRange(log, 190, 199));
+	fs::remove_all(directory);
+}
+
+void testMaxBytes()
+{
+	const auto directory = makeDirectory("TemStreamRetentionTest");
+	ReplayLog log(String(directory.string().c_str()));
+	record(log, ReplayLimits{0, 10, SegmentSize * 10, 0, 0, ServerType::Chat});
+	CHECK(log.enforceRetention(200) == 0u);
+
+	// The oldest segments are deleted until three are left
+	log.setLimits(ReplayLimits{0, 10, SegmentSize * 7 / 2, 0, 0, ServerType::Chat});
+	CHECK(log.enforceRetention(200) == 7u);
+	CHECK(countSegments(directory) == 3u);
+	CHECK(hasRange(log, 170, 199));
+
+	log.setLimits(ReplayLimits{0, 10, 1, 0, 0, ServerType::Chat});
+	CHECK(log.enforceRetention(200) == 2u);
+	CHECK(countSegments(directory) == 1u);
+	CHECK(hasRange(log, 190, 199));
+	fs::remove_all(directory);
+}
+
+Message::Packet makePacket(Message::Payload &&payload)
+{
+	Message::Packet packet;
+	packet.source = Message::Source{Address("localhost", 10000), "Test"};
+	packet.payload = std::move(payload);
+	return packet;
+}
+
+Message::Packet makeFrame(const bool keyframe, const uint8_t n)
+{
+	// VP8 frame header
+	const List<uint8_t> bytes{keyframe ? uint8_t(0x50) : uint8_t(0x51), 0x42, 0x00, 0x9d, 0x01, 0x2a, n};
+	const ByteList frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+	return makePacket(Message::Video(Message::Frame{640, 480, frame}));
+}
+
+Message::Packet makeText(const int64_t timestamp, const int n)
+{
+	char text[64];
+	snprintf(text, sizeof(text), "%" PRId64 " %d", timestamp, n);
+	return makePacket(Message::Text(text));
+}
+
+/**
+ * Record three packets per second from 100 to 199 in segments of ten seconds and compact the segments that end
+ * before 150
+ *
+ * @param type
+ * @param makePacket Make the nth packet of a second
+ * @param kept Returns true if the nth packet of a second is kept
+ */
+void testCompact(const ServerType type, const std::function<Message::Packet(int64_t, int)> &makePacket,
+				 const std::function<bool(int)> &kept)
+{
+	const auto directory = makeDirectory("TemStreamRetentionTest");
+	{
+		ReplayLog log(String(directory.string().c_str()));
+		log.setLimits(ReplayLimits{0, 10, 0, 0, 50, type});
+		CHECK(log.open());
+		List<RecordedPacket> packets;
+		for (int64_t timestamp = 100; timestamp < 200; ++timestamp)
+		{
+			for (int n = 0; n < 3; ++n)
+			{
+				RecordedPacket packet(makePacket(timestamp, n));
+				packet.timestamp = timestamp;
+				packets.push_back(std::move(packet));
+			}
+		}
+		CHECK(log.append(packets));
+
+		int compacted = 0;
+		while (log.compact(200))
+		{
+			++compacted;
+		}
+		CHECK(compacted == 5);
+		CHECK(hasRange(log, 100, 199));
+		for (int64_t timestamp = 100; timestamp < 200; ++timestamp)
+		{
+			List<SharedBytes> expected;
+			for (int n = 0; n < 3; ++n)
+			{
+				if (timestamp >= 150 || kept(n))
+				{
+					expected.push_back(Socket::serialize(makePacket(timestamp, n)));
+				}
+			}
+			size_t i = 0;
+			log.read(timestamp, [&expected, &i](ByteList &&bytes) {
+				CHECK(i < expected.size() && bytes.size() == expected[i]->size() &&
+					  memcmp(bytes.data(), expected[i]->data(), bytes.size()) == 0);
+				++i;
+				return true;
+			});
+			CHECK(i == expected.size());
+		}
+	}
+
+	// Compacted segments aren't compacted again and the last segment is never compacted
+	ReplayLog log(String(directory.string().c_str()));
+	log.setLimits(ReplayLimits{0, 10, 0, 0, 50, type});
+	CHECK(log.open());
+	int compacted = 0;
+	while (log.compact(100000))
+	{
+		++compacted;
+	}
+	CHECK(compacted == 4);
+	CHECK(count(log, 120) == 1u);
+	CHECK(count(log, 199) == 3u);
+	fs::remove_all(directory);
+}
+} // namespace
+
+void testRetention()
+{
+	testMaxAge();
+	testMaxBytes();
+	// Only the keyframe at the start of each second
+	testCompact(
+		ServerType::Video, [](int64_t, const int n) { return makeFrame(n == 0, static_cast<uint8_t>(n)); },
+		[](const int n) { return n == 0; });
+	// Only the last text of each second
+	testCompact(ServerType::Text, makeText, [](const int n) { return n == 2; });
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "unitTest.hpp"
+
+namespace TemStream
+{
+namespace
+{
+List<uint8_t> makeBytes(const uint8_t first, const size_t count)
+{
+	List<uint8_t> bytes(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		bytes[i] = static_cast<uint8_t>(first + i);
+	}
+	return bytes;
+}
+
+bool hasBytes(RingBuffer &buffer, const uint8_t first, const size_t count)
+{
+	const auto expected = makeBytes(first, count);
+	return buffer.size() >= count && memcmp(buffer.view(count), expected.data(), count) == 0;
+}
+
+void append(RingBuffer &buffer, const uint8_t first, const size_t count)
+{
+	const auto bytes = makeBytes(first, count);
+	buffer.append(bytes.data(), bytes.size());
+}
+
+void testWrapAround()
+{
+	RingBuffer buffer(8);
+	append(buffer, 0, 6);
+	buffer.consume(4);
+	// The last 3 bytes are written to the front of the buffer
+	append(buffer, 6, 5);
+	CHECK(buffer.size() == 7);
+	CHECK(buffer.capacity() == 8);
+	CHECK(hasBytes(buffer, 4, 7));
+
+	buffer.consume(3);
+	CHECK(hasBytes(buffer, 7, 4));
+	buffer.consume(4);
+	CHECK(buffer.empty());
+}
+
+void testGrowWhilePending()
+{
+	RingBuffer buffer(8);
+	append(buffer, 0, 6);
+	buffer.consume(4);
+	append(buffer, 6, 5);
+	// Full and wrapped. The unread bytes must keep their order when the buffer grows.
+	append(buffer, 11, 4);
+	CHECK(buffer.size() == 11);
+	CHECK(buffer.capacity() == 16);
+	CHECK(hasBytes(buffer, 4, 11));
+
+	append(buffer, 15, 40);
+	CHECK(buffer.capacity() == 64);
+	CHECK(hasBytes(buffer, 4, 51));
+}
+
+void testConsumeAll()
+{
+	RingBuffer buffer(4);
+	append(buffer, 0, 3);
+	buffer.consume(3);
+	CHECK(buffer.empty());
+	// Starts over at the front so it doesn't wrap
+	append(buffer, 10, 4);
+	CHECK(buffer.capacity() == 4);
+	CHECK(hasBytes(buffer, 10, 4));
+
+	buffer.clear();
+	CHECK(buffer.empty());
+}
+
+void testShrink()
+{
+	RingBuffer buffer(8);
+	append(buffer, 0, 20);
+	buffer.consume(10);
+	// Only shrinks once it is empty
+	CHECK(buffer.capacity() == 32);
+	buffer.consume(10);
+	CHECK(buffer.empty());
+	CHECK(buffer.capacity() == 32);
+
+	append(buffer, 0, 40);
+	CHECK(buffer.capacity() == 64);
+	CHECK(hasBytes(buffer, 0, 40));
+	buffer.consume(40);
+	CHECK(buffer.capacity() == 8);
+
+	append(buffer, 0, 40);
+	buffer.clear();
+	CHECK(buffer.capacity() == 8);
+	append(buffer, 3, 5);
+	CHECK(hasBytes(buffer, 3, 5));
+}
+
+List<uint8_t> makeMessages(const List<uint8_t> &body, const uint32_t streamId, const size_t count)
+{
+	List<uint8_t> bytes;
+	const auto header = Socket::makeHeader(static_cast<uint32_t>(body.size()), Framing::V2, 0, streamId, false);
+	for (size_t i = 0; i < count; ++i)
+	{
+		bytes.insert(bytes.end(), header->data(), header->data() + header->size());
+		bytes.insert(bytes.end(), body.begin(), body.end());
+	}
+	return bytes;
+}
+
+bool receivedAll(const TestConnection &connection, const List<uint8_t> &body, const uint32_t streamId,
+				 const size_t count)
+{
+	if (connection.messages.size() != count)
+	{
+		return false;
+	}
+	for (const auto &message : connection.messages)
+	{
+		if (message.bytes.size() != body.size() || memcmp(message.bytes.data(), body.data(), body.size()) != 0 ||
+			message.streamId != streamId || message.hasSource)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Send the messages to a connection a few bytes at a time so headers and bodies are split across reads
+ */
+void testSplitReads(const size_t bodySize, const size_t readSize)
+{
+	const auto body = makeBytes(7, bodySize);
+	// Both the stream id and size take more than one byte
+	const auto bytes = makeMessages(body, 300, 3);
+
+	TestConnection connection;
+	for (size_t offset = 0; offset < bytes.size(); offset += readSize)
+	{
+		const size_t size = std::min(readSize, bytes.size() - offset);
+		CHECK(connection.receive(bytes.data() + offset, static_cast<uint32_t>(size)));
+	}
+	CHECK(receivedAll(connection, body, 300, 3));
+}
+} // namespace
+
+void testRingBuffer()
+{
+	testWrapAround();
+	testGrowWhilePending();
+	testConsumeAll();
+	testShrink();
+	testSplitReads(200, 1);
+	testSplitReads(200, 3);
+	testSplitReads(200, 199);
+	// Larger than the connection's buffer so it grows while part of a message is in it
+	testSplitReads(KB(100), 1000);
+}
+} // namespace TemStream
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "unitTest.hpp"
+
+namespace TemStream
+{
+namespace
+{
+/**
+ * Socket that is only used for its outgoing queue. Bytes are taken from the queue with ::gather and ::consume.
+ */
+class TestSocket : public Socket
+{
+  public:
+	TestSocket() : Socket()
+	{
+	}
+
+	bool connect(const char *, const char *) override
+	{
+		return false;
+	}
+
+	bool read(const int, ByteList &, const bool) override
+	{
+		return false;
+	}
+
+	PollState pollWrite(const int) const override
+	{
+		return PollState::GotData;
+	}
+
+	bool getIpAndPort(std::array<char, INET6_ADDRSTRLEN> &, uint16_t &) const override
+	{
+		return false;
+	}
+
+	size_t queued()
+	{
+		return consume(0);
+	}
+
+	bool canFlush()
+	{
+		std::array<ByteSpan, MaxWriteSpans> spans;
+		return gather(spans.data(), spans.size()).has_value();
+	}
+
+  protected:
+	std::optional<uint32_t> write(const uint8_t *, const uint32_t size) override
+	{
+		return size;
+	}
+};
+
+OutgoingPacket makePacket(const uint32_t size, const SendPolicy policy, const bool keyframe = false)
+{
+	const List<uint8_t> bytes(size, 1);
+	return OutgoingPacket(tem_shared<ByteList>(), tem_shared<ByteList>(bytes.data(), size), policy, keyframe);
+}
+
+/**
+ * A stored image is larger than the queue and is partially written when a chat message is sent
+ */
+void testShared()
+{
+	TestSocket socket;
+	socket.setLimits(SendLimits{1000, std::chrono::seconds(10)});
+	socket.send(makePacket(5000, SendPolicy::Shared));
+	CHECK(socket.canFlush());
+	CHECK(socket.consume(2000) == 3000u);
+
+	socket.send(makePacket(100, SendPolicy::Reliable));
+	CHECK(socket.canFlush());
+	CHECK(socket.consume(3000) == 100u);
+
+	// The limit applies again once the shared bytes are written
+	socket.send(makePacket(900, SendPolicy::Reliable));
+	CHECK(socket.canFlush());
+	socket.send(makePacket(1, SendPolicy::Reliable));
+	CHECK(!socket.canFlush());
+}
+
+void testDropOldest()
+{
+	TestSocket socket;
+	socket.setLimits(SendLimits{1000, std::chrono::seconds(10)});
+	socket.send(makePacket(400, SendPolicy::Reliable));
+	socket.send(makePacket(400, SendPolicy::DropOldest));
+	socket.send(makePacket(400, SendPolicy::DropOldest));
+	CHECK(socket.queued() == 800u);
+	CHECK(socket.getDropCounters().queueFull == 1u);
+
+	socket.send(makePacket(400, SendPolicy::Reliable));
+	CHECK(socket.queued() == 800u);
+	CHECK(socket.getDropCounters().queueFull == 2u);
+	CHECK(socket.getDropCounters().bytes == 800u);
+	CHECK(socket.canFlush());
+
+	// Nothing left to drop
+	socket.send(makePacket(400, SendPolicy::Reliable));
+	CHECK(!socket.canFlush());
+}
+
+void testDropUntilKeyframe()
+{
+	TestSocket socket;
+	socket.setLimits(SendLimits{1000, std::chrono::seconds(10)});
+	socket.send(makePacket(500, SendPolicy::Reliable));
+	socket.send(makePacket(400, SendPolicy::DropUntilKeyframe, true));
+	// The keyframe is dropped so the frame after it is too
+	socket.send(makePacket(400, SendPolicy::DropUntilKeyframe));
+	CHECK(socket.queued() == 500u);
+	socket.send(makePacket(200, SendPolicy::DropUntilKeyframe));
+	CHECK(socket.queued() == 500u);
+
+	socket.send(makePacket(200, SendPolicy::DropUntilKeyframe, true));
+	socket.send(makePacket(200, SendPolicy::DropUntilKeyframe));
+	CHECK(socket.queued() == 900u);
+	const auto drops = socket.getDropCounters();
+	CHECK(drops.queueFull == 1u);
+	CHECK(drops.waitingForKeyframe == 2u);
+	CHECK(socket.canFlush());
+}
+
+void testTooOld()
+{
+	TestSocket socket;
+	socket.setLimits(SendLimits{1000, std::chrono::milliseconds(5)});
+	socket.send(makePacket(100, SendPolicy::Reliable));
+	socket.send(makePacket(100, SendPolicy::DropOldest));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	socket.send(makePacket(100, SendPolicy::DropOldest));
+	CHECK(socket.getDropCounters().tooOld == 1u);
+	CHECK(socket.queued() == 200u);
+	// The front message can't be dropped and is too old
+	CHECK(!socket.canFlush());
+}
+} // namespace
+
+void testSendQueue()
+{
+	testShared();
+	testDropOldest();
+	testDropUntilKeyframe();
+	testTooOld();
+}
+} // namespace TemStream
\ No newline at end of file
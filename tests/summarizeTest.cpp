@@ -0,0 +1,69 @@
+#include "unitTest.hpp"
+
+namespace TemStream
+{
+namespace
+{
+/**
+ * Serialize the payload with and without its source and summarize it
+ *
+ * @param payload
+ * @param keyframe Expected keyframe flag or std::nullopt if the payload isn't forwarded
+ */
+void testSummary(Message::Payload &&payload, const std::optional<bool> keyframe)
+{
+	Message::Packet packet;
+	packet.source = Message::Source{Address("localhost", 10000), "Test"};
+	packet.payload = std::move(payload);
+	const auto payloadSize = Socket::serialize(packet, false)->size();
+
+	for (const bool hasSource : {true, false})
+	{
+		const auto bytes = Socket::serialize(packet, hasSource);
+		const auto summary = Message::summarize(bytes->data(), bytes->size(), hasSource);
+		CHECK(summary.has_value() == keyframe.has_value());
+		if (!summary.has_value() || !keyframe.has_value())
+		{
+			continue;
+		}
+		CHECK(summary->type == packet.payload.index());
+		CHECK(summary->keyframe == *keyframe);
+		CHECK(summary->sourceOffset == payloadSize);
+		CHECK(!hasSource || summary->source == packet.source);
+
+		// Cut short anywhere
+		for (uint32_t size = 0; size < bytes->size(); ++size)
+		{
+			CHECK(!Message::summarize(bytes->data(), size, hasSource).has_value());
+		}
+	}
+}
+
+Message::Video makeFrame(const List<uint8_t> &bytes)
+{
+	return Message::Frame{640, 480, ByteList(bytes.data(), static_cast<uint32_t>(bytes.size()))};
+}
+} // namespace
+
+void testSummarize()
+{
+	testSummary(Message::Audio{ByteList(List<uint8_t>(100, 3).data(), 100)}, false);
+	testSummary(Message::Audio{ByteList()}, false);
+
+	// H264 IDR slice, sequence parameter set and a slice that isn't a keyframe
+	testSummary(makeFrame({0, 0, 0, 1, 0x65, 0x88, 0x84}), true);
+	testSummary(makeFrame({0, 0, 0, 1, 0x67, 0x42, 0, 0, 0, 1, 0x65}), true);
+	testSummary(makeFrame({0, 0, 0, 1, 0x41, 0x9a, 0x02}), false);
+	// VP8 key and inter frames
+	testSummary(makeFrame({0x50, 0x42, 0x00, 0x9d, 0x01, 0x2a, 0x80, 0x02}), true);
+	testSummary(makeFrame({0x51, 0x42, 0x00, 0x9d, 0x01, 0x2a, 0x80, 0x02}), false);
+	testSummary(makeFrame({}), false);
+
+	// Only frames are forwarded without being deserialized
+	testSummary(Message::Video(Message::LargeFile(uint64_t(100))), std::nullopt);
+	testSummary(Message::Chat{"Author", "Message", 100}, std::nullopt);
+	testSummary(Message::Text("Text"), std::nullopt);
+	testSummary(Message::Image{Message::LargeFile(uint64_t(100))}, std::nullopt);
+	testSummary(std::monostate{}, std::nullopt);
+}
+} // namespace TemStream
\ No newline at end of file
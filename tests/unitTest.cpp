@@ -0,0 +1,83 @@
+#include "unitTest.hpp"
+
+using namespace TemStream;
+
+bool TemStream::appDone = false;
+AllocatorData TemStream::globalAllocatorData;
+unique_ptr<Logger> TemStream::logger = nullptr;
+const char *TemStream::ApplicationPath = nullptr;
+
+namespace
+{
+struct UnitTest
+{
+	const char *name;
+	void (*run)();
+};
+
+const UnitTest tests[] = {{"RingBuffer", &testRingBuffer}, {"Header", &testHeader}, {"Summarize", &testSummarize},
+							 {"ReplayLog", &testReplayLog}, {"Retention", &testRetention},
+							 {"SendQueue", &testSendQueue}};
+
+int failures = 0;
+} // namespace
+
+void TemStream::initialLogs()
+{
+}
+
+void TemStream::check(const bool passed, const char *expression, const char *file, const int line)
+{
+	if (!passed)
+	{
+		++failures;
+		std::cerr << file << ':' << line << ": Check failed: " << expression << std::endl;
+	}
+}
+
+fs::path TemStream::makeDirectory(const char *name)
+{
+	const auto path = fs::temp_directory_path() / name;
+	fs::remove_all(path);
+	return path;
+}
+
+size_t TemStream::countSegments(const fs::path &directory)
+{
+	size_t count = 0;
+	for (const auto &entry : fs::directory_iterator(directory))
+	{
+		if (entry.path().extension() == ".tsl")
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+/**
+ * Run every test or only the one named by the first argument
+ */
+int main(int argc, char *argv[])
+{
+	globalAllocatorData.init(MB(64));
+	logger = tem_unique<ConsoleLogger>();
+
+	bool found = false;
+	for (const auto &test : tests)
+	{
+		if (argc > 1 && strcmp(argv[1], test.name) != 0)
+		{
+			continue;
+		}
+		found = true;
+		std::cout << "Running " << test.name << std::endl;
+		test.run();
+	}
+	if (!found)
+	{
+		std::cerr << "Unknown test: " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <main.hpp>
+
+/**
+ * Record a failed check without stopping the test
+ */
+#define CHECK(X) TemStream::check((X), #X, __FILE__, __LINE__)
+
+namespace TemStream
+{
+void check(bool, const char *expression, const char *file, int line);
+
+/**
+ * Get an empty directory for a test's files
+ *
+ * @param name Name of the directory in the temporary directory. It is removed if it exists.
+ *
+ * @return The path of the directory. The directory itself isn't created.
+ */
+fs::path makeDirectory(const char *name);
+
+/**
+ * @param directory
+ *
+ * @return The number of replay segments in the directory
+ */
+size_t countSegments(const fs::path &directory);
+
+/**
+ * Connection that keeps the messages it receives as bytes instead of deserializing them
+ */
+class TestConnection : public Connection
+{
+  public:
+	struct Received
+	{
+		ByteList bytes;
+		uint32_t streamId;
+		bool hasSource;
+	};
+
+	List<Received> messages;
+
+	using Connection::decodeHeader;
+
+	TestConnection() : Connection(Address("localhost", 0), nullptr), messages()
+	{
+	}
+
+	void setMaxMessageSize(const uint64_t size)
+	{
+		maxMessageSize = size;
+	}
+
+  protected:
+	bool tryForward(const uint8_t *data, const size_t size, const uint32_t streamId, const bool hasSource) override
+	{
+		messages.push_back(Received{ByteList(data, static_cast<uint32_t>(size)), streamId, hasSource});
+		return true;
+	}
+};
+
+void testRingBuffer();
+void testHeader();
+void testSummarize();
+void testReplayLog();
+void testRetention();
+void testSendQueue();
+} // namespace TemStream
\ No newline at end of file